@@ -4122,6 +4122,23 @@ AC_DEFUN([LINUX_CONFIG_COMPAT],
 		AC_MSG_RESULT(no)
 	])
 
+	AC_MSG_CHECKING([if device.h struct device_driver has probe_type])
+	MLNX_BG_LB_LINUX_TRY_COMPILE([
+		#include <linux/device.h>
+	],[
+		struct device_driver drv = {
+			.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		};
+
+		return 0;
+	],[
+		AC_MSG_RESULT(yes)
+		MLNX_AC_DEFINE(HAVE_DEVICE_DRIVER_PROBE_TYPE, 1,
+			  [struct device_driver has probe_type])
+	],[
+		AC_MSG_RESULT(no)
+	])
+
 	AC_MSG_CHECKING([if net_namespace.h has register_net_sysctl])
 	MLNX_BG_LB_LINUX_TRY_COMPILE([
 		#include <net/net_namespace.h>
@@ -41,21 +41,66 @@
 
 #include "mlx4.h"
 
+/* mlx4_bitmap keeps a summary bitmap next to the object table: bit w of
+ * bitmap->full is set when word w of bitmap->table has no free object.
+ * Searches skip full words through the summary instead of walking them.
+ */
+static void mlx4_bitmap_sync_full(struct mlx4_bitmap *bitmap, u32 start,
+				  int cnt)
+{
+	u32 w, last_w;
+
+	if (!cnt)
+		return;
+
+	last_w = BIT_WORD(start + cnt - 1);
+	for (w = BIT_WORD(start); w <= last_w; w++) {
+		if (bitmap->table[w] == ~0UL)
+			__set_bit(w, bitmap->full);
+		else
+			__clear_bit(w, bitmap->full);
+	}
+}
+
+/* First free object at or after pos, or >= bitmap->max if none */
+static u32 mlx4_bitmap_next_zero(struct mlx4_bitmap *bitmap, u32 pos)
+{
+	u32 nwords = BITS_TO_LONGS(bitmap->max);
+	u32 w = BIT_WORD(pos);
+	unsigned long word;
+
+	if (pos >= bitmap->max)
+		return bitmap->max;
+
+	/* rest of the word pos falls in */
+	word = ~bitmap->table[w] & BITMAP_FIRST_WORD_MASK(pos);
+	if (word)
+		return min(w * BITS_PER_LONG + __ffs(word), bitmap->max);
+
+	w = find_next_zero_bit(bitmap->full, nwords, w + 1);
+	if (w >= nwords)
+		return bitmap->max;
+
+	return min(w * BITS_PER_LONG + (u32)ffz(bitmap->table[w]),
+		   bitmap->max);
+}
+
 u32 mlx4_bitmap_alloc(struct mlx4_bitmap *bitmap)
 {
 	u32 obj;
 
 	spin_lock(&bitmap->lock);
 
-	obj = find_next_zero_bit(bitmap->table, bitmap->max, bitmap->last);
+	obj = mlx4_bitmap_next_zero(bitmap, bitmap->last);
 	if (obj >= bitmap->max) {
 		bitmap->top = (bitmap->top + bitmap->max + bitmap->reserved_top)
 				& bitmap->mask;
-		obj = find_first_zero_bit(bitmap->table, bitmap->max);
+		obj = mlx4_bitmap_next_zero(bitmap, 0);
 	}
 
 	if (obj < bitmap->max) {
 		set_bit(obj, bitmap->table);
+		mlx4_bitmap_sync_full(bitmap, obj, 1);
 		bitmap->last = (obj + 1);
 		if (bitmap->last == bitmap->max)
 			bitmap->last = 0;
@@ -76,33 +121,70 @@ void mlx4_bitmap_free(struct mlx4_bitmap *bitmap, u32 obj, int use_rr)
 	mlx4_bitmap_free_range(bitmap, obj, 1, use_rr);
 }
 
-static unsigned long find_aligned_range(unsigned long *bitmap,
+/* Smallest value >= x with none of the skip_mask bits set, given that x
+ * has some of them set.
+ */
+static u32 skip_mask_next(u32 x, u32 skip_mask)
+{
+	u32 high = 1U << (fls(x & skip_mask) - 1);
+
+	x |= high - 1;
+	return ((x | skip_mask) + 1) & ~skip_mask;
+}
+
+/* Smallest value >= x with one of the skip_mask bits set */
+static u64 skip_mask_first(u32 x, u32 skip_mask)
+{
+	unsigned long mask = skip_mask;
+	u64 first = (u64)-1;
+	u64 i;
+	int b;
+
+	for_each_set_bit(b, &mask, 32) {
+		i = ((u64)x | (1ULL << b)) & ~((1ULL << b) - 1);
+		if (i < first)
+			first = i;
+	}
+
+	return first;
+}
+
+static unsigned long find_aligned_range(struct mlx4_bitmap *bitmap,
 					u32 start, u32 nbits,
 					int len, int align, u32 skip_mask)
 {
-	unsigned long end, i;
+	u32 busy;
 
 again:
 	start = ALIGN(start, align);
-
-	while ((start < nbits) && (test_bit(start, bitmap) ||
-				   (start & skip_mask)))
-		start += align;
-
-	if (start >= nbits)
+	if ((u64)start + len > nbits)
 		return -1;
 
-	end = start+len;
-	if (end > nbits)
-		return -1;
-
-	for (i = start + 1; i < end; i++) {
-		if (test_bit(i, bitmap) || ((u32)i & skip_mask)) {
-			start = i + 1;
+	/* never start a range inside a run of used objects */
+	busy = start;
+	start = mlx4_bitmap_next_zero(bitmap, start);
+	if (start != busy)
+		goto again;
+
+	if (skip_mask) {
+		if (start & skip_mask) {
+			start = skip_mask_next(start, skip_mask);
+			if (!start)
+				return -1;
+			goto again;
+		}
+		if (skip_mask_first(start, skip_mask) < (u64)start + len) {
+			start = skip_mask_first(start, skip_mask);
 			goto again;
 		}
 	}
 
+	busy = find_next_bit(bitmap->table, start + len, start);
+	if (busy < start + len) {
+		start = busy + 1;
+		goto again;
+	}
+
 	return start;
 }
 
@@ -116,17 +198,18 @@ u32 mlx4_bitmap_alloc_range(struct mlx4_bitmap *bitmap, int cnt,
 
 	spin_lock(&bitmap->lock);
 
-	obj = find_aligned_range(bitmap->table, bitmap->last,
+	obj = find_aligned_range(bitmap, bitmap->last,
 				 bitmap->max, cnt, align, skip_mask);
 	if (obj >= bitmap->max) {
 		bitmap->top = (bitmap->top + bitmap->max + bitmap->reserved_top)
 				& bitmap->mask;
-		obj = find_aligned_range(bitmap->table, 0, bitmap->max,
+		obj = find_aligned_range(bitmap, 0, bitmap->max,
 					 cnt, align, skip_mask);
 	}
 
 	if (obj < bitmap->max) {
 		bitmap_set(bitmap->table, obj, cnt);
+		mlx4_bitmap_sync_full(bitmap, obj, cnt);
 		if (obj == bitmap->last) {
 			bitmap->last = (obj + cnt);
 			if (bitmap->last >= bitmap->max)
@@ -166,6 +249,7 @@ void mlx4_bitmap_free_range(struct mlx4_bitmap *bitmap, u32 obj, int cnt,
 				& bitmap->mask;
 	}
 	bitmap_clear(bitmap->table, obj, cnt);
+	mlx4_bitmap_sync_full(bitmap, obj, cnt);
 	bitmap->avail += cnt;
 	spin_unlock(&bitmap->lock);
 }
@@ -190,13 +274,22 @@ int mlx4_bitmap_init(struct mlx4_bitmap *bitmap, u32 num, u32 mask,
 	if (!bitmap->table)
 		return -ENOMEM;
 
+	bitmap->full = kzalloc(BITS_TO_LONGS(BITS_TO_LONGS(bitmap->max)) *
+			       sizeof(long), GFP_KERNEL);
+	if (!bitmap->full) {
+		kfree(bitmap->table);
+		return -ENOMEM;
+	}
+
 	bitmap_set(bitmap->table, 0, reserved_bot);
+	mlx4_bitmap_sync_full(bitmap, 0, reserved_bot);
 
 	return 0;
 }
 
 void mlx4_bitmap_cleanup(struct mlx4_bitmap *bitmap)
 {
+	kfree(bitmap->full);
 	kfree(bitmap->table);
 }
 
@@ -1648,8 +1648,9 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 {
 	struct mlx4_priv *priv = mlx4_priv(dev);
 	struct mlx4_cmd_info *cmd = NULL;
-	struct mlx4_vhcr_cmd *vhcr_cmd = in_vhcr ? in_vhcr : priv->mfunc.vhcr;
+	struct mlx4_vhcr_cmd *vhcr_cmd = in_vhcr;
 	struct mlx4_vhcr *vhcr;
+	struct mlx4_cmd_mailbox *vhcr_mailbox = NULL;
 	struct mlx4_cmd_mailbox *inbox = NULL;
 	struct mlx4_cmd_mailbox *outbox = NULL;
 	u64 in_param;
@@ -1663,9 +1664,18 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 	if (!vhcr)
 		return -ENOMEM;
 
-	/* DMA in the vHCR */
+	/* DMA in the vHCR, into a private buffer so that several slaves
+	 * can be serviced at once
+	 */
 	if (!in_vhcr) {
-		ret = mlx4_ACCESS_MEM(dev, priv->mfunc.vhcr_dma, slave,
+		vhcr_mailbox = mlx4_alloc_cmd_mailbox(dev);
+		if (IS_ERR(vhcr_mailbox)) {
+			kfree(vhcr);
+			return PTR_ERR(vhcr_mailbox);
+		}
+		vhcr_cmd = vhcr_mailbox->buf;
+
+		ret = mlx4_ACCESS_MEM(dev, vhcr_mailbox->dma, slave,
 				      priv->mfunc.master.slave_state[slave].vhcr_dma,
 				      ALIGN(sizeof(struct mlx4_vhcr_cmd),
 					    MLX4_ACCESS_MEM_ALIGN), 1);
@@ -1675,6 +1685,7 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 				mlx4_err(dev, "%s: Failed reading vhcr ret: 0x%x\n",
 					 __func__, ret);
 			kfree(vhcr);
+			mlx4_free_cmd_mailbox(dev, vhcr_mailbox);
 			return ret;
 		}
 	}
@@ -1743,7 +1754,12 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 		}
 	}
 
-	/* Execute the command! */
+	/* Execute the command!  Wrappers update master state shared by all
+	 * functions, so execution stays serialized; the PF's own commands
+	 * come in with in_vhcr and already hold slave_cmd_mutex.
+	 */
+	if (!in_vhcr)
+		mutex_lock(&priv->cmd.slave_cmd_mutex);
 	if (cmd->wrapper) {
 		err = cmd->wrapper(dev, slave, vhcr, inbox, outbox,
 				   cmd);
@@ -1765,6 +1781,8 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 			vhcr_cmd->out_param = cpu_to_be64(vhcr->out_param);
 		}
 	}
+	if (!in_vhcr)
+		mutex_unlock(&priv->cmd.slave_cmd_mutex);
 
 	if (err) {
 		if (!(dev->persist->state & MLX4_DEVICE_STATE_INTERNAL_ERROR))
@@ -1796,7 +1814,12 @@ static int mlx4_master_process_vhcr(struct mlx4_dev *dev, int slave,
 out_status:
 	/* DMA back vhcr result */
 	if (!in_vhcr) {
-		ret = mlx4_ACCESS_MEM(dev, priv->mfunc.vhcr_dma, slave,
+		/* Slaves are served in parallel and GEN_EQE stamps the
+		 * slave's token into the EQE, so each needs its own copy.
+		 */
+		struct mlx4_eqe cmd_eqe = priv->mfunc.master.cmd_eqe;
+
+		ret = mlx4_ACCESS_MEM(dev, vhcr_mailbox->dma, slave,
 				      priv->mfunc.master.slave_state[slave].vhcr_dma,
 				      ALIGN(sizeof(struct mlx4_vhcr),
 					    MLX4_ACCESS_MEM_ALIGN),
@@ -1805,7 +1828,7 @@ out_status:
 			mlx4_err(dev, "%s:Failed writing vhcr result\n",
 				 __func__);
 		else if (vhcr->e_bit &&
-			 mlx4_GEN_EQE(dev, slave, &priv->mfunc.master.cmd_eqe))
+			 mlx4_GEN_EQE(dev, slave, &cmd_eqe))
 				mlx4_warn(dev, "Failed to generate command completion eqe for slave %d\n",
 					  slave);
 	}
@@ -1814,6 +1837,7 @@ out:
 	kfree(vhcr);
 	mlx4_free_cmd_mailbox(dev, inbox);
 	mlx4_free_cmd_mailbox(dev, outbox);
+	mlx4_free_cmd_mailbox(dev, vhcr_mailbox);
 	return ret;
 }
 
@@ -2132,14 +2156,11 @@ static void mlx4_master_do_cmd(struct mlx4_dev *dev, int slave, u8 cmd,
 			goto reset_slave;
 		}
 
-		mutex_lock(&priv->cmd.slave_cmd_mutex);
 		if (mlx4_master_process_vhcr(dev, slave, NULL)) {
 			mlx4_err(dev, "Failed processing vhcr for slave:%d, resetting slave\n",
 				 slave);
-			mutex_unlock(&priv->cmd.slave_cmd_mutex);
 			goto reset_slave;
 		}
-		mutex_unlock(&priv->cmd.slave_cmd_mutex);
 		break;
 	default:
 		mlx4_warn(dev, "Bad comm cmd:%d from slave:%d\n", cmd, slave);
@@ -2189,7 +2210,54 @@ inform_slave_state:
 	wmb();
 }
 
-/* master command processing */
+/* Service the pending comm channel command of one slave.  Each slave has
+ * a single work item, so its commands are never handled concurrently or
+ * out of order, while different slaves proceed in parallel.
+ */
+static void mlx4_master_slave_comm(struct work_struct *work)
+{
+	struct mlx4_slave_comm *sc =
+		container_of(work, struct mlx4_slave_comm, work);
+	struct mlx4_priv *priv = sc->priv;
+	struct mlx4_mfunc *mfunc = &priv->mfunc;
+	struct mlx4_slave_state *s_state =
+		&mfunc->master.slave_state[sc->slave];
+	int slave = sc->slave;
+	u64 start = local_clock();
+	u64 ns;
+	u32 comm_cmd;
+	u32 slt;
+	int toggle;
+
+	ns = start - sc->queued;
+	sc->queue_ns += ns;
+	if (ns > sc->max_queue_ns)
+		sc->max_queue_ns = ns;
+
+	comm_cmd = swab32(readl(&mfunc->comm[slave].slave_write));
+	slt = swab32(readl(&mfunc->comm[slave].slave_read)) >> 31;
+	toggle = comm_cmd >> 31;
+	if (toggle == slt) {
+		++sc->spurious;
+		return;
+	}
+
+	if (s_state->comm_toggle != slt) {
+		pr_info("slave %d out of sync. read toggle %d, state toggle %d. Resynching.\n",
+			slave, slt, s_state->comm_toggle);
+		s_state->comm_toggle = slt;
+	}
+	mlx4_master_do_cmd(&priv->dev, slave, comm_cmd >> 16 & 0xff,
+			   comm_cmd & 0xffff, toggle);
+
+	ns = local_clock() - start;
+	sc->service_ns += ns;
+	if (ns > sc->max_service_ns)
+		sc->max_service_ns = ns;
+	++sc->cmds;
+}
+
+/* master command processing: dispatch armed slaves to the worker pool */
 void mlx4_master_comm_channel(struct work_struct *work)
 {
 	struct mlx4_mfunc_master_ctx *master =
@@ -2201,14 +2269,10 @@ void mlx4_master_comm_channel(struct work_struct *work)
 	struct mlx4_priv *priv =
 		container_of(mfunc, struct mlx4_priv, mfunc);
 	struct mlx4_dev *dev = &priv->dev;
+	struct mlx4_slave_comm *sc;
 	__be32 *bit_vec;
-	u32 comm_cmd;
 	u32 vec;
 	int i, j, slave;
-	int toggle;
-	int served = 0;
-	int reported = 0;
-	u32 slt;
 
 	bit_vec = master->comm_arm_bit_vector;
 	for (i = 0; i < COMM_CHANNEL_BIT_ARRAY_SIZE; i++) {
@@ -2216,38 +2280,49 @@ void mlx4_master_comm_channel(struct work_struct *work)
 		for (j = 0; j < 32; j++) {
 			if (!(vec & (1 << j)))
 				continue;
-			++reported;
 			slave = (i * 32) + j;
-			comm_cmd = swab32(readl(
-					  &mfunc->comm[slave].slave_write));
-			slt = swab32(readl(&mfunc->comm[slave].slave_read))
-				     >> 31;
-			toggle = comm_cmd >> 31;
-			if (toggle != slt) {
-				if (master->slave_state[slave].comm_toggle
-				    != slt) {
-					pr_info("slave %d out of sync. read toggle %d, state toggle %d. Resynching.\n",
-						slave, slt,
-						master->slave_state[slave].comm_toggle);
-					master->slave_state[slave].comm_toggle =
-						slt;
-				}
-				mlx4_master_do_cmd(dev, slave,
-						   comm_cmd >> 16 & 0xff,
-						   comm_cmd & 0xffff, toggle);
-				++served;
-			}
+			if (slave >= dev->num_slaves)
+				continue;
+			sc = &master->slave_comm[slave];
+			/* an already pending work will see the new command */
+			if (!work_pending(&sc->work))
+				sc->queued = local_clock();
+			queue_work(master->comm_slave_wq, &sc->work);
 		}
 	}
 
-	if (reported && reported != served)
-		mlx4_warn(dev, "Got command event with bitmask from %d slaves but %d were served\n",
-			  reported, served);
-
 	if (mlx4_ARM_COMM_CHANNEL(dev))
 		mlx4_warn(dev, "Failed to arm comm channel events\n");
 }
 
+/* Per-slave comm channel command count, queueing and service latency */
+static ssize_t show_comm_stats(struct device *d, struct device_attribute *attr,
+			       char *buf)
+{
+	struct mlx4_priv *priv = container_of(attr, struct mlx4_priv,
+					      mfunc.master.comm_stats_attr);
+	struct mlx4_slave_comm *sc;
+	ssize_t len = 0;
+	int slave;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "slave cmds spurious queue_avg_us queue_max_us service_avg_us service_max_us\n");
+	for (slave = 0; slave < priv->dev.num_slaves; slave++) {
+		sc = &priv->mfunc.master.slave_comm[slave];
+		if (!sc->cmds)
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%5d %llu %llu %llu %llu %llu %llu\n", slave,
+				 sc->cmds, sc->spurious,
+				 div64_u64(sc->queue_ns, sc->cmds) / NSEC_PER_USEC,
+				 div64_u64(sc->max_queue_ns, NSEC_PER_USEC),
+				 div64_u64(sc->service_ns, sc->cmds) / NSEC_PER_USEC,
+				 div64_u64(sc->max_service_ns, NSEC_PER_USEC));
+	}
+
+	return len;
+}
+
 static int sync_toggles(struct mlx4_dev *dev)
 {
 	struct mlx4_priv *priv = mlx4_priv(dev);
@@ -2402,8 +2477,39 @@ int mlx4_multi_func_init(struct mlx4_dev *dev)
 		if (!priv->mfunc.master.comm_wq)
 			goto err_slaves;
 
-		if (mlx4_init_resource_tracker(dev))
+		priv->mfunc.master.slave_comm =
+			kcalloc(dev->num_slaves,
+				sizeof(*priv->mfunc.master.slave_comm),
+				GFP_KERNEL);
+		if (!priv->mfunc.master.slave_comm)
 			goto err_thread;
+		for (i = 0; i < dev->num_slaves; i++) {
+			struct mlx4_slave_comm *sc =
+				&priv->mfunc.master.slave_comm[i];
+
+			INIT_WORK(&sc->work, mlx4_master_slave_comm);
+			sc->priv = priv;
+			sc->slave = i;
+		}
+		priv->mfunc.master.comm_slave_wq =
+			alloc_workqueue("mlx4_comm_slave", WQ_UNBOUND |
+					WQ_MEM_RECLAIM, MLX4_COMM_WORKERS);
+		if (!priv->mfunc.master.comm_slave_wq)
+			goto err_slave_comm;
+
+		if (mlx4_init_resource_tracker(dev))
+			goto err_slave_wq;
+
+		sysfs_attr_init(&priv->mfunc.master.comm_stats_attr.attr);
+		priv->mfunc.master.comm_stats_attr.attr.name =
+			"comm_channel_stats";
+		priv->mfunc.master.comm_stats_attr.attr.mode = S_IRUGO;
+		priv->mfunc.master.comm_stats_attr.show = show_comm_stats;
+		if (device_create_file(&dev->persist->pdev->dev,
+				       &priv->mfunc.master.comm_stats_attr)) {
+			mlx4_warn(dev, "Failed to create comm channel stats file\n");
+			priv->mfunc.master.comm_stats_attr.attr.name = NULL;
+		}
 
 	} else {
 		err = sync_toggles(dev);
@@ -2414,6 +2520,10 @@ int mlx4_multi_func_init(struct mlx4_dev *dev)
 	}
 	return 0;
 
+err_slave_wq:
+	destroy_workqueue(priv->mfunc.master.comm_slave_wq);
+err_slave_comm:
+	kfree(priv->mfunc.master.slave_comm);
 err_thread:
 	flush_workqueue(priv->mfunc.master.comm_wq);
 	destroy_workqueue(priv->mfunc.master.comm_wq);
@@ -2518,8 +2628,14 @@ void mlx4_multi_func_cleanup(struct mlx4_dev *dev)
 	int i, port;
 
 	if (mlx4_is_master(dev)) {
+		if (priv->mfunc.master.comm_stats_attr.attr.name)
+			device_remove_file(&dev->persist->pdev->dev,
+					   &priv->mfunc.master.comm_stats_attr);
+		/* the dispatcher feeds the slave pool, drain it first */
 		flush_workqueue(priv->mfunc.master.comm_wq);
+		destroy_workqueue(priv->mfunc.master.comm_slave_wq);
 		destroy_workqueue(priv->mfunc.master.comm_wq);
+		kfree(priv->mfunc.master.slave_comm);
 		for (i = 0; i < dev->num_slaves; i++) {
 			for (port = 1; port <= MLX4_MAX_PORTS; port++)
 				kfree(priv->mfunc.master.slave_state[i].vlan_filter[port]);
@@ -36,6 +36,7 @@
 
 #include <linux/hardirq.h>
 #include <linux/export.h>
+#include <linux/vmalloc.h>
 
 #include <linux/mlx4/cmd.h>
 #include <linux/mlx4/cq.h>
@@ -97,13 +98,55 @@ static void mlx4_add_cq_to_tasklet(struct mlx4_cq *cq)
 	spin_unlock_irqrestore(&tasklet_ctx->lock, flags);
 }
 
+/* Must be called under rcu_read_lock() */
+static struct mlx4_cq *mlx4_cq_lookup(struct mlx4_dev *dev, u32 cqn)
+{
+	struct mlx4_cq_table *cq_table = &mlx4_priv(dev)->cq_table;
+	struct mlx4_cq *cq;
+
+	cqn &= dev->caps.num_cqs - 1;
+	if (likely(cq_table->array)) {
+		cq = rcu_dereference(cq_table->array[cqn &
+						     cq_table->array_mask]);
+		if (likely(cq && cq->cqn == cqn))
+			return cq;
+	}
+
+	return radix_tree_lookup(&cq_table->tree, cqn);
+}
+
+static void mlx4_cq_array_insert(struct mlx4_cq_table *cq_table,
+				 struct mlx4_cq *cq)
+{
+	struct mlx4_cq __rcu **slot;
+
+	if (!cq_table->array)
+		return;
+
+	slot = &cq_table->array[cq->cqn & cq_table->array_mask];
+	if (!rcu_access_pointer(*slot))
+		rcu_assign_pointer(*slot, cq);
+}
+
+static void mlx4_cq_array_remove(struct mlx4_cq_table *cq_table,
+				 struct mlx4_cq *cq)
+{
+	struct mlx4_cq __rcu **slot;
+
+	if (!cq_table->array)
+		return;
+
+	slot = &cq_table->array[cq->cqn & cq_table->array_mask];
+	if (rcu_access_pointer(*slot) == cq)
+		RCU_INIT_POINTER(*slot, NULL);
+}
+
 void mlx4_cq_completion(struct mlx4_dev *dev, u32 cqn)
 {
 	struct mlx4_cq *cq;
 
 	rcu_read_lock();
-	cq = radix_tree_lookup(&mlx4_priv(dev)->cq_table.tree,
-			       cqn & (dev->caps.num_cqs - 1));
+	cq = mlx4_cq_lookup(dev, cqn);
 	rcu_read_unlock();
 
 	if (!cq) {
@@ -118,11 +161,10 @@ void mlx4_cq_completion(struct mlx4_dev *dev, u32 cqn)
 
 void mlx4_cq_event(struct mlx4_dev *dev, u32 cqn, int event_type)
 {
-	struct mlx4_cq_table *cq_table = &mlx4_priv(dev)->cq_table;
 	struct mlx4_cq *cq;
 
 	rcu_read_lock();
-	cq = radix_tree_lookup(&cq_table->tree, cqn & (dev->caps.num_cqs - 1));
+	cq = mlx4_cq_lookup(dev, cqn);
 	rcu_read_unlock();
 
 	if (cq) {
@@ -440,6 +482,12 @@ int mlx4_cq_alloc(struct mlx4_dev *dev, int nent,
 	INIT_LIST_HEAD(&cq->tasklet_ctx.list);
 
 	cq->irq = priv->eq_table.eq[MLX4_CQ_TO_EQ_VECTOR(vector)].irq;
+
+	/* Publish in the array only once the CQ is fully initialized */
+	spin_lock(&cq_table->lock);
+	mlx4_cq_array_insert(cq_table, cq);
+	spin_unlock(&cq_table->lock);
+
 	return 0;
 
 err_radix:
@@ -466,6 +514,7 @@ void mlx4_cq_free(struct mlx4_dev *dev, struct mlx4_cq *cq)
 
 	spin_lock(&cq_table->lock);
 	radix_tree_delete(&cq_table->tree, cq->cqn);
+	mlx4_cq_array_remove(cq_table, cq);
 	spin_unlock(&cq_table->lock);
 
 	synchronize_irq(priv->eq_table.eq[MLX4_CQ_TO_EQ_VECTOR(cq->vector)].irq);
@@ -474,6 +523,16 @@ void mlx4_cq_free(struct mlx4_dev *dev, struct mlx4_cq *cq)
 	    priv->eq_table.eq[MLX4_EQ_ASYNC].irq)
 		synchronize_irq(priv->eq_table.eq[MLX4_EQ_ASYNC].irq);
 
+	/* A budgeted EQ is also polled from its tasklet; wait for any pass
+	 * that may still have looked this CQ up to finish. Later passes no
+	 * longer find it in the table. The tasklets are shared by every CQ
+	 * on the EQ, so only wait for the running pass; tasklet_kill()
+	 * would drop a reschedule and leave the EQ unarmed.
+	 */
+	tasklet_unlock_wait(&priv->eq_table.eq[MLX4_CQ_TO_EQ_VECTOR(cq->vector)].
+			    poll_task);
+	tasklet_unlock_wait(&priv->eq_table.eq[MLX4_EQ_ASYNC].poll_task);
+
 	if (atomic_dec_and_test(&cq->refcount))
 		complete(&cq->free);
 	wait_for_completion(&cq->free);
@@ -485,25 +544,42 @@ EXPORT_SYMBOL_GPL(mlx4_cq_free);
 int mlx4_init_cq_table(struct mlx4_dev *dev)
 {
 	struct mlx4_cq_table *cq_table = &mlx4_priv(dev)->cq_table;
+	u32 size;
 	int err;
 
 	spin_lock_init(&cq_table->lock);
 	INIT_RADIX_TREE(&cq_table->tree, GFP_ATOMIC);
+
+	/* Not fatal, lookups fall back to the radix tree */
+	size = min_t(u32, dev->caps.num_cqs, 1 << MLX4_CQ_ARRAY_MAX_LOG_SIZE);
+	cq_table->array = kcalloc(size, sizeof(*cq_table->array),
+				  GFP_KERNEL | __GFP_NOWARN);
+	if (!cq_table->array)
+		cq_table->array = vzalloc(size * sizeof(*cq_table->array));
+	cq_table->array_mask = cq_table->array ? size - 1 : 0;
+
 	if (mlx4_is_slave(dev))
 		return 0;
 
 	err = mlx4_bitmap_init(&cq_table->bitmap, dev->caps.num_cqs,
 			       dev->caps.num_cqs - 1, dev->caps.reserved_cqs, 0);
-	if (err)
+	if (err) {
+		kvfree(cq_table->array);
+		cq_table->array = NULL;
 		return err;
+	}
 
 	return 0;
 }
 
 void mlx4_cleanup_cq_table(struct mlx4_dev *dev)
 {
+	struct mlx4_cq_table *cq_table = &mlx4_priv(dev)->cq_table;
+
+	kvfree(cq_table->array);
+	cq_table->array = NULL;
 	if (mlx4_is_slave(dev))
 		return;
 	/* Nothing to do to clean up radix_tree */
-	mlx4_bitmap_cleanup(&mlx4_priv(dev)->cq_table.bitmap);
+	mlx4_bitmap_cleanup(&cq_table->bitmap);
 }
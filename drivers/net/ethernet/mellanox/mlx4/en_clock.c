@@ -59,16 +59,59 @@ u64 mlx4_en_get_cqe_ts(struct mlx4_cqe *cqe)
 	return hi | lo;
 }
 
+/* mlx4_en_update_ts_snapshot - publish the timecounter state to readers
+ * of mlx4_en_fill_hwtstamps(). Called with clock_lock held, after every
+ * change to mdev->clock or mdev->cycles.
+ */
+static void mlx4_en_update_ts_snapshot(struct mlx4_en_dev *mdev)
+{
+	struct mlx4_en_ts_snapshot *snap = &mdev->ts_snapshot;
+
+	write_seqcount_begin(&snap->seq);
+	snap->mult = mdev->cycles.mult;
+	snap->shift = mdev->cycles.shift;
+	snap->mask = mdev->cycles.mask;
+	snap->cycle_last = mdev->clock.cycle_last;
+	snap->nsec = mdev->clock.nsec;
+#ifdef HAVE_CYCLECOUNTER_CYC2NS_4_PARAMS
+	snap->frac = mdev->clock.frac;
+#endif
+	write_seqcount_end(&snap->seq);
+}
+
+/* Same conversion as timecounter_cyc2time(), on a snapshot */
+static inline u64 mlx4_en_ts_cyc2time(const struct mlx4_en_ts_snapshot *snap,
+				      u64 cycles)
+{
+	u64 delta = (cycles - snap->cycle_last) & snap->mask;
+	u64 frac = 0;
+
+#ifdef HAVE_CYCLECOUNTER_CYC2NS_4_PARAMS
+	frac = snap->frac;
+#endif
+	/* Timestamps older than cycle_last come from before the last
+	 * timecounter update and are converted backwards.
+	 */
+	if (delta > snap->mask / 2) {
+		delta = (snap->cycle_last - cycles) & snap->mask;
+		return snap->nsec - ((delta * snap->mult - frac) >> snap->shift);
+	}
+
+	return snap->nsec + ((delta * snap->mult + frac) >> snap->shift);
+}
+
 void mlx4_en_fill_hwtstamps(struct mlx4_en_dev *mdev,
 			    struct skb_shared_hwtstamps *hwts,
 			    u64 timestamp)
 {
-	unsigned long flags;
+	const struct mlx4_en_ts_snapshot *snap = &mdev->ts_snapshot;
+	unsigned int seq;
 	u64 nsec;
 
-	read_lock_irqsave(&mdev->clock_lock, flags);
-	nsec = timecounter_cyc2time(&mdev->clock, timestamp);
-	read_unlock_irqrestore(&mdev->clock_lock, flags);
+	do {
+		seq = read_seqcount_begin(&snap->seq);
+		nsec = mlx4_en_ts_cyc2time(snap, timestamp);
+	} while (read_seqcount_retry(&snap->seq, seq));
 
 	memset(hwts, 0, sizeof(struct skb_shared_hwtstamps));
 	hwts->hwtstamp = ns_to_ktime(nsec);
@@ -98,9 +141,10 @@ void mlx4_en_ptp_overflow_check(struct mlx4_en_dev *mdev)
 	unsigned long flags;
 
 	if (timeout) {
-		write_lock_irqsave(&mdev->clock_lock, flags);
+		spin_lock_irqsave(&mdev->clock_lock, flags);
 		timecounter_read(&mdev->clock);
-		write_unlock_irqrestore(&mdev->clock_lock, flags);
+		mlx4_en_update_ts_snapshot(mdev);
+		spin_unlock_irqrestore(&mdev->clock_lock, flags);
 		mdev->last_overflow_check = jiffies;
 	}
 }
@@ -132,10 +176,11 @@ static int mlx4_en_phc_adjfreq(struct ptp_clock_info *ptp, s32 delta)
 	adj *= delta;
 	diff = div_u64(adj, 1000000000ULL);
 
-	write_lock_irqsave(&mdev->clock_lock, flags);
+	spin_lock_irqsave(&mdev->clock_lock, flags);
 	timecounter_read(&mdev->clock);
 	mdev->cycles.mult = neg_adj ? mult - diff : mult + diff;
-	write_unlock_irqrestore(&mdev->clock_lock, flags);
+	mlx4_en_update_ts_snapshot(mdev);
+	spin_unlock_irqrestore(&mdev->clock_lock, flags);
 
 	return 0;
 }
@@ -153,9 +198,10 @@ static int mlx4_en_phc_adjtime(struct ptp_clock_info *ptp, s64 delta)
 						ptp_clock_info);
 	unsigned long flags;
 
-	write_lock_irqsave(&mdev->clock_lock, flags);
+	spin_lock_irqsave(&mdev->clock_lock, flags);
 	timecounter_adjtime(&mdev->clock, delta);
-	write_unlock_irqrestore(&mdev->clock_lock, flags);
+	mlx4_en_update_ts_snapshot(mdev);
+	spin_unlock_irqrestore(&mdev->clock_lock, flags);
 
 	return 0;
 }
@@ -181,9 +227,10 @@ static int mlx4_en_phc_gettime(struct ptp_clock_info *ptp,
 	u32 remainder;
 	u64 ns;
 
-	write_lock_irqsave(&mdev->clock_lock, flags);
+	spin_lock_irqsave(&mdev->clock_lock, flags);
 	ns = timecounter_read(&mdev->clock);
-	write_unlock_irqrestore(&mdev->clock_lock, flags);
+	mlx4_en_update_ts_snapshot(mdev);
+	spin_unlock_irqrestore(&mdev->clock_lock, flags);
 
 	ts->tv_sec = div_u64_rem(ns, NSEC_PER_SEC, &remainder);
 	ts->tv_nsec = remainder;
@@ -216,9 +263,10 @@ static int mlx4_en_phc_settime(struct ptp_clock_info *ptp,
 	unsigned long flags;
 
 	/* reset the timecounter */
-	write_lock_irqsave(&mdev->clock_lock, flags);
+	spin_lock_irqsave(&mdev->clock_lock, flags);
 	timecounter_init(&mdev->clock, &mdev->cycles, ns);
-	write_unlock_irqrestore(&mdev->clock_lock, flags);
+	mlx4_en_update_ts_snapshot(mdev);
+	spin_unlock_irqrestore(&mdev->clock_lock, flags);
 
 	return 0;
 }
@@ -272,7 +320,8 @@ void mlx4_en_init_timestamp(struct mlx4_en_dev *mdev)
 	u64 ns;
 #endif
 
-	rwlock_init(&mdev->clock_lock);
+	spin_lock_init(&mdev->clock_lock);
+	seqcount_init(&mdev->ts_snapshot.seq);
 
 	memset(&mdev->cycles, 0, sizeof(mdev->cycles));
 	mdev->cycles.read = mlx4_en_read_clock;
@@ -287,10 +336,11 @@ void mlx4_en_init_timestamp(struct mlx4_en_dev *mdev)
 		clocksource_khz2mult(1000 * dev->caps.hca_core_clock, mdev->cycles.shift);
 	mdev->nominal_c_mult = mdev->cycles.mult;
 
-	write_lock_irqsave(&mdev->clock_lock, flags);
+	spin_lock_irqsave(&mdev->clock_lock, flags);
 	timecounter_init(&mdev->clock, &mdev->cycles,
 			 ktime_to_ns(ktime_get_real()));
-	write_unlock_irqrestore(&mdev->clock_lock, flags);
+	mlx4_en_update_ts_snapshot(mdev);
+	spin_unlock_irqrestore(&mdev->clock_lock, flags);
 
 	/* Calculate period in seconds to call the overflow watchdog - to make
 	 * sure counter is checked at least once every wrap around.
@@ -43,6 +43,19 @@ static void mlx4_en_cq_event(struct mlx4_cq *cq, enum mlx4_event event)
 	return;
 }
 
+static void mlx4_en_cq_moder_work(struct work_struct *work)
+{
+	struct mlx4_en_cq *cq = container_of(work, struct mlx4_en_cq,
+					     moder_work);
+	struct mlx4_en_priv *priv = netdev_priv(cq->dev);
+
+	cq->moder_time = cq->moder_target;
+	cq->moder_cnt = cq->is_tx ? priv->tx_frames : priv->rx_frames;
+	if (mlx4_en_set_cq_moder(priv, cq))
+		en_err(priv, "Failed modifying moderation for %s cq:%d\n",
+		       cq->is_tx ? "TX" : "RX", cq->ring);
+}
+
 
 int mlx4_en_create_cq(struct mlx4_en_priv *priv,
 		      struct mlx4_en_cq **pcq,
@@ -68,6 +81,7 @@ int mlx4_en_create_cq(struct mlx4_en_priv *priv,
 	cq->ring = ring;
 	cq->is_tx = mode;
 	cq->vector = mdev->dev->caps.num_comp_vectors;
+	INIT_WORK(&cq->moder_work, mlx4_en_cq_moder_work);
 
 	/* Allocate HW buffers on provided NUMA node.
 	 * dev->numa_node is used in mtt range allocation flow.
@@ -134,6 +148,8 @@ int mlx4_en_activate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
 	*cq->mcq.set_ci_db = 0;
 	*cq->mcq.arm_db    = 0;
 	memset(cq->buf, 0, cq->buf_size);
+	cq->moder_events = 0;
+	cq->moder_stamp = ktime_get();
 
 	if (cq->is_tx == RX) {
 		if (!mlx4_is_eq_vector_valid(mdev->dev, priv->port,
@@ -243,6 +259,12 @@ void mlx4_en_destroy_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq **pcq)
 void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 {
 	napi_disable(&cq->napi);
+	__mlx4_en_deactivate_cq(priv, cq);
+}
+
+/* For a CQ whose NAPI the caller already disabled */
+void __mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
+{
 #ifdef HAVE_NAPI_HASH_ADD
 	if (!cq->is_tx) {
 		napi_hash_del(&cq->napi);
@@ -250,6 +272,7 @@ void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 	}
 #endif
 	netif_napi_del(&cq->napi);
+	cancel_work_sync(&cq->moder_work);
 
 	mlx4_cq_free(priv->mdev->dev, &cq->mcq);
 }
@@ -261,6 +284,81 @@ int mlx4_en_set_cq_moder(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 			      cq->moder_cnt, cq->moder_time);
 }
 
+/* Sample the ring counters from NAPI and move the CQ along the rate
+ * curve of its class (RX or TX). The CQ is modified from a work item,
+ * as the firmware command may sleep.
+ *
+ * Both classes share the pkt_rate_low/high thresholds: ethtool has a single
+ * pair, and both are per-ring packet rates where coalescing starts to pay
+ * off. Each class keeps its own usecs range.
+ */
+void mlx4_en_cq_moder_sample(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
+			     unsigned long packets, unsigned long bytes)
+{
+	unsigned long pkt_diff, rate, avg_pkt_size;
+	u16 usecs_low, usecs_high;
+	int ring_num, moder_time;
+	ktime_t now;
+	s64 period, min_period;
+
+	if (cq->is_tx) {
+		if (!priv->adaptive_tx_coal)
+			return;
+		usecs_low = priv->tx_usecs_low;
+		usecs_high = priv->tx_usecs_high;
+		ring_num = priv->tx_ring_num;
+	} else {
+		if (!priv->adaptive_rx_coal)
+			return;
+		usecs_low = priv->rx_usecs_low;
+		usecs_high = priv->rx_usecs_high;
+		ring_num = priv->rx_ring_num;
+	}
+
+	if (++cq->moder_events < MLX4_EN_MODER_EVENTS)
+		return;
+
+	now = ktime_get();
+	period = ktime_us_delta(now, cq->moder_stamp);
+	min_period = max_t(s64, MLX4_EN_MODER_MIN_USECS,
+			   (s64)priv->sample_interval * USEC_PER_SEC);
+	if (period < min_period) {
+		cq->moder_events = 0;
+		return;
+	}
+
+	pkt_diff = packets - cq->moder_packets;
+	rate = div64_u64((u64)pkt_diff * USEC_PER_SEC, period);
+	avg_pkt_size = pkt_diff ? (bytes - cq->moder_bytes) / pkt_diff : 0;
+
+	cq->moder_events = 0;
+	cq->moder_stamp = now;
+	cq->moder_packets = packets;
+	cq->moder_bytes = bytes;
+
+	/* Apply auto-moderation only when packet rate
+	 * exceeds a rate that it matters */
+	if (rate > (MLX4_EN_RX_RATE_THRESH / ring_num) &&
+	    avg_pkt_size > MLX4_EN_AVG_PKT_SMALL) {
+		if (rate < priv->pkt_rate_low)
+			moder_time = usecs_low;
+		else if (rate > priv->pkt_rate_high)
+			moder_time = usecs_high;
+		else
+			moder_time = (rate - priv->pkt_rate_low) *
+				(usecs_high - usecs_low) /
+				(priv->pkt_rate_high - priv->pkt_rate_low) +
+				usecs_low;
+	} else {
+		moder_time = usecs_low;
+	}
+
+	if (moder_time != cq->moder_time && !work_pending(&cq->moder_work)) {
+		cq->moder_target = moder_time;
+		queue_work(priv->mdev->workqueue, &cq->moder_work);
+	}
+}
+
 int mlx4_en_arm_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 {
 	mlx4_cq_arm(&cq->mcq, MLX4_CQ_DB_REQ_NOT, priv->mdev->uar_map,
@@ -162,7 +162,11 @@ static int mlx4_en_moderation_update(struct mlx4_en_priv *priv)
 	int i;
 	int err = 0;
 
-	for (i = 0; i < priv->tx_ring_num; i++) {
+	/* Rings under adaptive moderation pick up the new settings on
+	 * their next NAPI sample.
+	 */
+	for (i = 0; i < priv->tx_ring_num && !priv->adaptive_tx_coal; i++) {
+		cancel_work_sync(&priv->tx_cq[i]->moder_work);
 		priv->tx_cq[i]->moder_cnt = priv->tx_frames;
 		priv->tx_cq[i]->moder_time = priv->tx_usecs;
 		if (priv->port_up) {
@@ -172,13 +176,10 @@ static int mlx4_en_moderation_update(struct mlx4_en_priv *priv)
 		}
 	}
 
-	if (priv->adaptive_rx_coal)
-		return 0;
-
-	for (i = 0; i < priv->rx_ring_num; i++) {
+	for (i = 0; i < priv->rx_ring_num && !priv->adaptive_rx_coal; i++) {
+		cancel_work_sync(&priv->rx_cq[i]->moder_work);
 		priv->rx_cq[i]->moder_cnt = priv->rx_frames;
 		priv->rx_cq[i]->moder_time = priv->rx_usecs;
-		priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
 		if (priv->port_up) {
 			err = mlx4_en_set_cq_moder(priv, priv->rx_cq[i]);
 			if (err)
@@ -309,6 +310,12 @@ static const char main_strings[][ETH_GSTRING_LEN] = {
 	"xmit_more",
 	"queue_stopped", "wake_queue", "tx_timeout", "rx_alloc_failed",
 	"rx_csum_good", "rx_csum_none", "rx_csum_complete", "tx_chksum_offload",
+	"rx_pages_reused", "rx_pages_allocated", "rx_pages_waived",
+	"rx_mc_loopback_dropped", "tx_edge_padding", "rx_hdr_pulls",
+	"rfs_filters", "rfs_collisions", "rfs_expired", "rfs_expire_latency",
+	"rx_mode_pending", "rx_mode_applied",
+	"tx_ring_recoveries", "tx_ring_recovery_usecs",
+	"port_restarts", "port_restart_usecs",
 
 	/* priority flow control statistics rx */
 	"rx_pause_prio_0", "rx_pause_duration_prio_0",
@@ -548,7 +555,7 @@ static int mlx4_en_get_sset_count(struct net_device *dev, int sset)
 	switch (sset) {
 	case ETH_SS_STATS:
 		return bitmap_iterator_count(&it) +
-			(priv->tx_ring_num * 2) +
+			(priv->tx_ring_num * 5) +
 #ifdef CONFIG_NET_RX_BUSY_POLL
 			(priv->rx_ring_num * 5);
 #else
@@ -591,6 +598,8 @@ static void mlx4_en_get_ethtool_stats(struct net_device *dev,
 
 	bitmap_iterator_init(&it, priv->stats_bitmap.bitmap, NUM_ALL_STATS);
 
+	mlx4_en_refresh_stats(priv);
+
 	spin_lock_bh(&priv->stats_lock);
 
 #ifdef CONFIG_COMPAT_LRO_ENABLED
@@ -642,6 +651,9 @@ static void mlx4_en_get_ethtool_stats(struct net_device *dev,
 	for (i = 0; i < priv->tx_ring_num; i++) {
 		data[index++] = priv->tx_ring[i]->packets;
 		data[index++] = priv->tx_ring[i]->bytes;
+		data[index++] = priv->tx_ring[i]->tx_inline;
+		data[index++] = priv->tx_ring[i]->tx_bf;
+		data[index++] = priv->tx_ring[i]->tx_doorbell;
 	}
 	for (i = 0; i < priv->rx_ring_num; i++) {
 		data[index++] = priv->rx_ring[i]->packets;
@@ -724,6 +736,12 @@ static void mlx4_en_get_strings(struct net_device *dev,
 				"tx%d_packets", i);
 			sprintf(data + (index++) * ETH_GSTRING_LEN,
 				"tx%d_bytes", i);
+			sprintf(data + (index++) * ETH_GSTRING_LEN,
+				"tx%d_inline", i);
+			sprintf(data + (index++) * ETH_GSTRING_LEN,
+				"tx%d_bf", i);
+			sprintf(data + (index++) * ETH_GSTRING_LEN,
+				"tx%d_doorbell", i);
 		}
 		for (i = 0; i < priv->rx_ring_num; i++) {
 			sprintf(data + (index++) * ETH_GSTRING_LEN,
@@ -1199,8 +1217,11 @@ static int mlx4_en_get_coalesce(struct net_device *dev,
 	coal->rx_coalesce_usecs_low = priv->rx_usecs_low;
 	coal->pkt_rate_high = priv->pkt_rate_high;
 	coal->rx_coalesce_usecs_high = priv->rx_usecs_high;
+	coal->tx_coalesce_usecs_low = priv->tx_usecs_low;
+	coal->tx_coalesce_usecs_high = priv->tx_usecs_high;
 	coal->rate_sample_interval = priv->sample_interval;
 	coal->use_adaptive_rx_coalesce = priv->adaptive_rx_coal;
+	coal->use_adaptive_tx_coalesce = priv->adaptive_tx_coal;
 
 	return 0;
 }
@@ -1213,6 +1234,12 @@ static int mlx4_en_set_coalesce(struct net_device *dev,
 	if (!coal->tx_max_coalesced_frames_irq)
 		return -EINVAL;
 
+	/* The adaptive rate curve interpolates between the two thresholds */
+	if ((coal->use_adaptive_rx_coalesce ||
+	     coal->use_adaptive_tx_coalesce) &&
+	    coal->pkt_rate_high <= coal->pkt_rate_low)
+		return -EINVAL;
+
 	priv->rx_frames = (coal->rx_max_coalesced_frames ==
 			   MLX4_EN_AUTO_CONF) ?
 				MLX4_EN_RX_COAL_TARGET :
@@ -1234,8 +1261,11 @@ static int mlx4_en_set_coalesce(struct net_device *dev,
 	priv->rx_usecs_low = coal->rx_coalesce_usecs_low;
 	priv->pkt_rate_high = coal->pkt_rate_high;
 	priv->rx_usecs_high = coal->rx_coalesce_usecs_high;
+	priv->tx_usecs_low = coal->tx_coalesce_usecs_low;
+	priv->tx_usecs_high = coal->tx_coalesce_usecs_high;
 	priv->sample_interval = coal->rate_sample_interval;
 	priv->adaptive_rx_coal = coal->use_adaptive_rx_coalesce;
+	priv->adaptive_tx_coal = coal->use_adaptive_tx_coalesce;
 	priv->tx_work_limit = coal->tx_max_coalesced_frames_irq;
 
 	return mlx4_en_moderation_update(priv);
@@ -2324,8 +2354,10 @@ static int mlx4_en_set_priv_flags(struct net_device *dev, u32 flags)
 			priv->pflags &= ~MLX4_EN_PRIV_FLAGS_BLUEFLAME;
 		}
 
-		for (i = 0; i < priv->tx_ring_num; i++)
+		for (i = 0; i < priv->tx_ring_num; i++) {
 			priv->tx_ring[i]->bf_enabled = bf_enabled_new;
+			priv->tx_ring[i]->bf_active = bf_enabled_new;
+		}
 
 		en_info(priv, "BlueFlame %s\n",
 			bf_enabled_new ?  "Enabled" : "Disabled");
@@ -75,6 +75,12 @@ MLX4_EN_PARM_INT(pfcrx, 0, "Priority based Flow Control policy on RX[7:0]."
 MLX4_EN_PARM_INT(inline_thold, MAX_INLINE,
 		 "Threshold for using inline data (range: 17-104, default: 104)");
 
+MLX4_EN_PARM_INT(inline_bulk_thold, MLX4_EN_INLINE_BULK_THOLD,
+		 "Inline data threshold while TX is batched with xmit_more, capped by inline_thold (range: 17-104, default: 44)");
+
+MLX4_EN_PARM_INT(rx_page_reuse, 1,
+		 "Recycle RX pages released by the stack instead of allocating and mapping new ones (default: 1)");
+
 #define MAX_PFC_TX     0xff
 #define MAX_PFC_RX     0xff
 
@@ -126,26 +132,13 @@ void mlx4_en_update_loopback_state(struct net_device *dev,
 	if (mlx4_is_mfunc(priv->mdev->dev) || priv->validate_loopback)
 		priv->flags |= MLX4_EN_FLAG_ENABLE_HW_LOOPBACK;
 
+	/* RX QPs only exist while the port is up; otherwise the filter is
+	 * programmed by mlx4_en_config_rss_steer() on the next start.
+	 */
 	mutex_lock(&priv->mdev->state_lock);
-	if (priv->mdev->dev->caps.flags2 &
-	    MLX4_DEV_CAP_FLAG2_UPDATE_QP_SRC_CHECK_LB &&
-	    priv->rss_map.indir_qp.qpn) {
-		int i;
-		int err = 0;
-
-		for (i = 0; i < priv->rx_ring_num; i++) {
-			int ret;
-
-			ret = mlx4_en_change_mcast_loopback(priv,
-							    &priv->rss_map.qps[i],
-							    !!(features &
-							       NETIF_F_LOOPBACK));
-			if (!err)
-				err = ret;
-		}
-		if (err)
-			mlx4_warn(priv->mdev, "failed to change mcast loopback\n");
-	}
+	if (priv->port_up && priv->rss_map.indir_qp.qpn)
+		mlx4_en_update_mcast_lb_filter(priv,
+					       !!(features & NETIF_F_LOOPBACK));
 	mutex_unlock(&priv->mdev->state_lock);
 }
 
@@ -155,6 +148,7 @@ static int mlx4_en_get_profile(struct mlx4_en_dev *mdev)
 	int i;
 
 	params->udp_rss = udp_rss;
+	params->rx_page_reuse = !!rx_page_reuse;
 #ifdef HAVE_NEW_TX_RING_SCHEME
 	params->num_tx_rings_p_up = mlx4_low_memory_profile() ?
 		MLX4_EN_MIN_TX_RING_P_UP :
@@ -182,6 +176,7 @@ static int mlx4_en_get_profile(struct mlx4_en_dev *mdev)
 #endif
 		params->prof[i].rss_rings = 0;
 		params->prof[i].inline_thold = inline_thold;
+		params->prof[i].inline_bulk_thold = inline_bulk_thold;
 		params->prof[i].inline_scatter_thold = 0;
 	}
 
@@ -398,6 +393,13 @@ static void mlx4_en_verify_params(void)
 			inline_thold, MIN_PKT_LEN, MAX_INLINE, MAX_INLINE);
 		inline_thold = MAX_INLINE;
 	}
+
+	if (inline_bulk_thold < MIN_PKT_LEN || inline_bulk_thold > MAX_INLINE) {
+		pr_warn("mlx4_en: WARNING: illegal module parameter inline_bulk_thold %d - should be in range %d-%d, will be changed to default (%d)\n",
+			inline_bulk_thold, MIN_PKT_LEN, MAX_INLINE,
+			(int)MLX4_EN_INLINE_BULK_THOLD);
+		inline_bulk_thold = MLX4_EN_INLINE_BULK_THOLD;
+	}
 }
 
 static int __init mlx4_en_init(void)
@@ -37,6 +37,7 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/hash.h>
+#include <linux/vmalloc.h>
 #include <net/ip.h>
 #ifdef CONFIG_NET_RX_BUSY_POLL
 #include <net/busy_poll.h>
@@ -133,10 +134,11 @@ struct mlx4_en_filter {
 	u8 activated;			/* Used to prevent expiry before filter
 					 * is attached
 					 */
+	unsigned long stamp;		/* jiffies when last found in use */
 	struct hlist_node filter_chain;
 };
 
-static void mlx4_en_filter_rfs_expire(struct mlx4_en_priv *priv);
+static void mlx4_en_filter_rfs_expire(struct mlx4_en_priv *priv, int rxq);
 
 static enum mlx4_net_trans_rule_id mlx4_ip_proto_to_trans_rule_id(u8 ip_proto)
 {
@@ -219,7 +221,12 @@ static void mlx4_en_filter_work(struct work_struct *work)
 		en_err(priv, "Error attaching flow. err = %d\n", rc);
 
 ignore:
-	mlx4_en_filter_rfs_expire(priv);
+	/* Reclaim on the ring the filter was steered to, and advance
+	 * through the other rings so idle ones are drained as well.
+	 */
+	mlx4_en_filter_rfs_expire(priv, filter->rxq_index);
+	mlx4_en_filter_rfs_expire(priv, priv->filter_expire_next++ %
+				  priv->rx_ring_num);
 
 	filter->activated = 1;
 }
@@ -235,17 +242,108 @@ filter_hash_bucket(struct mlx4_en_priv *priv, __be32 src_ip, __be32 dst_ip,
 	    ((__force unsigned long)dst_port << 2);
 	l ^= (__force unsigned long)(src_ip ^ dst_ip);
 
-	bucket_idx = hash_long(l, MLX4_EN_FILTER_HASH_SHIFT);
+	bucket_idx = hash_long(l, priv->filter_hash_shift);
 
 	return &priv->filter_hash[bucket_idx];
 }
 
+/* Grow the filter hash once its load passes MLX4_EN_FILTER_LOAD filters per
+ * bucket. Runs from the workqueue since ndo_rx_flow_steer is atomic.
+ */
+static void mlx4_en_filter_resize(struct work_struct *work)
+{
+	struct mlx4_en_priv *priv = container_of(work, struct mlx4_en_priv,
+						 filter_resize_task);
+	struct mlx4_en_filter *filter;
+	struct hlist_head *hash, *old;
+	u32 shift;
+	int i;
+
+	spin_lock_bh(&priv->filters_lock);
+	shift = priv->filter_hash_shift;
+	while (shift < priv->filter_hash_max_shift &&
+	       priv->filter_count > (MLX4_EN_FILTER_LOAD << shift))
+		shift++;
+	spin_unlock_bh(&priv->filters_lock);
+
+	if (shift == priv->filter_hash_shift)
+		return;
+
+	hash = vzalloc(sizeof(*hash) << shift);
+	if (!hash) {
+		en_warn(priv, "RFS: failed to grow filter table to %u buckets\n",
+			1U << shift);
+		return;
+	}
+
+	spin_lock_bh(&priv->filters_lock);
+	old = priv->filter_hash;
+	priv->filter_hash = hash;
+	priv->filter_hash_shift = shift;
+	for (i = 0; i < MAX_RX_RINGS; i++) {
+		list_for_each_entry(filter, &priv->filters[i], next) {
+			hlist_del(&filter->filter_chain);
+			hlist_add_head(&filter->filter_chain,
+				       filter_hash_bucket(priv, filter->src_ip,
+							  filter->dst_ip,
+							  filter->src_port,
+							  filter->dst_port));
+		}
+	}
+	spin_unlock_bh(&priv->filters_lock);
+
+	vfree(old);
+	en_dbg(DRV, priv, "RFS: filter table grown to %u buckets\n",
+	       1U << shift);
+}
+
+/* The table starts at MAX_NUM_OF_FS_RULES buckets and may grow up to the
+ * port's share of the device steering entries, which also bounds the
+ * number of filters.
+ */
+static int mlx4_en_filter_table_alloc(struct mlx4_en_priv *priv)
+{
+	struct mlx4_dev *dev = priv->mdev->dev;
+	u32 budget;
+	int i;
+
+	budget = (dev->caps.num_mgms + dev->caps.num_amgms) /
+		 dev->caps.num_ports;
+	priv->filter_max = clamp_t(u32, budget, MAX_NUM_OF_FS_RULES,
+				   MLX4_EN_FILTER_MAX);
+	priv->filter_hash_shift = MLX4_EN_FILTER_HASH_SHIFT;
+	priv->filter_hash_max_shift =
+		ilog2(roundup_pow_of_two(priv->filter_max));
+
+	for (i = 0; i < MAX_RX_RINGS; i++)
+		INIT_LIST_HEAD(&priv->filters[i]);
+	INIT_WORK(&priv->filter_resize_task, mlx4_en_filter_resize);
+
+	priv->filter_hash = vzalloc(sizeof(*priv->filter_hash) <<
+				    priv->filter_hash_shift);
+	return priv->filter_hash ? 0 : -ENOMEM;
+}
+
+static void mlx4_en_filter_table_free(struct mlx4_en_priv *priv)
+{
+	if (!priv->filter_hash)
+		return;
+
+	cancel_work_sync(&priv->filter_resize_task);
+	vfree(priv->filter_hash);
+	priv->filter_hash = NULL;
+}
+
 static struct mlx4_en_filter *
 mlx4_en_filter_alloc(struct mlx4_en_priv *priv, int rxq_index, __be32 src_ip,
 		     __be32 dst_ip, u8 ip_proto, __be16 src_port,
 		     __be16 dst_port, u32 flow_id)
 {
 	struct mlx4_en_filter *filter = NULL;
+	struct hlist_head *bucket;
+
+	if (priv->filter_count >= priv->filter_max)
+		return NULL;
 
 	filter = kzalloc(sizeof(struct mlx4_en_filter), GFP_ATOMIC);
 	if (!filter)
@@ -262,13 +360,20 @@ mlx4_en_filter_alloc(struct mlx4_en_priv *priv, int rxq_index, __be32 src_ip,
 	filter->dst_port = dst_port;
 
 	filter->flow_id = flow_id;
+	filter->stamp = jiffies;
 
 	filter->id = priv->last_filter_id++ % RPS_NO_FILTER;
 
-	list_add_tail(&filter->next, &priv->filters);
-	hlist_add_head(&filter->filter_chain,
-		       filter_hash_bucket(priv, src_ip, dst_ip, src_port,
-					  dst_port));
+	list_add_tail(&filter->next, &priv->filters[rxq_index]);
+	bucket = filter_hash_bucket(priv, src_ip, dst_ip, src_port, dst_port);
+	if (!hlist_empty(bucket))
+		priv->filter_collisions++;
+	hlist_add_head(&filter->filter_chain, bucket);
+
+	if (++priv->filter_count > (MLX4_EN_FILTER_LOAD <<
+				    priv->filter_hash_shift) &&
+	    priv->filter_hash_shift < priv->filter_hash_max_shift)
+		queue_work(priv->mdev->workqueue, &priv->filter_resize_task);
 
 	return filter;
 }
@@ -355,12 +460,14 @@ mlx4_en_filter_rfs(struct net_device *net_dev, const struct sk_buff *skb,
 			goto out;
 
 		filter->rxq_index = rxq_index;
+		list_move_tail(&filter->next, &priv->filters[rxq_index]);
 	} else {
 		filter = mlx4_en_filter_alloc(priv, rxq_index,
 					      src_ip, dst_ip, ip_proto,
 					      src_port, dst_port, flow_id);
 		if (!filter) {
-			ret = -ENOMEM;
+			ret = priv->filter_count >= priv->filter_max ?
+			      -EBUSY : -ENOMEM;
 			goto err;
 		}
 	}
@@ -379,12 +486,16 @@ void mlx4_en_cleanup_filters(struct mlx4_en_priv *priv)
 {
 	struct mlx4_en_filter *filter, *tmp;
 	LIST_HEAD(del_list);
+	int i;
 
 	spin_lock_bh(&priv->filters_lock);
-	list_for_each_entry_safe(filter, tmp, &priv->filters, next) {
-		list_move(&filter->next, &del_list);
-		hlist_del(&filter->filter_chain);
+	for (i = 0; i < MAX_RX_RINGS; i++) {
+		list_for_each_entry_safe(filter, tmp, &priv->filters[i], next) {
+			list_move(&filter->next, &del_list);
+			hlist_del(&filter->filter_chain);
+		}
 	}
+	priv->filter_count = 0;
 	spin_unlock_bh(&priv->filters_lock);
 
 	list_for_each_entry_safe(filter, tmp, &del_list, next) {
@@ -393,14 +504,20 @@ void mlx4_en_cleanup_filters(struct mlx4_en_priv *priv)
 	}
 }
 
-static void mlx4_en_filter_rfs_expire(struct mlx4_en_priv *priv)
+/* Expire at most MLX4_EN_FILTER_EXPIRY_QUOTA filters of one RX ring, resuming
+ * after the last filter kept by the previous pass on that ring.
+ */
+static void mlx4_en_filter_rfs_expire(struct mlx4_en_priv *priv, int rxq)
 {
 	struct mlx4_en_filter *filter = NULL, *tmp, *last_filter = NULL;
+	struct list_head *filters = &priv->filters[rxq];
+	unsigned long now = jiffies;
 	LIST_HEAD(del_list);
+	unsigned int lat;
 	int i = 0;
 
 	spin_lock_bh(&priv->filters_lock);
-	list_for_each_entry_safe(filter, tmp, &priv->filters, next) {
+	list_for_each_entry_safe(filter, tmp, filters, next) {
 		if (i > MLX4_EN_FILTER_EXPIRY_QUOTA)
 			break;
 
@@ -411,14 +528,21 @@ static void mlx4_en_filter_rfs_expire(struct mlx4_en_priv *priv)
 					filter->id)) {
 			list_move(&filter->next, &del_list);
 			hlist_del(&filter->filter_chain);
-		} else
+			priv->filter_count--;
+			priv->filter_expired++;
+			lat = jiffies_to_msecs(now - filter->stamp);
+			if (lat > priv->filter_expire_latency)
+				priv->filter_expire_latency = lat;
+		} else {
+			filter->stamp = now;
 			last_filter = filter;
+		}
 
 		i++;
 	}
 
-	if (last_filter && (&last_filter->next != priv->filters.next))
-		list_move(&priv->filters, &last_filter->next);
+	if (last_filter && (&last_filter->next != filters->next))
+		list_move(filters, &last_filter->next);
 
 	spin_unlock_bh(&priv->filters_lock);
 
@@ -672,6 +796,34 @@ static void mlx4_en_put_qp(struct mlx4_en_priv *priv)
 	}
 }
 
+static void mlx4_en_mac_filter_add(struct mlx4_en_priv *priv, const u8 *mac)
+{
+	set_bit(MLX4_EN_MAC_FILTER_IDX1(mac), priv->mac_filter);
+	set_bit(MLX4_EN_MAC_FILTER_IDX2(mac), priv->mac_filter);
+}
+
+/* A Bloom filter cannot forget a MAC, so rebuild it from mac_hash once
+ * entries were removed. Called under mdev->state_lock.
+ */
+static void mlx4_en_mac_filter_rebuild(struct mlx4_en_priv *priv)
+{
+	DECLARE_BITMAP(filter, MLX4_EN_MAC_FILTER_BITS);
+	struct mlx4_mac_entry *entry;
+#ifndef HAVE_HLIST_FOR_EACH_ENTRY_3_PARAMS
+	struct hlist_node *hlnode;
+#endif
+	unsigned int i;
+
+	bitmap_zero(filter, MLX4_EN_MAC_FILTER_BITS);
+	for (i = 0; i < MLX4_EN_MAC_HASH_SIZE; ++i) {
+		compat_hlist_for_each_entry(entry, &priv->mac_hash[i], hlist) {
+			set_bit(MLX4_EN_MAC_FILTER_IDX1(entry->mac), filter);
+			set_bit(MLX4_EN_MAC_FILTER_IDX2(entry->mac), filter);
+		}
+	}
+	bitmap_copy(priv->mac_filter, filter, MLX4_EN_MAC_FILTER_BITS);
+}
+
 static int mlx4_en_replace_mac(struct mlx4_en_priv *priv, int qpn,
 			       unsigned char *new_mac, unsigned char *prev_mac)
 {
@@ -704,6 +856,7 @@ static int mlx4_en_replace_mac(struct mlx4_en_priv *priv, int qpn,
 				mac_hash = new_mac[MLX4_EN_MAC_HASH_IDX];
 				hlist_add_head_rcu(&entry->hlist,
 						   &priv->mac_hash[mac_hash]);
+				mlx4_en_mac_filter_rebuild(priv);
 				mlx4_register_mac(dev, priv->port, new_mac_u64);
 				err = mlx4_en_uc_steer_add(priv, new_mac,
 							   &qpn,
@@ -807,51 +960,78 @@ static void mlx4_en_cache_mclist(struct net_device *dev)
 	}
 }
 
-static void update_mclist_flags(struct mlx4_en_priv *priv,
+static struct mlx4_en_mc_list *mlx4_en_mc_find(struct mlx4_en_priv *priv,
+					       const u8 *addr)
+{
+#ifndef HAVE_HLIST_FOR_EACH_ENTRY_3_PARAMS
+	struct hlist_node *hlnode;
+#endif
+	struct mlx4_en_mc_list *mclist;
+
+	compat_hlist_for_each_entry(mclist,
+				    &priv->mc_hash[addr[MLX4_EN_MAC_HASH_IDX]],
+				    hlist) {
+		if (ether_addr_equal(mclist->addr, addr))
+			return mclist;
+	}
+
+	return NULL;
+}
+
+static void mlx4_en_mc_free(struct mlx4_en_mc_list *mclist)
+{
+	list_del(&mclist->list);
+	hlist_del(&mclist->hlist);
+	kfree(mclist);
+}
+
+/* Diff the wanted addresses in src against dst, the installed list indexed
+ * by mc_hash. Installed addresses that are no longer wanted are marked
+ * MCLIST_REM, or dropped at once if they were never attached. Wanted
+ * addresses that are not attached yet are marked MCLIST_ADD.
+ * Returns true if an address still set in the port filter left the set.
+ */
+static bool update_mclist_flags(struct mlx4_en_priv *priv,
 				struct list_head *dst,
 				struct list_head *src)
 {
-	struct mlx4_en_mc_list *dst_tmp, *src_tmp, *new_mc;
-	bool found;
+	struct mlx4_en_mc_list *dst_tmp, *src_tmp, *new_mc, *tmp;
+	bool removed = false;
 
-	/* Find all the entries that should be removed from dst,
-	 * These are the entries that are not found in src
-	 */
-	list_for_each_entry(dst_tmp, dst, list) {
-		found = false;
-		list_for_each_entry(src_tmp, src, list) {
-			if (ether_addr_equal(dst_tmp->addr, src_tmp->addr)) {
-				found = true;
-				break;
-			}
-		}
-		if (!found)
-			dst_tmp->action = MCLIST_REM;
-	}
+	list_for_each_entry(dst_tmp, dst, list)
+		dst_tmp->action = MCLIST_REM;
 
-	/* Add entries that exist in src but not in dst
-	 * mark them as need to add
-	 */
 	list_for_each_entry(src_tmp, src, list) {
-		found = false;
-		list_for_each_entry(dst_tmp, dst, list) {
-			if (ether_addr_equal(dst_tmp->addr, src_tmp->addr)) {
-				dst_tmp->action = MCLIST_NONE;
-				found = true;
-				break;
-			}
-		}
-		if (!found) {
-			new_mc = kmemdup(src_tmp,
-					 sizeof(struct mlx4_en_mc_list),
-					 GFP_KERNEL);
-			if (!new_mc)
-				return;
-
-			new_mc->action = MCLIST_ADD;
-			list_add_tail(&new_mc->list, dst);
+		dst_tmp = mlx4_en_mc_find(priv, src_tmp->addr);
+		if (dst_tmp) {
+			dst_tmp->action = dst_tmp->attached ? MCLIST_NONE :
+							      MCLIST_ADD;
+			continue;
 		}
+
+		/* on failure the address is retried on the next sync */
+		new_mc = kzalloc(sizeof(struct mlx4_en_mc_list), GFP_KERNEL);
+		if (!new_mc)
+			continue;
+
+		memcpy(new_mc->addr, src_tmp->addr, ETH_ALEN);
+		new_mc->action = MCLIST_ADD;
+		list_add_tail(&new_mc->list, dst);
+		hlist_add_head(&new_mc->hlist,
+			       &priv->mc_hash[new_mc->addr[MLX4_EN_MAC_HASH_IDX]]);
+	}
+
+	list_for_each_entry_safe(dst_tmp, tmp, dst, list) {
+		if (dst_tmp->action != MCLIST_REM)
+			continue;
+
+		if (dst_tmp->in_filter)
+			removed = true;
+		if (!dst_tmp->attached)
+			mlx4_en_mc_free(dst_tmp);
 	}
+
+	return removed;
 }
 
 static void mlx4_en_set_rx_mode(struct net_device *dev)
@@ -861,7 +1041,9 @@ static void mlx4_en_set_rx_mode(struct net_device *dev)
 	if (!priv->port_up)
 		return;
 
-	queue_work(priv->mdev->workqueue, &priv->rx_mode_task);
+	/* Let a burst of address changes settle into a single sync */
+	queue_delayed_work(priv->mdev->workqueue, &priv->rx_mode_task,
+			   MLX4_EN_RX_MODE_DELAY);
 }
 
 static void mlx4_en_set_promisc_mode(struct mlx4_en_priv *priv,
@@ -921,6 +1103,7 @@ static void mlx4_en_set_promisc_mode(struct mlx4_en_priv *priv,
 					  0, MLX4_MCAST_DISABLE);
 		if (err)
 			en_err(priv, "Failed disabling multicast filter\n");
+		priv->flags &= ~MLX4_EN_FLAG_MC_FLTR_SYNC;
 	}
 }
 
@@ -971,21 +1154,41 @@ static void mlx4_en_clear_promisc_mode(struct mlx4_en_priv *priv,
 	}
 }
 
+/* Port filter commands are spent from the same budget as attach/detach.
+ * A rebuild is never split, so it may overdraw the budget once.
+ */
+static int mlx4_en_mcast_fltr(struct mlx4_en_priv *priv, u64 mac, u64 clear,
+			      u8 mode, int *budget)
+{
+	if (*budget)
+		(*budget)--;
+
+	return mlx4_SET_MCAST_FLTR(priv->mdev->dev, priv->port, mac, clear,
+				   mode);
+}
+
+/* Apply the multicast changes since the last sync, spending at most *budget
+ * filter and attach/detach commands. Changes left over stay marked in
+ * curr_list.
+ */
 static void mlx4_en_do_multicast(struct mlx4_en_priv *priv,
 				 struct net_device *dev,
-				 struct mlx4_en_dev *mdev)
+				 struct mlx4_en_dev *mdev,
+				 int *budget)
 {
 	struct mlx4_en_mc_list *mclist, *tmp;
 	u64 mcast_addr = 0;
 	u8 mc_list[16] = {0};
+	bool added = false;
 	int err = 0;
 
 	/* Enable/disable the multicast filter according to IFF_ALLMULTI */
 	if (dev->flags & IFF_ALLMULTI) {
-		err = mlx4_SET_MCAST_FLTR(mdev->dev, priv->port, 0,
-					  0, MLX4_MCAST_DISABLE);
+		err = mlx4_en_mcast_fltr(priv, 0, 0, MLX4_MCAST_DISABLE,
+					 budget);
 		if (err)
 			en_err(priv, "Failed disabling multicast filter\n");
+		priv->flags &= ~MLX4_EN_FLAG_MC_FLTR_SYNC;
 
 		/* Add the default qp number as multicast promisc */
 		if (!(priv->flags & MLX4_EN_FLAG_MC_PROMISC)) {
@@ -1034,32 +1237,85 @@ static void mlx4_en_do_multicast(struct mlx4_en_priv *priv,
 			priv->flags &= ~MLX4_EN_FLAG_MC_PROMISC;
 		}
 
-		err = mlx4_SET_MCAST_FLTR(mdev->dev, priv->port, 0,
-					  0, MLX4_MCAST_DISABLE);
-		if (err)
-			en_err(priv, "Failed disabling multicast filter\n");
-
-		/* Flush mcast filter and init it with broadcast address */
-		mlx4_SET_MCAST_FLTR(mdev->dev, priv->port, ETH_BCAST,
-				    1, MLX4_MCAST_CONFIG);
-
 		/* Update multicast list - we cache all addresses so they won't
 		 * change while HW is updated holding the command semaphor */
 		netif_addr_lock_bh(dev);
 		mlx4_en_cache_mclist(dev);
 		netif_addr_unlock_bh(dev);
-		list_for_each_entry(mclist, &priv->mc_list, list) {
-			mcast_addr = mlx4_mac_to_u64(mclist->addr);
-			mlx4_SET_MCAST_FLTR(mdev->dev, priv->port,
-					    mcast_addr, 0, MLX4_MCAST_CONFIG);
+		if (update_mclist_flags(priv, &priv->curr_list,
+					&priv->mc_list))
+			priv->flags &= ~MLX4_EN_FLAG_MC_FLTR_SYNC;
+
+		/* The port filter can only be flushed as a whole, so it is
+		 * rebuilt once when a filtered address leaves; new addresses
+		 * are added on top of it.  Removals still waiting for budget
+		 * are no longer in the filter and do not rebuild it again.
+		 */
+		if (!(priv->flags & MLX4_EN_FLAG_MC_FLTR_SYNC)) {
+			err = mlx4_en_mcast_fltr(priv, 0, 0, MLX4_MCAST_DISABLE,
+						 budget);
+			if (err)
+				en_err(priv, "Failed disabling multicast filter\n");
+
+			/* Flush mcast filter and init it with broadcast address */
+			mlx4_en_mcast_fltr(priv, ETH_BCAST, 1, MLX4_MCAST_CONFIG,
+					   budget);
+
+			list_for_each_entry(mclist, &priv->curr_list, list) {
+				mclist->in_filter = mclist->action != MCLIST_REM;
+				if (!mclist->in_filter)
+					continue;
+
+				mcast_addr = mlx4_mac_to_u64(mclist->addr);
+				mlx4_en_mcast_fltr(priv, mcast_addr, 0,
+						   MLX4_MCAST_CONFIG, budget);
+			}
+			added = true;
+		} else {
+			list_for_each_entry(mclist, &priv->curr_list, list) {
+				if (mclist->action == MCLIST_REM ||
+				    mclist->in_filter)
+					continue;
+
+				/* leave room for the final enable */
+				if (*budget < (added ? 2 : 3)) {
+					priv->rx_mode_pending++;
+					continue;
+				}
+
+				if (!added) {
+					err = mlx4_en_mcast_fltr(priv, 0, 0,
+								 MLX4_MCAST_DISABLE,
+								 budget);
+					if (err)
+						en_err(priv, "Failed disabling multicast filter\n");
+					added = true;
+				}
+				mcast_addr = mlx4_mac_to_u64(mclist->addr);
+				mlx4_en_mcast_fltr(priv, mcast_addr, 0,
+						   MLX4_MCAST_CONFIG, budget);
+				mclist->in_filter = 1;
+			}
+		}
+		if (added) {
+			err = mlx4_en_mcast_fltr(priv, 0, 0, MLX4_MCAST_ENABLE,
+						 budget);
+			if (err)
+				en_err(priv, "Failed enabling multicast filter\n");
+			priv->flags |= MLX4_EN_FLAG_MC_FLTR_SYNC;
 		}
-		err = mlx4_SET_MCAST_FLTR(mdev->dev, priv->port, 0,
-					  0, MLX4_MCAST_ENABLE);
-		if (err)
-			en_err(priv, "Failed enabling multicast filter\n");
 
-		update_mclist_flags(priv, &priv->curr_list, &priv->mc_list);
 		list_for_each_entry_safe(mclist, tmp, &priv->curr_list, list) {
+			if (mclist->action == MCLIST_NONE)
+				continue;
+
+			if (!*budget) {
+				priv->rx_mode_pending++;
+				continue;
+			}
+			(*budget)--;
+			priv->rx_mode_applied++;
+
 			if (mclist->action == MCLIST_REM) {
 				/* detach this address and delete from list */
 				memcpy(&mc_list[10], mclist->addr, ETH_ALEN);
@@ -1079,8 +1335,7 @@ static void mlx4_en_do_multicast(struct mlx4_en_priv *priv,
 				}
 
 				/* remove from list */
-				list_del(&mclist->list);
-				kfree(mclist);
+				mlx4_en_mc_free(mclist);
 			} else if (mclist->action == MCLIST_ADD) {
 				/* attach the address */
 				memcpy(&mc_list[10], mclist->addr, ETH_ALEN);
@@ -1099,14 +1354,40 @@ static void mlx4_en_do_multicast(struct mlx4_en_priv *priv,
 							       &mclist->tunnel_reg_id);
 				if (err)
 					en_err(priv, "Failed to attach multicast address\n");
+
+				mclist->attached = 1;
+				mclist->action = MCLIST_NONE;
 			}
 		}
 	}
 }
 
+static struct mlx4_mac_entry *mlx4_en_uc_find(struct mlx4_en_priv *priv,
+					      const u8 *addr)
+{
+#ifndef HAVE_HLIST_FOR_EACH_ENTRY_3_PARAMS
+	struct hlist_node *hlnode;
+#endif
+	struct mlx4_mac_entry *entry;
+
+	compat_hlist_for_each_entry(entry,
+				    &priv->mac_hash[addr[MLX4_EN_MAC_HASH_IDX]],
+				    hlist) {
+		if (ether_addr_equal_64bits(entry->mac, addr))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* Removals only release resources and are always done in full. Additions
+ * spend *budget like mlx4_en_do_multicast() and the rest wait for the next
+ * sync.
+ */
 static void mlx4_en_do_uc_filter(struct mlx4_en_priv *priv,
 				 struct net_device *dev,
-				 struct mlx4_en_dev *mdev)
+				 struct mlx4_en_dev *mdev,
+				 int *budget)
 {
 	struct netdev_hw_addr *ha;
 	struct mlx4_mac_entry *entry;
@@ -1126,18 +1407,19 @@ static void mlx4_en_do_uc_filter(struct mlx4_en_priv *priv,
 	 * since all modification code is protected by mdev->state_lock
 	 */
 
+	/* mark what is still wanted */
+	netdev_for_each_uc_addr(ha, dev) {
+		entry = mlx4_en_uc_find(priv, ha->addr);
+		if (entry)
+			entry->seen = true;
+	}
+
 	/* find what to remove */
 	for (i = 0; i < MLX4_EN_MAC_HASH_SIZE; ++i) {
 		bucket = &priv->mac_hash[i];
 		compat_hlist_for_each_entry_safe(entry, tmp, bucket, hlist) {
-			found = false;
-			netdev_for_each_uc_addr(ha, dev) {
-				if (ether_addr_equal_64bits(entry->mac,
-							    ha->addr)) {
-					found = true;
-					break;
-				}
-			}
+			found = entry->seen;
+			entry->seen = false;
 
 			/* MAC address of the port is not in uc list */
 			if (ether_addr_equal_64bits(entry->mac,
@@ -1155,11 +1437,15 @@ static void mlx4_en_do_uc_filter(struct mlx4_en_priv *priv,
 				kfree_rcu(entry, rcu);
 				en_dbg(DRV, priv, "Removed MAC %pM on port:%d\n",
 				       entry->mac, priv->port);
+				priv->rx_mode_applied++;
 				++removed;
 			}
 		}
 	}
 
+	if (removed)
+		mlx4_en_mac_filter_rebuild(priv);
+
 	/* if we didn't remove anything, there is no use in trying to add
 	 * again once we are in a forced promisc mode state
 	 */
@@ -1171,51 +1457,52 @@ static void mlx4_en_do_uc_filter(struct mlx4_en_priv *priv,
 
 	/* find what to add */
 	netdev_for_each_uc_addr(ha, dev) {
-		found = false;
-		bucket = &priv->mac_hash[ha->addr[MLX4_EN_MAC_HASH_IDX]];
-		compat_hlist_for_each_entry(entry, bucket, hlist) {
-			if (ether_addr_equal_64bits(entry->mac, ha->addr)) {
-				found = true;
-				break;
-			}
+		if (mlx4_en_uc_find(priv, ha->addr))
+			continue;
+
+		if (!*budget) {
+			priv->rx_mode_pending++;
+			continue;
 		}
 
-		if (!found) {
-			entry = kmalloc(sizeof(*entry), GFP_KERNEL);
-			if (!entry) {
-				en_err(priv, "Failed adding MAC %pM on port:%d (out of memory)\n",
-				       ha->addr, priv->port);
-				priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
-				break;
-			}
-			mac = mlx4_mac_to_u64(ha->addr);
-			memcpy(entry->mac, ha->addr, ETH_ALEN);
-			err = mlx4_register_mac(mdev->dev, priv->port, mac);
-			if (err < 0) {
-				en_err(priv, "Failed registering MAC %pM on port %d: %d\n",
-				       ha->addr, priv->port, err);
-				kfree(entry);
-				priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
-				break;
-			}
-			err = mlx4_en_uc_steer_add(priv, ha->addr,
-						   &priv->base_qpn,
-						   &entry->reg_id);
-			if (err) {
-				en_err(priv, "Failed adding MAC %pM on port %d: %d\n",
-				       ha->addr, priv->port, err);
-				mlx4_unregister_mac(mdev->dev, priv->port, mac);
-				kfree(entry);
-				priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
-				break;
-			} else {
-				unsigned int mac_hash;
-				en_dbg(DRV, priv, "Added MAC %pM on port:%d\n",
-				       ha->addr, priv->port);
-				mac_hash = ha->addr[MLX4_EN_MAC_HASH_IDX];
-				bucket = &priv->mac_hash[mac_hash];
-				hlist_add_head_rcu(&entry->hlist, bucket);
-			}
+		(*budget)--;
+		entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry) {
+			en_err(priv, "Failed adding MAC %pM on port:%d (out of memory)\n",
+			       ha->addr, priv->port);
+			priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
+			break;
+		}
+		mac = mlx4_mac_to_u64(ha->addr);
+		memcpy(entry->mac, ha->addr, ETH_ALEN);
+		entry->seen = false;
+		err = mlx4_register_mac(mdev->dev, priv->port, mac);
+		if (err < 0) {
+			en_err(priv, "Failed registering MAC %pM on port %d: %d\n",
+			       ha->addr, priv->port, err);
+			kfree(entry);
+			priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
+			break;
+		}
+		err = mlx4_en_uc_steer_add(priv, ha->addr,
+					   &priv->base_qpn,
+					   &entry->reg_id);
+		if (err) {
+			en_err(priv, "Failed adding MAC %pM on port %d: %d\n",
+			       ha->addr, priv->port, err);
+			mlx4_unregister_mac(mdev->dev, priv->port, mac);
+			kfree(entry);
+			priv->flags |= MLX4_EN_FLAG_FORCE_PROMISC;
+			break;
+		} else {
+			unsigned int mac_hash;
+			en_dbg(DRV, priv, "Added MAC %pM on port:%d\n",
+			       ha->addr, priv->port);
+			mac_hash = ha->addr[MLX4_EN_MAC_HASH_IDX];
+			bucket = &priv->mac_hash[mac_hash];
+			hlist_add_head_rcu(&entry->hlist, bucket);
+			mlx4_en_mac_filter_add(priv, entry->mac);
+			priv->rx_mode_applied++;
 		}
 	}
 
@@ -1230,10 +1517,12 @@ static void mlx4_en_do_uc_filter(struct mlx4_en_priv *priv,
 
 static void mlx4_en_do_set_rx_mode(struct work_struct *work)
 {
-	struct mlx4_en_priv *priv = container_of(work, struct mlx4_en_priv,
+	struct delayed_work *delay = to_delayed_work(work);
+	struct mlx4_en_priv *priv = container_of(delay, struct mlx4_en_priv,
 						 rx_mode_task);
 	struct mlx4_en_dev *mdev = priv->mdev;
 	struct net_device *dev = priv->dev;
+	int budget = MLX4_EN_RX_MODE_BUDGET;
 
 	mutex_lock(&mdev->state_lock);
 	if (!mdev->device_up) {
@@ -1255,12 +1544,14 @@ static void mlx4_en_do_set_rx_mode(struct work_struct *work)
 		}
 	}
 
+	priv->rx_mode_pending = 0;
+
 #ifdef HAVE_NETDEV_IFF_UNICAST_FLT
 	if (dev->priv_flags & IFF_UNICAST_FLT)
 #else
 	if (mdev->dev->caps.steering_mode != MLX4_STEERING_MODE_A0)
 #endif
-		mlx4_en_do_uc_filter(priv, dev, mdev);
+		mlx4_en_do_uc_filter(priv, dev, mdev, &budget);
 
 	/* Promsicuous mode: disable all filters */
 	if ((dev->flags & IFF_PROMISC) ||
@@ -1273,7 +1564,11 @@ static void mlx4_en_do_set_rx_mode(struct work_struct *work)
 	if (priv->flags & MLX4_EN_FLAG_PROMISC)
 		mlx4_en_clear_promisc_mode(priv, mdev);
 
-	mlx4_en_do_multicast(priv, dev, mdev);
+	mlx4_en_do_multicast(priv, dev, mdev, &budget);
+
+	/* Give other work a chance before applying the rest */
+	if (priv->rx_mode_pending)
+		queue_delayed_work(mdev->workqueue, &priv->rx_mode_task, 0);
 out:
 	mutex_unlock(&mdev->state_lock);
 }
@@ -1317,8 +1612,10 @@ static int mlx4_en_set_rss_steer_rules(struct mlx4_en_priv *priv)
 	memcpy(entry->mac, priv->dev->dev_addr, sizeof(entry->mac));
 	memcpy(priv->current_mac, entry->mac, sizeof(priv->current_mac));
 	entry->reg_id = reg_id;
+	entry->seen = false;
 	hlist_add_head_rcu(&entry->hlist,
 			   &priv->mac_hash[entry->mac[MLX4_EN_MAC_HASH_IDX]]);
+	mlx4_en_mac_filter_add(priv, entry->mac);
 
 	return 0;
 
@@ -1357,6 +1654,7 @@ static void mlx4_en_delete_rss_steer_rules(struct mlx4_en_priv *priv)
 			kfree_rcu(entry, rcu);
 		}
 	}
+	mlx4_en_mac_filter_rebuild(priv);
 
 	if (priv->tunnel_reg_id) {
 		mlx4_flow_detach(priv->mdev->dev, priv->tunnel_reg_id);
@@ -1379,6 +1677,7 @@ static void mlx4_en_tx_timeout(struct net_device *dev)
 		en_warn(priv, "TX timeout on queue: %d, QP: 0x%x, CQ: 0x%x, Cons: 0x%x, Prod: 0x%x\n",
 			i, priv->tx_ring[i]->qpn, priv->tx_ring[i]->cqn,
 			priv->tx_ring[i]->cons, priv->tx_ring[i]->prod);
+		set_bit(i, priv->tx_hung);
 	}
 
 	priv->port_stats.tx_timeout++;
@@ -1387,12 +1686,58 @@ static void mlx4_en_tx_timeout(struct net_device *dev)
 }
 
 
+/* Replace the packet and byte totals with a fresh sum of the per-ring
+ * software counters, so they never lag behind an idle stats task.  The
+ * master keeps the port counters, which also account for its VFs.
+ */
+static void mlx4_en_fold_software_stats(struct mlx4_en_priv *priv,
+					struct net_device_stats *stats)
+{
+	unsigned long packets, bytes;
+	int i;
+
+	if (!priv->port_up || mlx4_is_master(priv->mdev->dev))
+		return;
+
+	packets = 0;
+	bytes = 0;
+	for (i = 0; i < priv->rx_ring_num; i++) {
+		const struct mlx4_en_rx_ring *ring = priv->rx_ring[i];
+
+		packets += ACCESS_ONCE(ring->packets);
+		bytes   += ACCESS_ONCE(ring->bytes);
+	}
+	stats->rx_packets = packets;
+	stats->rx_bytes   = bytes;
+
+	packets = 0;
+	bytes = 0;
+	for (i = 0; i < priv->tx_ring_num; i++) {
+		const struct mlx4_en_tx_ring *ring = priv->tx_ring[i];
+
+		packets += ACCESS_ONCE(ring->packets);
+		bytes   += ACCESS_ONCE(ring->bytes);
+	}
+	stats->tx_packets = packets;
+	stats->tx_bytes   = bytes;
+}
+
 static struct net_device_stats *mlx4_en_get_stats(struct net_device *dev)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
 
+	/* May run in atomic context, so only ask the stats task to resume
+	 * polling if it went idle; the counters only the firmware knows
+	 * are returned as last fetched.
+	 */
+	priv->stats_demand = jiffies;
+	if (priv->port_up &&
+	    time_after(jiffies, priv->stats_jiffies + 2 * STATS_DELAY))
+		mod_delayed_work(priv->mdev->workqueue, &priv->stats_task, 0);
+
 	spin_lock_bh(&priv->stats_lock);
 	memcpy(&priv->ret_stats, &priv->stats, sizeof(priv->stats));
+	mlx4_en_fold_software_stats(priv, &priv->ret_stats);
 	spin_unlock_bh(&priv->stats_lock);
 
 	return &priv->ret_stats;
@@ -1421,9 +1766,6 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 		cq = priv->rx_cq[i];
 		cq->moder_cnt = priv->rx_frames;
 		cq->moder_time = priv->rx_usecs;
-		priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
-		priv->last_moder_packets[i] = 0;
-		priv->last_moder_bytes[i] = 0;
 	}
 
 	for (i = 0; i < priv->tx_ring_num; i++) {
@@ -1437,73 +1779,44 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 	priv->rx_usecs_low = MLX4_EN_RX_COAL_TIME_LOW;
 	priv->pkt_rate_high = MLX4_EN_RX_RATE_HIGH;
 	priv->rx_usecs_high = MLX4_EN_RX_COAL_TIME_HIGH;
+	priv->tx_usecs_low = MLX4_EN_TX_COAL_TIME;
+	priv->tx_usecs_high = MLX4_EN_TX_COAL_TIME_HIGH;
 	priv->sample_interval = MLX4_EN_SAMPLE_INTERVAL;
 	priv->adaptive_rx_coal = 1;
-	priv->last_moder_jiffies = 0;
-	priv->last_moder_tx_packets = 0;
+	/* TX keeps the static tx_usecs/tx_frames until ethtool -C enables
+	 * adaptive-tx
+	 */
+	priv->adaptive_tx_coal = 0;
 }
 
-static void mlx4_en_auto_moderation(struct mlx4_en_priv *priv)
+/* Caller holds mdev->state_lock */
+static void mlx4_en_fetch_stats(struct mlx4_en_priv *priv)
 {
-	unsigned long period = (unsigned long) (jiffies - priv->last_moder_jiffies);
-	struct mlx4_en_cq *cq;
-	unsigned long packets;
-	unsigned long rate;
-	unsigned long avg_pkt_size;
-	unsigned long rx_packets;
-	unsigned long rx_bytes;
-	unsigned long rx_pkt_diff;
-	int moder_time;
-	int ring, err;
-
-	if (!priv->adaptive_rx_coal || period < priv->sample_interval * HZ)
-		return;
+	struct mlx4_en_dev *mdev = priv->mdev;
+	int err;
 
-	for (ring = 0; ring < priv->rx_ring_num; ring++) {
-		spin_lock_bh(&priv->stats_lock);
-		rx_packets = priv->rx_ring[ring]->packets;
-		rx_bytes = priv->rx_ring[ring]->bytes;
-		spin_unlock_bh(&priv->stats_lock);
-
-		rx_pkt_diff = ((unsigned long) (rx_packets -
-				priv->last_moder_packets[ring]));
-		packets = rx_pkt_diff;
-		rate = packets * HZ / period;
-		avg_pkt_size = packets ? ((unsigned long) (rx_bytes -
-				priv->last_moder_bytes[ring])) / packets : 0;
-
-		/* Apply auto-moderation only when packet rate
-		 * exceeds a rate that it matters */
-		if (rate > (MLX4_EN_RX_RATE_THRESH / priv->rx_ring_num) &&
-		    avg_pkt_size > MLX4_EN_AVG_PKT_SMALL) {
-			if (rate < priv->pkt_rate_low)
-				moder_time = priv->rx_usecs_low;
-			else if (rate > priv->pkt_rate_high)
-				moder_time = priv->rx_usecs_high;
-			else
-				moder_time = (rate - priv->pkt_rate_low) *
-					(priv->rx_usecs_high - priv->rx_usecs_low) /
-					(priv->pkt_rate_high - priv->pkt_rate_low) +
-					priv->rx_usecs_low;
-		} else {
-			moder_time = priv->rx_usecs_low;
-		}
+	if (mlx4_is_slave(mdev->dev))
+		err = mlx4_en_get_vport_stats(mdev, priv->port);
+	else
+		err = mlx4_en_DUMP_ETH_STATS(mdev, priv->port, 0);
+	if (err)
+		en_dbg(HW, priv, "Could not update stats\n");
+	else
+		priv->stats_jiffies = jiffies;
+}
 
-		if (moder_time != priv->last_moder_time[ring]) {
-			priv->last_moder_time[ring] = moder_time;
-			cq = priv->rx_cq[ring];
-			cq->moder_time = moder_time;
-			cq->moder_cnt = priv->rx_frames;
-			err = mlx4_en_set_cq_moder(priv, cq);
-			if (err)
-				en_err(priv, "Failed modifying moderation for cq:%d\n",
-				       ring);
-		}
-		priv->last_moder_packets[ring] = rx_packets;
-		priv->last_moder_bytes[ring] = rx_bytes;
-	}
+/* Synchronously refresh counters older than STATS_DELAY; may sleep */
+void mlx4_en_refresh_stats(struct mlx4_en_priv *priv)
+{
+	struct mlx4_en_dev *mdev = priv->mdev;
 
-	priv->last_moder_jiffies = jiffies;
+	priv->stats_demand = jiffies;
+
+	mutex_lock(&mdev->state_lock);
+	if (mdev->device_up && priv->port_up &&
+	    time_after(jiffies, priv->stats_jiffies + STATS_DELAY))
+		mlx4_en_fetch_stats(priv);
+	mutex_unlock(&mdev->state_lock);
 }
 
 static void mlx4_en_do_get_stats(struct work_struct *work)
@@ -1512,20 +1825,16 @@ static void mlx4_en_do_get_stats(struct work_struct *work)
 	struct mlx4_en_priv *priv = container_of(delay, struct mlx4_en_priv,
 						 stats_task);
 	struct mlx4_en_dev *mdev = priv->mdev;
-	int err;
 
 	mutex_lock(&mdev->state_lock);
 	if (mdev->device_up) {
-		if (priv->port_up) {
-			if (mlx4_is_slave(mdev->dev))
-				err = mlx4_en_get_vport_stats(mdev, priv->port);
-			else
-				err = mlx4_en_DUMP_ETH_STATS(mdev, priv->port, 0);
-			if (err)
-				en_dbg(HW, priv, "Could not update stats\n");
-
-			mlx4_en_auto_moderation(priv);
-		}
+		/* Hardware counters are only polled while someone reads
+		 * them; the task itself keeps ticking for the MAC restore
+		 * below.
+		 */
+		if (priv->port_up &&
+		    time_before(jiffies, priv->stats_demand + MLX4_EN_STATS_IDLE))
+			mlx4_en_fetch_stats(priv);
 
 		queue_delayed_work(mdev->workqueue, &priv->stats_task, STATS_DELAY);
 	}
@@ -1599,12 +1908,66 @@ static void mlx4_en_free_affinity_hint(struct mlx4_en_priv *priv, int ring_idx)
 	free_cpumask_var(priv->rx_ring[ring_idx]->affinity_mask);
 }
 
+/* Bring up TX ring @i and its completion queue. On failure nothing is
+ * left active for the ring.
+ */
+static int mlx4_en_start_tx_ring(struct mlx4_en_priv *priv, int i)
+{
+	struct mlx4_en_cq *cq = priv->tx_cq[i];
+	struct mlx4_en_tx_ring *tx_ring = priv->tx_ring[i];
+	int err;
+	int j;
+
+	/* Configure cq */
+	err = mlx4_en_activate_cq(priv, cq, i);
+	if (err) {
+		en_err(priv, "Failed allocating Tx CQ\n");
+		return err;
+	}
+	err = mlx4_en_set_cq_moder(priv, cq);
+	if (err) {
+		en_err(priv, "Failed setting cq moderation parameters\n");
+		mlx4_en_deactivate_cq(priv, cq);
+		return err;
+	}
+	en_dbg(DRV, priv, "Resetting index of collapsed CQ:%d to -1\n", i);
+	cq->buf->wqe_index = cpu_to_be16(0xffff);
+
+	/* Configure ring */
+#ifdef HAVE_NEW_TX_RING_SCHEME
+	err = mlx4_en_activate_tx_ring(priv, tx_ring, cq->mcq.cqn,
+		i / priv->num_tx_rings_p_up);
+#else
+	err = mlx4_en_activate_tx_ring(priv, tx_ring, cq->mcq.cqn);
+#endif
+	if (err) {
+		en_err(priv, "Failed allocating Tx ring\n");
+		mlx4_en_deactivate_cq(priv, cq);
+		return err;
+	}
+	tx_ring->tx_queue = netdev_get_tx_queue(priv->dev, i);
+
+	/* Arm CQ for TX completions */
+	mlx4_en_arm_cq(priv, cq);
+
+	/* Set initial ownership of all Tx TXBBs to SW (1) */
+	for (j = 0; j < tx_ring->buf_size; j += STAMP_STRIDE)
+		*((u32 *) (tx_ring->buf + j)) = INIT_OWNER_BIT;
+
+	return 0;
+}
+
+static void mlx4_en_stop_tx_ring(struct mlx4_en_priv *priv, int i)
+{
+	mlx4_en_deactivate_tx_ring(priv, priv->tx_ring[i]);
+	mlx4_en_deactivate_cq(priv, priv->tx_cq[i]);
+}
+
 int mlx4_en_start_port(struct net_device *dev)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
 	struct mlx4_en_dev *mdev = priv->mdev;
 	struct mlx4_en_cq *cq;
-	struct mlx4_en_tx_ring *tx_ring;
 	int rx_index = 0;
 	int tx_index = 0;
 	int err = 0;
@@ -1700,43 +2063,9 @@ int mlx4_en_start_port(struct net_device *dev)
 
 	/* Configure tx cq's and rings */
 	for (i = 0; i < priv->tx_ring_num; i++) {
-		/* Configure cq */
-		cq = priv->tx_cq[i];
-		err = mlx4_en_activate_cq(priv, cq, i);
-		if (err) {
-			en_err(priv, "Failed allocating Tx CQ\n");
-			goto tx_err;
-		}
-		err = mlx4_en_set_cq_moder(priv, cq);
-		if (err) {
-			en_err(priv, "Failed setting cq moderation parameters\n");
-			mlx4_en_deactivate_cq(priv, cq);
-			goto tx_err;
-		}
-		en_dbg(DRV, priv, "Resetting index of collapsed CQ:%d to -1\n", i);
-		cq->buf->wqe_index = cpu_to_be16(0xffff);
-
-		/* Configure ring */
-		tx_ring = priv->tx_ring[i];
-#ifdef HAVE_NEW_TX_RING_SCHEME
-		err = mlx4_en_activate_tx_ring(priv, tx_ring, cq->mcq.cqn,
-			i / priv->num_tx_rings_p_up);
-#else
-		err = mlx4_en_activate_tx_ring(priv, tx_ring, cq->mcq.cqn);
-#endif
-		if (err) {
-			en_err(priv, "Failed allocating Tx ring\n");
-			mlx4_en_deactivate_cq(priv, cq);
+		err = mlx4_en_start_tx_ring(priv, i);
+		if (err)
 			goto tx_err;
-		}
-		tx_ring->tx_queue = netdev_get_tx_queue(dev, i);
-
-		/* Arm CQ for TX completions */
-		mlx4_en_arm_cq(priv, cq);
-
-		/* Set initial ownership of all Tx TXBBs to SW (1) */
-		for (j = 0; j < tx_ring->buf_size; j += STAMP_STRIDE)
-			*((u32 *) (tx_ring->buf + j)) = INIT_OWNER_BIT;
 		++tx_index;
 	}
 
@@ -1793,7 +2122,7 @@ int mlx4_en_start_port(struct net_device *dev)
 	priv->flags &= ~(MLX4_EN_FLAG_PROMISC | MLX4_EN_FLAG_MC_PROMISC);
 
 	/* Schedule multicast task to populate multicast list */
-	queue_work(mdev->workqueue, &priv->rx_mode_task);
+	queue_delayed_work(mdev->workqueue, &priv->rx_mode_task, 0);
 
 #ifdef HAVE_VXLAN_DYNAMIC_PORT
 	if (priv->mdev->dev->caps.tunnel_offload_mode == MLX4_TUNNEL_OFFLOAD_MODE_VXLAN)
@@ -1801,16 +2130,16 @@ int mlx4_en_start_port(struct net_device *dev)
 #endif
 
 	priv->port_up = true;
+	/* collect a first set of counters right after bring-up */
+	priv->stats_demand = jiffies;
 	netif_tx_start_all_queues(dev);
 	netif_device_attach(dev);
 
 	return 0;
 
 tx_err:
-	while (tx_index--) {
-		mlx4_en_deactivate_tx_ring(priv, priv->tx_ring[tx_index]);
-		mlx4_en_deactivate_cq(priv, priv->tx_cq[tx_index]);
-	}
+	while (tx_index--)
+		mlx4_en_stop_tx_ring(priv, tx_index);
 	mlx4_en_destroy_drop_qp(priv);
 rss_err:
 	mlx4_en_release_rss_steer(priv);
@@ -1889,6 +2218,8 @@ void mlx4_en_stop_port(struct net_device *dev, int detach)
 	mlx4_multicast_detach(mdev->dev, &priv->rss_map.indir_qp, mc_list,
 			      MLX4_PROT_ETH, priv->broadcast_id);
 	list_for_each_entry(mclist, &priv->curr_list, list) {
+		if (!mclist->attached)
+			continue;
 		memcpy(&mc_list[10], mclist->addr, ETH_ALEN);
 		mc_list[5] = priv->port;
 		mlx4_multicast_detach(mdev->dev, &priv->rss_map.indir_qp,
@@ -1897,13 +2228,12 @@ void mlx4_en_stop_port(struct net_device *dev, int detach)
 			mlx4_flow_detach(mdev->dev, mclist->tunnel_reg_id);
 	}
 	mlx4_en_clear_list(dev);
-	list_for_each_entry_safe(mclist, tmp, &priv->curr_list, list) {
-		list_del(&mclist->list);
-		kfree(mclist);
-	}
+	list_for_each_entry_safe(mclist, tmp, &priv->curr_list, list)
+		mlx4_en_mc_free(mclist);
 
 	/* Flush multicast filter */
 	mlx4_SET_MCAST_FLTR(mdev->dev, priv->port, 0, 1, MLX4_MCAST_CONFIG);
+	priv->flags &= ~MLX4_EN_FLAG_MC_FLTR_SYNC;
 
 	/* Remove flow steering rules for the port*/
 	if (mdev->dev->caps.steering_mode ==
@@ -1918,15 +2248,20 @@ void mlx4_en_stop_port(struct net_device *dev, int detach)
 
 	mlx4_en_destroy_drop_qp(priv);
 
-	/* Free TX Rings */
+	/* Free TX Rings, except those a failed ring recovery already took
+	 * down.
+	 */
 	for (i = 0; i < priv->tx_ring_num; i++) {
-		mlx4_en_deactivate_tx_ring(priv, priv->tx_ring[i]);
-		mlx4_en_deactivate_cq(priv, priv->tx_cq[i]);
+		if (test_bit(i, priv->tx_down))
+			continue;
+		mlx4_en_stop_tx_ring(priv, i);
 	}
 	msleep(10);
 
 	for (i = 0; i < priv->tx_ring_num; i++)
 		mlx4_en_free_tx_buf(dev, priv->tx_ring[i]);
+	bitmap_zero(priv->tx_down, MAX_TX_RINGS);
+	bitmap_zero(priv->tx_hung, MAX_TX_RINGS);
 
 	if (mdev->dev->caps.steering_mode != MLX4_STEERING_MODE_A0)
 		mlx4_en_delete_rss_steer_rules(priv);
@@ -1958,6 +2293,71 @@ void mlx4_en_stop_port(struct net_device *dev, int detach)
 	}
 }
 
+/* Reset only the TX rings the watchdog reported as stuck. The port,
+ * its RX rings and steering are left untouched, so traffic on the other
+ * queues keeps flowing. Returns nonzero if a ring could not be brought
+ * back, in which case the caller falls back to a full port restart.
+ */
+static int mlx4_en_recover_tx_rings(struct mlx4_en_priv *priv)
+{
+	struct net_device *dev = priv->dev;
+	DECLARE_BITMAP(hung, MAX_TX_RINGS);
+	struct netdev_queue *txq;
+	ktime_t start = ktime_get();
+	int err;
+	int i;
+
+	bitmap_zero(hung, MAX_TX_RINGS);
+	for (i = 0; i < priv->tx_ring_num; i++)
+		if (test_and_clear_bit(i, priv->tx_hung))
+			set_bit(i, hung);
+
+	/* The port stays up, so quiesce the completion path first: a live
+	 * TX NAPI could wake the queue again. Once the queue is stopped
+	 * under its lock, no xmit runs on the ring until it is restarted.
+	 */
+	for_each_set_bit(i, hung, priv->tx_ring_num) {
+		napi_disable(&priv->tx_cq[i]->napi);
+		txq = netdev_get_tx_queue(dev, i);
+		__netif_tx_lock_bh(txq);
+		netif_tx_stop_queue(txq);
+		__netif_tx_unlock_bh(txq);
+		mlx4_en_deactivate_tx_ring(priv, priv->tx_ring[i]);
+		__mlx4_en_deactivate_cq(priv, priv->tx_cq[i]);
+	}
+	msleep(10);
+
+	/* Reclaim every hung ring before restarting any, so a failed
+	 * restart leaves nothing in flight behind. With no descriptor left
+	 * to skip, the stop_port reclaim of a ring that stays down is a
+	 * no-op.
+	 */
+	for_each_set_bit(i, hung, priv->tx_ring_num) {
+		mlx4_en_free_tx_buf(dev, priv->tx_ring[i]);
+		priv->tx_ring[i]->last_nr_txbb = 0;
+	}
+
+	for_each_set_bit(i, hung, priv->tx_ring_num) {
+		err = mlx4_en_start_tx_ring(priv, i);
+		if (err) {
+			en_err(priv, "Failed recovering TX ring %d\n", i);
+			/* This ring and the ones not yet restarted are down */
+			for (; i < priv->tx_ring_num; i++)
+				if (test_bit(i, hung))
+					set_bit(i, priv->tx_down);
+			return err;
+		}
+		netif_tx_wake_queue(netdev_get_tx_queue(dev, i));
+		priv->port_stats.tx_ring_recoveries++;
+	}
+
+	priv->port_stats.tx_ring_recovery_usecs =
+		ktime_us_delta(ktime_get(), start);
+	en_info(priv, "Recovered hung TX rings in %lu usecs\n",
+		priv->port_stats.tx_ring_recovery_usecs);
+	return 0;
+}
+
 static void mlx4_en_restart(struct work_struct *work)
 {
 	struct mlx4_en_priv *priv = container_of(work, struct mlx4_en_priv,
@@ -1965,6 +2365,8 @@ static void mlx4_en_restart(struct work_struct *work)
 	struct mlx4_en_dev *mdev = priv->mdev;
 	struct net_device *dev = priv->dev;
 	bool lock_flag = false;
+	bool full_restart;
+	ktime_t start;
 
 	en_dbg(DRV, priv, "Watchdog task called for port %d\n", priv->port);
 
@@ -1973,15 +2375,32 @@ static void mlx4_en_restart(struct work_struct *work)
 		rtnl_lock();
 	}
 	mutex_lock(&mdev->state_lock);
-	if (priv->port_up) {
+	/* Ring recovery only serves tx_timeout; a full restart requested
+	 * meanwhile, e.g. after a failed MTU change left the port down, is
+	 * still carried out.
+	 */
+	full_restart = priv->full_restart;
+	priv->full_restart = false;
+	if (priv->port_up ||
+	    (full_restart && mdev->device_up && netif_running(dev))) {
+		if (!full_restart &&
+		    !bitmap_empty(priv->tx_hung, priv->tx_ring_num) &&
+		    !mlx4_en_recover_tx_rings(priv))
+			goto out;
+
+		start = ktime_get();
 		mlx4_en_stop_port(dev, 1);
 		if (mlx4_en_start_port(dev))
 			en_err(priv, "Failed restarting port %d\n", priv->port);
+		priv->port_stats.port_restarts++;
+		priv->port_stats.port_restart_usecs =
+			ktime_us_delta(ktime_get(), start);
 	}
+out:
 	mutex_unlock(&mdev->state_lock);
 	if (lock_flag)
 		rtnl_unlock();
-	}
+}
 
 static void mlx4_en_clear_stats(struct net_device *dev)
 {
@@ -2009,6 +2428,13 @@ static void mlx4_en_clear_stats(struct net_device *dev)
 		priv->tx_ring[i]->bytes = 0;
 		priv->tx_ring[i]->packets = 0;
 		priv->tx_ring[i]->tx_csum = 0;
+		priv->tx_ring[i]->tx_edge_pad = 0;
+		priv->tx_ring[i]->tx_inline = 0;
+		priv->tx_ring[i]->tx_bf = 0;
+		priv->tx_ring[i]->tx_doorbell = 0;
+		priv->tx_ring[i]->policy_sends = 0;
+		priv->tx_ring[i]->policy_doorbells = 0;
+		priv->tx_ring[i]->policy_bytes = 0;
 	}
 	for (i = 0; i < priv->rx_ring_num; i++) {
 		priv->rx_ring[i]->bytes = 0;
@@ -2016,7 +2442,18 @@ static void mlx4_en_clear_stats(struct net_device *dev)
 		priv->rx_ring[i]->csum_ok = 0;
 		priv->rx_ring[i]->csum_none = 0;
 		priv->rx_ring[i]->csum_complete = 0;
+		priv->rx_ring[i]->pages_reused = 0;
+		priv->rx_ring[i]->pages_allocated = 0;
+		priv->rx_ring[i]->pages_waived = 0;
+		priv->rx_ring[i]->mc_loopback_dropped = 0;
+		priv->rx_ring[i]->hdr_pulls = 0;
 	}
+	priv->rx_mode_applied = 0;
+#ifdef CONFIG_RFS_ACCEL
+	priv->filter_collisions = 0;
+	priv->filter_expired = 0;
+	priv->filter_expire_latency = 0;
+#endif
 }
 
 static int mlx4_en_open(struct net_device *dev)
@@ -2399,6 +2836,7 @@ void mlx4_en_destroy_netdev(struct net_device *dev)
 
 	cancel_delayed_work(&priv->stats_task);
 	cancel_delayed_work(&priv->service_task);
+	cancel_delayed_work_sync(&priv->rx_mode_task);
 	/* flush any pending task for this netdev */
 	flush_workqueue(mdev->workqueue);
 
@@ -2420,6 +2858,11 @@ void mlx4_en_destroy_netdev(struct net_device *dev)
 	}
 
 	mlx4_en_free_resources(priv);
+#ifdef CONFIG_RFS_ACCEL
+#ifdef HAVE_NDO_RX_FLOW_STEER
+	mlx4_en_filter_table_free(priv);
+#endif
+#endif
 
 	kfree(priv->tx_ring);
 	kfree(priv->tx_cq);
@@ -2460,6 +2903,7 @@ static int mlx4_en_change_mtu(struct net_device *dev, int new_mtu)
 			if (err) {
 				en_err(priv, "Failed restarting port:%d\n",
 					 priv->port);
+				priv->full_restart = true;
 				queue_work(mdev->workqueue, &priv->watchdog_task);
 			}
 		}
@@ -3332,7 +3776,7 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 	memset(priv, 0, sizeof(struct mlx4_en_priv));
 	priv->counter_index = 0xff;
 	spin_lock_init(&priv->stats_lock);
-	INIT_WORK(&priv->rx_mode_task, mlx4_en_do_set_rx_mode);
+	INIT_DELAYED_WORK(&priv->rx_mode_task, mlx4_en_do_set_rx_mode);
 	INIT_WORK(&priv->watchdog_task, mlx4_en_restart);
 	INIT_WORK(&priv->linkstate_task, mlx4_en_linkstate);
 	INIT_DELAYED_WORK(&priv->stats_task, mlx4_en_do_get_stats);
@@ -3342,7 +3786,6 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 	INIT_WORK(&priv->vxlan_del_task, mlx4_en_del_vxlan_offloads);
 #endif
 #ifdef CONFIG_RFS_ACCEL
-	INIT_LIST_HEAD(&priv->filters);
 	spin_lock_init(&priv->filters_lock);
 #endif
 
@@ -3354,6 +3797,8 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 	priv->port_up = false;
 	priv->flags = prof->flags;
 	priv->pflags = MLX4_EN_PRIV_FLAGS_BLUEFLAME;
+	priv->rx_copybreak = SMALL_PACKET_SIZE;
+	priv->rx_hdr_copy = MLX4_EN_HDR_COPY_AUTO;
 	priv->ctrl_flags = cpu_to_be32(MLX4_WQE_CTRL_CQ_UPDATE |
 			MLX4_WQE_CTRL_SOLICITED);
 	priv->num_tx_rings_p_up = mdev->profile.num_tx_rings_p_up;
@@ -3375,6 +3820,13 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 		err = -ENOMEM;
 		goto out;
 	}
+#ifdef CONFIG_RFS_ACCEL
+#ifdef HAVE_NDO_RX_FLOW_STEER
+	err = mlx4_en_filter_table_alloc(priv);
+	if (err)
+		goto out;
+#endif
+#endif
 	priv->rx_ring_num = prof->rx_ring_num;
 	priv->cqe_factor = (mdev->dev->caps.cqe_size == 64) ? 1 : 0;
 	priv->cqe_size = mdev->dev->caps.cqe_size;
@@ -178,10 +178,21 @@ int mlx4_en_DUMP_ETH_STATS(struct mlx4_en_dev *mdev, u8 port, u8 reset)
 	priv->port_stats.rx_chksum_good = 0;
 	priv->port_stats.rx_chksum_none = 0;
 	priv->port_stats.rx_chksum_complete = 0;
+	priv->port_stats.rx_pages_reused = 0;
+	priv->port_stats.rx_pages_allocated = 0;
+	priv->port_stats.rx_pages_waived = 0;
+	priv->port_stats.rx_mc_loopback_dropped = 0;
+	priv->port_stats.rx_hdr_pulls = 0;
 	for (i = 0; i < priv->rx_ring_num; i++) {
 		priv->port_stats.rx_chksum_good += priv->rx_ring[i]->csum_ok;
 		priv->port_stats.rx_chksum_none += priv->rx_ring[i]->csum_none;
 		priv->port_stats.rx_chksum_complete += priv->rx_ring[i]->csum_complete;
+		priv->port_stats.rx_pages_reused += priv->rx_ring[i]->pages_reused;
+		priv->port_stats.rx_pages_allocated += priv->rx_ring[i]->pages_allocated;
+		priv->port_stats.rx_pages_waived += priv->rx_ring[i]->pages_waived;
+		priv->port_stats.rx_mc_loopback_dropped +=
+			priv->rx_ring[i]->mc_loopback_dropped;
+		priv->port_stats.rx_hdr_pulls += priv->rx_ring[i]->hdr_pulls;
 	}
 	stats->tx_packets = 0;
 	stats->tx_bytes = 0;
@@ -190,6 +201,7 @@ int mlx4_en_DUMP_ETH_STATS(struct mlx4_en_dev *mdev, u8 port, u8 reset)
 	priv->port_stats.wake_queue = 0;
 	priv->port_stats.tso_packets = 0;
 	priv->port_stats.xmit_more = 0;
+	priv->port_stats.tx_edge_padding = 0;
 
 	for (i = 0; i < priv->tx_ring_num; i++) {
 		const struct mlx4_en_tx_ring *ring = priv->tx_ring[i];
@@ -199,7 +211,16 @@ int mlx4_en_DUMP_ETH_STATS(struct mlx4_en_dev *mdev, u8 port, u8 reset)
 		priv->port_stats.wake_queue        += ring->wake_queue;
 		priv->port_stats.tso_packets       += ring->tso_packets;
 		priv->port_stats.xmit_more         += ring->xmit_more;
+		priv->port_stats.tx_edge_padding   += ring->tx_edge_pad;
 	}
+	priv->port_stats.rx_mode_pending = priv->rx_mode_pending;
+	priv->port_stats.rx_mode_applied = priv->rx_mode_applied;
+#ifdef CONFIG_RFS_ACCEL
+	priv->port_stats.rfs_filters = priv->filter_count;
+	priv->port_stats.rfs_collisions = priv->filter_collisions;
+	priv->port_stats.rfs_expired = priv->filter_expired;
+	priv->port_stats.rfs_expire_latency = priv->filter_expire_latency;
+#endif
 
 	/* net device stats */
 	stats->rx_errors = be64_to_cpu(mlx4_en_stats->PCS) +
@@ -421,12 +442,23 @@ int mlx4_en_get_vport_stats(struct mlx4_en_dev *mdev, u8 port)
 	priv->port_stats.rx_chksum_good = 0;
 	priv->port_stats.rx_chksum_none = 0;
 	priv->port_stats.rx_chksum_complete = 0;
+	priv->port_stats.rx_pages_reused = 0;
+	priv->port_stats.rx_pages_allocated = 0;
+	priv->port_stats.rx_pages_waived = 0;
+	priv->port_stats.rx_mc_loopback_dropped = 0;
+	priv->port_stats.rx_hdr_pulls = 0;
 	for (i = 0; i < priv->rx_ring_num; i++) {
 		priv->stats.rx_packets += priv->rx_ring[i]->packets;
 		priv->stats.rx_bytes += priv->rx_ring[i]->bytes;
 		priv->port_stats.rx_chksum_good += priv->rx_ring[i]->csum_ok;
 		priv->port_stats.rx_chksum_none += priv->rx_ring[i]->csum_none;
 		priv->port_stats.rx_chksum_complete += priv->rx_ring[i]->csum_complete;
+		priv->port_stats.rx_pages_reused += priv->rx_ring[i]->pages_reused;
+		priv->port_stats.rx_pages_allocated += priv->rx_ring[i]->pages_allocated;
+		priv->port_stats.rx_pages_waived += priv->rx_ring[i]->pages_waived;
+		priv->port_stats.rx_mc_loopback_dropped +=
+			priv->rx_ring[i]->mc_loopback_dropped;
+		priv->port_stats.rx_hdr_pulls += priv->rx_ring[i]->hdr_pulls;
 	}
 	priv->stats.tx_packets = 0;
 	priv->stats.tx_bytes = 0;
@@ -435,6 +467,7 @@ int mlx4_en_get_vport_stats(struct mlx4_en_dev *mdev, u8 port)
 	priv->port_stats.wake_queue = 0;
 	priv->port_stats.tso_packets = 0;
 	priv->port_stats.xmit_more = 0;
+	priv->port_stats.tx_edge_padding = 0;
 
 	for (i = 0; i < priv->tx_ring_num; i++) {
 		const struct mlx4_en_tx_ring *ring = priv->tx_ring[i];
@@ -446,7 +479,16 @@ int mlx4_en_get_vport_stats(struct mlx4_en_dev *mdev, u8 port)
 		priv->port_stats.wake_queue        += ring->wake_queue;
 		priv->port_stats.tso_packets       += ring->tso_packets;
 		priv->port_stats.xmit_more         += ring->xmit_more;
+		priv->port_stats.tx_edge_padding   += ring->tx_edge_pad;
 	}
+	priv->port_stats.rx_mode_pending = priv->rx_mode_pending;
+	priv->port_stats.rx_mode_applied = priv->rx_mode_applied;
+#ifdef CONFIG_RFS_ACCEL
+	priv->port_stats.rfs_filters = priv->filter_count;
+	priv->port_stats.rfs_collisions = priv->filter_collisions;
+	priv->port_stats.rfs_expired = priv->filter_expired;
+	priv->port_stats.rfs_expire_latency = priv->filter_expire_latency;
+#endif
 
 	spin_unlock_bh(&priv->stats_lock);
 
@@ -117,6 +117,33 @@ int mlx4_en_change_mcast_loopback(struct mlx4_en_priv *priv, struct mlx4_qp *qp,
 	return ret;
 }
 
+/* Let the firmware drop multicast we looped back ourselves, so the RX
+ * path can skip the software source MAC check.
+ */
+void mlx4_en_update_mcast_lb_filter(struct mlx4_en_priv *priv, int loopback)
+{
+	int err = 0;
+	int i;
+
+	priv->flags &= ~MLX4_EN_FLAG_RX_FILTER_HW;
+	if (!(priv->mdev->dev->caps.flags2 &
+	      MLX4_DEV_CAP_FLAG2_UPDATE_QP_SRC_CHECK_LB))
+		return;
+
+	for (i = 0; i < priv->rx_ring_num && !err; i++)
+		err = mlx4_en_change_mcast_loopback(priv,
+						    &priv->rss_map.qps[i],
+						    loopback);
+	if (err) {
+		en_warn(priv, "Failed to set multicast loopback check (%d), using software filter\n",
+			err);
+		return;
+	}
+
+	if (!loopback)
+		priv->flags |= MLX4_EN_FLAG_RX_FILTER_HW;
+}
+
 int mlx4_en_map_buffer(struct mlx4_buf *buf)
 {
 	struct page **pages;
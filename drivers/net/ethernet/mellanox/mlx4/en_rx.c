@@ -49,7 +49,134 @@
 
 #include "mlx4_en.h"
 
+static bool mlx4_en_page_cache_get(struct mlx4_en_priv *priv,
+				   struct mlx4_en_rx_ring *ring,
+				   struct mlx4_en_rx_alloc *page_alloc,
+				   const struct mlx4_en_frag_info *frag_info)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_page_cache_entry *e;
+
+	if (cache->head == cache->tail)
+		return false;
+
+	e = &cache->buf[cache->head & cache->size_mask];
+	if (!e->done || page_count(e->page) != 1 ||
+	    e->page_size < frag_info->frag_stride)
+		return false;
+	cache->head++;
+
+	dma_sync_single_for_device(priv->ddev, e->dma, e->page_size,
+				   DMA_FROM_DEVICE);
+	page_alloc->page_size = e->page_size;
+	page_alloc->page = e->page;
+	page_alloc->dma = e->dma;
+	page_alloc->page_offset = 0;
+	/* We hold the only reference: one per fragment plus the cache's */
+	atomic_add(e->page_size / frag_info->frag_stride, &e->page->_count);
+	ring->pages_reused++;
+	return true;
+}
+
+/* Called once all fragments of a page were posted to the ring */
+static void mlx4_en_page_cache_put(struct mlx4_en_priv *priv,
+				   struct mlx4_en_rx_ring *ring,
+				   const struct mlx4_en_rx_alloc *page_alloc)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_page_cache_entry *e;
+
+	if (cache->tail - cache->head > cache->size_mask) {
+		e = &cache->buf[cache->head & cache->size_mask];
+		if (!e->done) {
+			/* Too many pages in flight: give up on this one and
+			 * let its last fragment unmap it as usual.
+			 */
+			put_page(page_alloc->page);
+			ring->pages_waived++;
+			return;
+		}
+		dma_unmap_page(priv->ddev, e->dma, e->page_size,
+			       PCI_DMA_FROMDEVICE);
+		put_page(e->page);
+		cache->head++;
+		ring->pages_waived++;
+	}
+
+	e = &cache->buf[cache->tail & cache->size_mask];
+	e->page = page_alloc->page;
+	e->dma = page_alloc->dma;
+	e->page_size = page_alloc->page_size;
+	e->done = false;
+	cache->tail++;
+}
+
+/* The last fragment of a cached page left the ring; the cache now owns the
+ * DMA mapping. Returns false if the page is not cached.
+ */
+static bool mlx4_en_page_cache_complete(struct mlx4_en_rx_ring *ring,
+					dma_addr_t dma)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_page_cache_entry *e;
+	u32 idx;
+
+	for (idx = cache->head; idx != cache->tail; idx++) {
+		e = &cache->buf[idx & cache->size_mask];
+		if (!e->done && e->dma == dma) {
+			e->done = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int mlx4_en_page_cache_init(struct mlx4_en_priv *priv,
+				   struct mlx4_en_rx_ring *ring)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	u32 in_flight = 0;
+	u32 size;
+	int i;
+
+	memset(cache, 0, sizeof(*cache));
+	if (!priv->mdev->profile.rx_page_reuse)
+		return 0;
+
+	for (i = 0; i < priv->num_frags; i++)
+		in_flight += DIV_ROUND_UP(ring->size *
+					  priv->frag_info[i].frag_stride,
+					  MLX4_EN_ALLOC_SIZE);
+	size = roundup_pow_of_two(in_flight + MLX4_EN_PAGE_CACHE_SPARE);
+
+	cache->buf = kcalloc(size, sizeof(*cache->buf), GFP_KERNEL);
+	if (!cache->buf)
+		return -ENOMEM;
+	cache->size_mask = size - 1;
+	return 0;
+}
+
+static void mlx4_en_page_cache_destroy(struct mlx4_en_priv *priv,
+				       struct mlx4_en_rx_ring *ring)
+{
+	struct mlx4_en_page_cache *cache = &ring->page_cache;
+	struct mlx4_en_page_cache_entry *e;
+
+	if (!cache->buf)
+		return;
+
+	for (; cache->head != cache->tail; cache->head++) {
+		e = &cache->buf[cache->head & cache->size_mask];
+		dma_unmap_page(priv->ddev, e->dma, e->page_size,
+			       PCI_DMA_FROMDEVICE);
+		put_page(e->page);
+	}
+	kfree(cache->buf);
+	cache->buf = NULL;
+}
+
 static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
+			    struct mlx4_en_rx_ring *ring,
 			    struct mlx4_en_rx_alloc *page_alloc,
 			    const struct mlx4_en_frag_info *frag_info,
 			    gfp_t _gfp)
@@ -58,6 +185,10 @@ static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
 	struct page *page;
 	dma_addr_t dma;
 
+	if (ring->page_cache.buf &&
+	    mlx4_en_page_cache_get(priv, ring, page_alloc, frag_info))
+		return 0;
+
 	for (order = MLX4_EN_ALLOC_PREFER_ORDER; ;) {
 		gfp_t gfp = _gfp;
 
@@ -82,18 +213,21 @@ static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
 	page_alloc->page_offset = 0;
 	/* Not doing get_page() for each frag is a big win
 	 * on asymetric workloads. Note we can not use atomic_set().
+	 * With page reuse the cache holds one more reference.
 	 */
-	atomic_add(page_alloc->page_size / frag_info->frag_stride - 1,
-		   &page->_count);
+	atomic_add(page_alloc->page_size / frag_info->frag_stride - 1 +
+		   !!ring->page_cache.buf, &page->_count);
+	ring->pages_allocated++;
 	return 0;
 }
 
 static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
+			       struct mlx4_en_rx_ring *ring,
 			       struct mlx4_en_rx_desc *rx_desc,
 			       struct mlx4_en_rx_alloc *frags,
-			       struct mlx4_en_rx_alloc *ring_alloc,
 			       gfp_t gfp)
 {
+	struct mlx4_en_rx_alloc *ring_alloc = ring->page_alloc;
 	struct mlx4_en_rx_alloc page_alloc[MLX4_EN_MAX_RX_FRAGS];
 	const struct mlx4_en_frag_info *frag_info;
 	struct page *page;
@@ -109,13 +243,17 @@ static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
 		    ring_alloc[i].page_size)
 			continue;
 
-		if (mlx4_alloc_pages(priv, &page_alloc[i], frag_info, gfp))
+		if (mlx4_alloc_pages(priv, ring, &page_alloc[i], frag_info,
+				     gfp))
 			goto out;
 	}
 
 	for (i = 0; i < priv->num_frags; i++) {
 		frags[i] = ring_alloc[i];
 		dma = ring_alloc[i].dma + ring_alloc[i].page_offset;
+		if (ring->page_cache.buf &&
+		    page_alloc[i].page != ring_alloc[i].page)
+			mlx4_en_page_cache_put(priv, ring, &ring_alloc[i]);
 		ring_alloc[i] = page_alloc[i];
 		rx_desc->data[i].addr = cpu_to_be64(dma);
 	}
@@ -136,6 +274,7 @@ out:
 }
 
 static void mlx4_en_free_frag(struct mlx4_en_priv *priv,
+			      struct mlx4_en_rx_ring *ring,
 			      struct mlx4_en_rx_alloc *frags,
 			      int i)
 {
@@ -143,7 +282,9 @@ static void mlx4_en_free_frag(struct mlx4_en_priv *priv,
 	u32 next_frag_end = frags[i].page_offset + 2 * frag_info->frag_stride;
 
 
-	if (next_frag_end > frags[i].page_size)
+	if (next_frag_end > frags[i].page_size &&
+	    !(ring->page_cache.buf &&
+	      mlx4_en_page_cache_complete(ring, frags[i].dma)))
 		dma_unmap_page(priv->ddev, frags[i].dma, frags[i].page_size,
 			       PCI_DMA_FROMDEVICE);
 
@@ -157,10 +298,13 @@ static int mlx4_en_init_allocator(struct mlx4_en_priv *priv,
 	int i;
 	struct mlx4_en_rx_alloc *page_alloc;
 
+	if (mlx4_en_page_cache_init(priv, ring))
+		return -ENOMEM;
+
 	for (i = 0; i < priv->num_frags; i++) {
 		const struct mlx4_en_frag_info *frag_info = &priv->frag_info[i];
 
-		if (mlx4_alloc_pages(priv, &ring->page_alloc[i],
+		if (mlx4_alloc_pages(priv, ring, &ring->page_alloc[i],
 				     frag_info, GFP_KERNEL | __GFP_COLD))
 			goto out;
 
@@ -182,6 +326,7 @@ out:
 		put_page(page);
 		page_alloc->page = NULL;
 	}
+	mlx4_en_page_cache_destroy(priv, ring);
 	return -ENOMEM;
 }
 
@@ -205,8 +350,12 @@ static void mlx4_en_destroy_allocator(struct mlx4_en_priv *priv,
 			put_page(page_alloc->page);
 			page_alloc->page_offset += frag_info->frag_stride;
 		}
+		/* drop the reference held on behalf of the page cache */
+		if (ring->page_cache.buf)
+			put_page(page_alloc->page);
 		page_alloc->page = NULL;
 	}
+	mlx4_en_page_cache_destroy(priv, ring);
 }
 
 static void mlx4_en_init_rx_desc(struct mlx4_en_priv *priv,
@@ -242,7 +391,7 @@ static int mlx4_en_prepare_rx_desc(struct mlx4_en_priv *priv,
 	struct mlx4_en_rx_alloc *frags = ring->rx_info +
 					(index << priv->log_rx_info);
 
-	return mlx4_en_alloc_frags(priv, rx_desc, frags, ring->page_alloc, gfp);
+	return mlx4_en_alloc_frags(priv, ring, rx_desc, frags, gfp);
 }
 
 static inline bool mlx4_en_is_ring_empty(struct mlx4_en_rx_ring *ring)
@@ -265,7 +414,7 @@ static void mlx4_en_free_rx_desc(struct mlx4_en_priv *priv,
 	frags = ring->rx_info + (index << priv->log_rx_info);
 	for (nr = 0; nr < priv->num_frags; nr++) {
 		en_dbg(DRV, priv, "Freeing fragment:%d\n", nr);
-		mlx4_en_free_frag(priv, frags, nr);
+		mlx4_en_free_frag(priv, ring, frags, nr);
 	}
 }
 
@@ -436,6 +585,8 @@ int mlx4_en_create_rx_ring(struct mlx4_en_priv *priv,
 	ring->stride = stride;
 	ring->log_stride = ffs(ring->stride) - 1;
 	ring->buf_size = ring->size * ring->stride + TXBB_SIZE;
+	ring->copybreak = priv->rx_copybreak;
+	ring->hdr_copy = priv->rx_hdr_copy;
 
 	tmp = size * roundup_pow_of_two(MLX4_EN_MAX_RX_FRAGS *
 					sizeof(struct mlx4_en_rx_alloc));
@@ -648,17 +799,41 @@ fail:
 }
 
 
+/* Length of the L2-L4 headers at va, including the inner headers of a
+ * VXLAN packet when the HW reported one.
+ */
+static unsigned int mlx4_en_rx_hdr_len(void *va, unsigned int len,
+				       bool l2_tunnel)
+{
+#ifdef HAVE_ETH_GET_HEADLEN
+	unsigned int hlen = eth_get_headlen(va, len);
+
+	if (l2_tunnel && hlen + MLX4_EN_TUNNEL_HDR_LEN < len) {
+		hlen += MLX4_EN_TUNNEL_HDR_LEN;
+		hlen += eth_get_headlen(va + hlen, len - hlen);
+	}
+
+	return hlen;
+#else
+	return min_t(unsigned int, len, HEADER_COPY_SIZE);
+#endif
+}
+
 static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
+				      struct mlx4_en_rx_ring *ring,
 				      struct mlx4_en_rx_desc *rx_desc,
 				      struct mlx4_en_rx_alloc *frags,
-				      unsigned int length)
+				      unsigned int length, bool l2_tunnel)
 {
+	unsigned int hdr_len, pull_len, scan_len;
 	struct sk_buff *skb;
 	void *va;
 	int used_frags;
 	dma_addr_t dma;
 
-	skb = netdev_alloc_skb(priv->dev, SMALL_PACKET_SIZE + NET_IP_ALIGN);
+	skb = netdev_alloc_skb(priv->dev,
+			       max_t(unsigned int, ring->copybreak,
+				     MLX4_EN_MAX_HDR_COPY) + NET_IP_ALIGN);
 	if (!skb) {
 		en_dbg(RX_ERR, priv, "Failed allocating skb\n");
 		return NULL;
@@ -669,20 +844,31 @@ static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
 	/* Get pointer to first fragment so we could copy the headers into the
 	 * (linear part of the) skb */
 	va = page_address(frags[0].page) + frags[0].page_offset;
+	dma = be64_to_cpu(rx_desc->data[0].addr);
 
-	if (length <= SMALL_PACKET_SIZE) {
+	if (length <= ring->copybreak) {
+		pull_len = length;
+	} else {
+		/* Sync the headers for the CPU to size the copy */
+		scan_len = min_t(unsigned int, length, MLX4_EN_MAX_HDR_COPY);
+		dma_sync_single_for_cpu(priv->ddev, dma, scan_len,
+					DMA_FROM_DEVICE);
+		hdr_len = mlx4_en_rx_hdr_len(va, scan_len, l2_tunnel);
+		pull_len = ring->hdr_copy == MLX4_EN_HDR_COPY_AUTO ? hdr_len :
+			   min_t(unsigned int, ring->hdr_copy, scan_len);
+		/* The stack will have to pull the rest of the headers */
+		if (pull_len < hdr_len)
+			ring->hdr_pulls++;
+	}
+
+	if (pull_len >= length) {
 		/* We are copying all relevant data to the skb - temporarily
 		 * sync buffers for the copy */
-		dma = be64_to_cpu(rx_desc->data[0].addr);
 		dma_sync_single_for_cpu(priv->ddev, dma, length,
 					DMA_FROM_DEVICE);
 		skb_copy_to_linear_data(skb, va, length);
 		skb->tail += length;
 	} else {
-#ifdef HAVE_ETH_GET_HEADLEN
-		unsigned int pull_len;
-#endif
-
 		/* Move relevant fragments to skb */
 		used_frags = mlx4_en_complete_rx_desc(priv, rx_desc, frags,
 						      skb_shinfo(skb)->frags,
@@ -693,8 +879,6 @@ static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
 		}
 		skb_shinfo(skb)->nr_frags = used_frags;
 
-#ifdef HAVE_ETH_GET_HEADLEN
-		pull_len = eth_get_headlen(va, SMALL_PACKET_SIZE);
 		/* Copy headers into the skb linear buffer */
 		memcpy(skb->data, va, pull_len);
 		skb->tail += pull_len;
@@ -705,17 +889,6 @@ static struct sk_buff *mlx4_en_rx_skb(struct mlx4_en_priv *priv,
 		/* Adjust size of first fragment */
 		skb_frag_size_sub(&skb_shinfo(skb)->frags[0], pull_len);
 		skb->data_len = length - pull_len;
-#else
-		memcpy(skb->data, va, HEADER_COPY_SIZE);
-		skb->tail += HEADER_COPY_SIZE;
-
-		/* Skip headers in first fragment */
-		skb_shinfo(skb)->frags[0].page_offset += HEADER_COPY_SIZE;
-
-		/* Adjust size of first fragment */
-		skb_frag_size_sub(&skb_shinfo(skb)->frags[0], HEADER_COPY_SIZE);
-		skb->data_len = length - HEADER_COPY_SIZE;
-#endif
 	}
 	return skb;
 }
@@ -945,7 +1118,9 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 		/* Check if we need to drop the packet if SRIOV is not enabled
 		 * and not performing the selftest or flb disabled
 		 */
-		if (priv->flags & MLX4_EN_FLAG_RX_FILTER_NEEDED) {
+		if ((priv->flags & (MLX4_EN_FLAG_RX_FILTER_NEEDED |
+				    MLX4_EN_FLAG_RX_FILTER_HW)) ==
+		    MLX4_EN_FLAG_RX_FILTER_NEEDED) {
 			struct ethhdr *ethh;
 			dma_addr_t dma;
 			/* Get pointer to first fragment since we haven't
@@ -957,7 +1132,11 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 			ethh = (struct ethhdr *)(page_address(frags[0].page) +
 						 frags[0].page_offset);
 
-			if (is_multicast_ether_addr(ethh->h_dest)) {
+			if (is_multicast_ether_addr(ethh->h_dest) &&
+			    test_bit(MLX4_EN_MAC_FILTER_IDX1(ethh->h_source),
+				     priv->mac_filter) &&
+			    test_bit(MLX4_EN_MAC_FILTER_IDX2(ethh->h_source),
+				     priv->mac_filter)) {
 				struct mlx4_mac_entry *entry;
 #ifndef HAVE_HLIST_FOR_EACH_ENTRY_3_PARAMS
 				struct hlist_node *hlnode;
@@ -973,6 +1152,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 					if (ether_addr_equal_64bits(entry->mac,
 								    ethh->h_source)) {
 						rcu_read_unlock();
+						ring->mc_loopback_dropped++;
 						goto next;
 					}
 				}
@@ -1141,7 +1321,12 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 		}
 
 		/* GRO not possible, complete processing here */
-		skb = mlx4_en_rx_skb(priv, rx_desc, frags, length);
+#ifdef HAVE_NETDEV_HW_ENC_FEATURES
+		skb = mlx4_en_rx_skb(priv, ring, rx_desc, frags, length,
+				     l2_tunnel);
+#else
+		skb = mlx4_en_rx_skb(priv, ring, rx_desc, frags, length, false);
+#endif
 		if (!skb) {
 			priv->stats.rx_dropped++;
 			goto next;
@@ -1227,7 +1412,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 
 next:
 		for (nr = 0; nr < priv->num_frags; nr++)
-			mlx4_en_free_frag(priv, frags, nr);
+			mlx4_en_free_frag(priv, ring, frags, nr);
 
 		++cq->mcq.cons_index;
 		index = (cq->mcq.cons_index) & ring->size_mask;
@@ -1285,6 +1470,9 @@ int mlx4_en_poll_rx_cq(struct napi_struct *napi, int budget)
 	mlx4_en_cq_unlock_napi(cq);
 #endif
 
+	mlx4_en_cq_moder_sample(priv, cq, priv->rx_ring[cq->ring]->packets,
+				priv->rx_ring[cq->ring]->bytes);
+
 	/* If we used up all the quota - we're probably not done yet... */
 #if !(defined(HAVE_IRQ_DESC_GET_IRQ_DATA) && defined(HAVE_IRQ_TO_DESC_EXPORTED))
 	cq->tot_rx += done;
@@ -1572,6 +1760,9 @@ int mlx4_en_config_rss_steer(struct mlx4_en_priv *priv)
 	if (err)
 		goto indir_err;
 
+	mlx4_en_update_mcast_lb_filter(priv,
+				       !!(priv->dev->features & NETIF_F_LOOPBACK));
+
 	return 0;
 
 indir_err:
@@ -577,6 +577,109 @@ static DEVICE_ATTR(loopback, S_IRUGO | S_IWUSR,
                   mlx4_en_show_loopback, mlx4_en_store_loopback);
 #endif
 
+/* Per-ring RX copybreak and header copy length. Reading lists one value
+ * per RX ring; writing "<value>" sets all rings and the default for rings
+ * created later, "<ring> <value>" sets a single ring until it is
+ * reallocated.
+ */
+static ssize_t mlx4_en_show_rx_copy(struct device *d, char *buf,
+				    bool hdr_copy)
+{
+	struct mlx4_en_priv *priv = to_en_priv(d);
+	int len = 0;
+	int i;
+
+	mutex_lock(&priv->mdev->state_lock);
+	for (i = 0; i < priv->rx_ring_num; i++)
+		len += sprintf(buf + len, "%u\n",
+			       hdr_copy ? priv->rx_ring[i]->hdr_copy :
+					  priv->rx_ring[i]->copybreak);
+	mutex_unlock(&priv->mdev->state_lock);
+
+	return len;
+}
+
+static ssize_t mlx4_en_store_rx_copy(struct device *d, const char *buf,
+				     size_t count, bool hdr_copy)
+{
+	struct mlx4_en_priv *priv = to_en_priv(d);
+	unsigned int ring, val;
+	int ret = count;
+	int i;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (sscanf(buf, "%u %u", &ring, &val) != 2) {
+		if (kstrtouint(buf, 0, &val))
+			return -EINVAL;
+		ring = UINT_MAX;
+	}
+
+	if (hdr_copy ? (val != MLX4_EN_HDR_COPY_AUTO &&
+			(val < ETH_HLEN || val > MLX4_EN_MAX_HDR_COPY)) :
+		       val > MLX4_EN_MAX_COPYBREAK)
+		return -EINVAL;
+
+	mutex_lock(&priv->mdev->state_lock);
+	if (ring == UINT_MAX) {
+		if (hdr_copy)
+			priv->rx_hdr_copy = val;
+		else
+			priv->rx_copybreak = val;
+		for (i = 0; i < priv->rx_ring_num; i++) {
+			if (hdr_copy)
+				priv->rx_ring[i]->hdr_copy = val;
+			else
+				priv->rx_ring[i]->copybreak = val;
+		}
+	} else if (ring < priv->rx_ring_num) {
+		if (hdr_copy)
+			priv->rx_ring[ring]->hdr_copy = val;
+		else
+			priv->rx_ring[ring]->copybreak = val;
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&priv->mdev->state_lock);
+
+	return ret;
+}
+
+static ssize_t mlx4_en_show_rx_copybreak(struct device *d,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	return mlx4_en_show_rx_copy(d, buf, false);
+}
+
+static ssize_t mlx4_en_store_rx_copybreak(struct device *d,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	return mlx4_en_store_rx_copy(d, buf, count, false);
+}
+
+static ssize_t mlx4_en_show_rx_hdr_copy(struct device *d,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return mlx4_en_show_rx_copy(d, buf, true);
+}
+
+static ssize_t mlx4_en_store_rx_hdr_copy(struct device *d,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	return mlx4_en_store_rx_copy(d, buf, count, true);
+}
+
+static DEVICE_ATTR(rx_copybreak, S_IRUGO | S_IWUSR,
+		   mlx4_en_show_rx_copybreak, mlx4_en_store_rx_copybreak);
+
+static DEVICE_ATTR(rx_hdr_copy, S_IRUGO | S_IWUSR,
+		   mlx4_en_show_rx_hdr_copy, mlx4_en_store_rx_hdr_copy);
+
 static struct attribute *mlx4_en_qos_attrs[] = {
 #ifdef CONFIG_SYSFS_MAXRATE
 	&dev_attr_maxrate.attr,
@@ -598,6 +701,8 @@ static struct attribute *mlx4_en_qos_attrs[] = {
 	&dev_attr_qcn.attr,
 	&dev_attr_qcn_stats.attr,
 #endif
+	&dev_attr_rx_copybreak.attr,
+	&dev_attr_rx_hdr_copy.attr,
 	NULL,
 };
 
@@ -118,14 +118,6 @@ int mlx4_en_create_tx_ring(struct mlx4_en_priv *priv,
 	en_dbg(DRV, priv, "Allocated tx_info ring at addr:%p size:%d\n",
 		 ring->tx_info, tmp);
 
-	ring->bounce_buf = kmalloc_node(MAX_DESC_SIZE, GFP_KERNEL, node);
-	if (!ring->bounce_buf) {
-		ring->bounce_buf = kmalloc(MAX_DESC_SIZE, GFP_KERNEL);
-		if (!ring->bounce_buf) {
-			err = -ENOMEM;
-			goto err_info;
-		}
-	}
 	ring->buf_size = ALIGN(size * ring->stride, MLX4_EN_PAGE_SIZE);
 
 	/* Allocate HW buffers on provided NUMA node */
@@ -135,7 +127,7 @@ int mlx4_en_create_tx_ring(struct mlx4_en_priv *priv,
 	set_dev_node(&mdev->dev->persist->pdev->dev, mdev->dev->numa_node);
 	if (err) {
 		en_err(priv, "Failed allocating hwq resources\n");
-		goto err_bounce;
+		goto err_info;
 	}
 
 	err = mlx4_en_map_buffer(&ring->wqres.buf);
@@ -193,9 +185,6 @@ err_map:
 	mlx4_en_unmap_buffer(&ring->wqres.buf);
 err_hwq_res:
 	mlx4_free_hwq_res(mdev->dev, &ring->wqres, ring->buf_size);
-err_bounce:
-	kfree(ring->bounce_buf);
-	ring->bounce_buf = NULL;
 err_info:
 	kvfree(ring->tx_info);
 	ring->tx_info = NULL;
@@ -219,8 +208,6 @@ void mlx4_en_destroy_tx_ring(struct mlx4_en_priv *priv,
 	mlx4_qp_release_range(priv->mdev->dev, ring->qpn, 1);
 	mlx4_en_unmap_buffer(&ring->wqres.buf);
 	mlx4_free_hwq_res(mdev->dev, &ring->wqres, ring->buf_size);
-	kfree(ring->bounce_buf);
-	ring->bounce_buf = NULL;
 	kvfree(ring->tx_info);
 	ring->tx_info = NULL;
 	kfree(ring);
@@ -242,6 +229,12 @@ int mlx4_en_activate_tx_ring(struct mlx4_en_priv *priv,
 	ring->prod = 0;
 	ring->cons = 0xffffffff;
 	ring->last_nr_txbb = 1;
+	ring->inline_thold = priv->prof->inline_thold;
+	ring->bf_active = ring->bf_enabled;
+	ring->policy_budget = MLX4_EN_TX_POLICY_WINDOW;
+	ring->policy_sends = ring->tx_bf + ring->tx_doorbell + ring->xmit_more;
+	ring->policy_doorbells = ring->tx_bf + ring->tx_doorbell;
+	ring->policy_bytes = ring->bytes;
 	memset(ring->tx_info, 0, ring->size * sizeof(struct mlx4_en_tx_info));
 	memset(ring->buf, 0, ring->buf_size);
 
@@ -284,53 +277,64 @@ void mlx4_en_deactivate_tx_ring(struct mlx4_en_priv *priv,
 }
 
 #ifndef CONFIG_INFINIBAND_WQE_FORMAT
-static void mlx4_en_stamp_wqe(struct mlx4_en_priv *priv,
-			      struct mlx4_en_tx_ring *ring, int index,
-			      u8 owner)
+/* Stamp the TXBBs [cons, cons + cnt) released by one completion poll in a
+ * single pass. The range crosses the ring end at most once, and the owner
+ * bit flips there.
+ */
+static void mlx4_en_stamp_range(struct mlx4_en_tx_ring *ring, u32 cons,
+				u32 cnt)
 {
-	__be32 stamp = cpu_to_be32(STAMP_VAL | (!!owner << STAMP_SHIFT));
-	struct mlx4_en_tx_desc *tx_desc = ring->buf + index * TXBB_SIZE;
-	struct mlx4_en_tx_info *tx_info = &ring->tx_info[index];
-	void *end = ring->buf + ring->buf_size;
-	__be32 *ptr = (__be32 *)tx_desc;
-	int i;
-
-	/* Optimize the common case when there are no wraparounds */
-	if (likely((void *)tx_desc + tx_info->nr_txbb * TXBB_SIZE <= end)) {
-		/* Stamp the freed descriptor */
-		for (i = 0; i < tx_info->nr_txbb * TXBB_SIZE;
-		     i += STAMP_STRIDE) {
-			*ptr = stamp;
-			ptr += STAMP_DWORDS;
-		}
-	} else {
-		/* Stamp the freed descriptor */
-		for (i = 0; i < tx_info->nr_txbb * TXBB_SIZE;
-		     i += STAMP_STRIDE) {
+	while (cnt) {
+		u32 index = cons & ring->size_mask;
+		u32 n = min_t(u32, cnt, ring->size - index);
+		__be32 stamp = cpu_to_be32(STAMP_VAL |
+					   (!!(cons & ring->size) << STAMP_SHIFT));
+		__be32 *ptr = ring->buf + index * TXBB_SIZE;
+		__be32 *end = ptr + n * (TXBB_SIZE / 4);
+
+		for (; ptr < end; ptr += STAMP_DWORDS)
 			*ptr = stamp;
-			ptr += STAMP_DWORDS;
-			if ((void *)ptr >= end) {
-				ptr = ring->buf;
-				stamp ^= cpu_to_be32(0x80000000);
-			}
-		}
+
+		cons += n;
+		cnt -= n;
 	}
 }
 #endif
 
+static inline void mlx4_en_consume_skb(struct sk_buff *skb)
+{
+#ifdef HAVE_DEV_CONSUME_SKB_ANY
+	dev_consume_skb_any(skb);
+#else
+	dev_kfree_skb_any(skb);
+#endif
+}
+
+static void mlx4_en_tx_bulk_flush(struct mlx4_en_tx_bulk *bulk)
+{
+	int i;
+
+	for (i = 0; i < bulk->nr; i++)
+		mlx4_en_consume_skb(bulk->skbs[i]);
+	bulk->nr = 0;
+}
 
 static u32 mlx4_en_free_tx_desc(struct mlx4_en_priv *priv,
 				struct mlx4_en_tx_ring *ring,
-				int index, u8 owner, u64 timestamp)
+				int index, u8 owner, u64 timestamp,
+				struct mlx4_en_tx_bulk *bulk)
 {
 	struct mlx4_en_tx_info *tx_info = &ring->tx_info[index];
 	struct mlx4_en_tx_desc *tx_desc = ring->buf + index * TXBB_SIZE;
 	struct mlx4_wqe_data_seg *data = (void *) tx_desc + tx_info->data_offset;
-	void *end = ring->buf + ring->buf_size;
 	struct sk_buff *skb = tx_info->skb;
 	int nr_maps = tx_info->nr_maps;
 	int i;
 
+	/* ring edge padding NOP */
+	if (unlikely(!skb))
+		return tx_info->nr_txbb;
+
 	/* We do not touch skb here, so prefetch skb->users location
 	 * to speedup consume_skb()
 	 */
@@ -343,60 +347,34 @@ static u32 mlx4_en_free_tx_desc(struct mlx4_en_priv *priv,
 		skb_tstamp_tx(skb, &hwts);
 	}
 
-	/* Optimize the common case when there are no wraparounds */
-	if (likely((void *) tx_desc + tx_info->nr_txbb * TXBB_SIZE <= end)) {
-		if (!tx_info->inl) {
-			if (tx_info->linear)
-				dma_unmap_single(priv->ddev,
-						tx_info->map0_dma,
-						tx_info->map0_byte_count,
-						PCI_DMA_TODEVICE);
-			else
-				dma_unmap_page(priv->ddev,
-					       tx_info->map0_dma,
-					       tx_info->map0_byte_count,
-					       PCI_DMA_TODEVICE);
-			for (i = 1; i < nr_maps; i++) {
-				data++;
-				dma_unmap_page(priv->ddev,
-					(dma_addr_t)be64_to_cpu(data->addr),
-					be32_to_cpu(data->byte_count),
-					PCI_DMA_TODEVICE);
-			}
+	if (!tx_info->inl) {
+		if (tx_info->linear)
+			dma_unmap_single(priv->ddev,
+					 tx_info->map0_dma,
+					 tx_info->map0_byte_count,
+					 PCI_DMA_TODEVICE);
+		else
+			dma_unmap_page(priv->ddev,
+				       tx_info->map0_dma,
+				       tx_info->map0_byte_count,
+				       PCI_DMA_TODEVICE);
+		for (i = 1; i < nr_maps; i++) {
+			data++;
+			dma_unmap_page(priv->ddev,
+				(dma_addr_t)be64_to_cpu(data->addr),
+				be32_to_cpu(data->byte_count),
+				PCI_DMA_TODEVICE);
 		}
-	} else {
-		if (!tx_info->inl) {
-			if ((void *) data >= end) {
-				data = ring->buf + ((void *)data - end);
-			}
+	}
 
-			if (tx_info->linear)
-				dma_unmap_single(priv->ddev,
-						tx_info->map0_dma,
-						tx_info->map0_byte_count,
-						PCI_DMA_TODEVICE);
-			else
-				dma_unmap_page(priv->ddev,
-					       tx_info->map0_dma,
-					       tx_info->map0_byte_count,
-					       PCI_DMA_TODEVICE);
-			for (i = 1; i < nr_maps; i++) {
-				data++;
-				/* Check for wraparound before unmapping */
-				if ((void *) data >= end)
-					data = ring->buf;
-				dma_unmap_page(priv->ddev,
-					(dma_addr_t)be64_to_cpu(data->addr),
-					be32_to_cpu(data->byte_count),
-					PCI_DMA_TODEVICE);
-			}
-		}
+	/* Completion path releases skbs once the ring consumer is updated */
+	if (bulk) {
+		if (unlikely(bulk->nr == MLX4_EN_TX_BULK_SKBS))
+			mlx4_en_tx_bulk_flush(bulk);
+		bulk->skbs[bulk->nr++] = skb;
+	} else {
+		mlx4_en_consume_skb(skb);
 	}
-#ifdef HAVE_DEV_CONSUME_SKB_ANY
-	dev_consume_skb_any(skb);
-#else
-	dev_kfree_skb_any(skb);
-#endif
 	return tx_info->nr_txbb;
 }
 
@@ -420,7 +398,8 @@ int mlx4_en_free_tx_buf(struct net_device *dev, struct mlx4_en_tx_ring *ring)
 	while (ring->cons != ring->prod) {
 		ring->last_nr_txbb = mlx4_en_free_tx_desc(priv, ring,
 						ring->cons & ring->size_mask,
-						!!(ring->cons & ring->size), 0);
+						!!(ring->cons & ring->size), 0,
+						NULL);
 		ring->cons += ring->last_nr_txbb;
 		cnt++;
 	}
@@ -440,11 +419,9 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 	struct mlx4_en_tx_ring *ring = priv->tx_ring[cq->ring];
 	struct mlx4_cqe *cqe;
 	u16 index;
-	u16 new_index, ring_index, stamp_index;
+	u16 new_index, ring_index;
 	u32 txbbs_skipped = 0;
-#ifndef CONFIG_INFINIBAND_WQE_FORMAT
-	u32 txbbs_stamp = 0;
-#endif
+	struct mlx4_en_tx_bulk bulk;
 	u32 cons_index = mcq->cons_index;
 	int size = cq->size;
 	u32 size_mask = ring->size_mask;
@@ -457,10 +434,15 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 	int budget = priv->tx_work_limit;
 	u32 last_nr_txbb;
 	u32 ring_cons;
+#ifdef MLX4_EN_PERF_STAT
+	cycles_t start = get_cycles();
+#endif
 
 	if (!priv->port_up)
 		return true;
 
+	bulk.nr = 0;
+
 #ifdef HAVE_NETDEV_TXQ_BQL_PREFETCHW
 	netdev_txq_bql_complete_prefetchw(ring->tx_queue);
 #else
@@ -474,7 +456,6 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 	last_nr_txbb = ACCESS_ONCE(ring->last_nr_txbb);
 	ring_cons = ACCESS_ONCE(ring->cons);
 	ring_index = ring_cons & size_mask;
-	stamp_index = ring_index;
 
 	/* Process all completed CQEs */
 	while (XNOR(cqe->owner_sr_opcode & MLX4_CQE_OWNER_MASK,
@@ -507,16 +488,8 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 			last_nr_txbb = mlx4_en_free_tx_desc(
 					priv, ring, ring_index,
 					!!((ring_cons + txbbs_skipped) &
-					ring->size), timestamp);
-
-#ifndef CONFIG_INFINIBAND_WQE_FORMAT
-			mlx4_en_stamp_wqe(priv, ring, stamp_index,
-					  !!((ring_cons + txbbs_stamp) &
-						ring->size));
-			stamp_index = ring_index;
-			txbbs_stamp = txbbs_skipped;
-#endif
-			packets++;
+					ring->size), timestamp, &bulk);
+			packets += !!ring->tx_info[ring_index].skb;
 			bytes += ring->tx_info[ring_index].nr_bytes;
 		} while ((++done < budget) && (ring_index != new_index));
 
@@ -532,6 +505,13 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 	 */
 	mcq->cons_index = cons_index;
 	mlx4_cq_set_ci(mcq);
+
+#ifndef CONFIG_INFINIBAND_WQE_FORMAT
+	/* Stamp every freed descriptor but the last polled one, which
+	 * stays owned until the next poll skips over it.
+	 */
+	mlx4_en_stamp_range(ring, ring_cons, txbbs_skipped);
+#endif
 	wmb();
 
 	/* we want to dirty this cache line once */
@@ -546,10 +526,20 @@ static bool mlx4_en_process_tx_cq(struct net_device *dev, struct mlx4_en_cq *cq)
 	 */
 	if (netif_tx_queue_stopped(ring->tx_queue) &&
 	    (ring->prod - ring->cons) <=
-	    (ring->size - HEADROOM - MAX_DESC_TXBBS)) {
+	    (ring->size - HEADROOM - MAX_XMIT_TXBBS)) {
 		netif_tx_wake_queue(ring->tx_queue);
 		ring->wake_queue++;
 	}
+
+	mlx4_en_tx_bulk_flush(&bulk);
+
+#ifdef MLX4_EN_PERF_STAT
+	if (packets) {
+		AVG_PERF_COUNTER(priv->pstats.tx_batch_avg, packets);
+		AVG_PERF_COUNTER(priv->pstats.tx_cycles_avg,
+				 div_u64(get_cycles() - start, packets));
+	}
+#endif
 	return done < budget;
 }
 
@@ -577,6 +567,8 @@ int mlx4_en_poll_tx_cq(struct napi_struct *napi, int budget)
 	int clean_complete;
 
 	clean_complete = mlx4_en_process_tx_cq(dev, cq);
+	mlx4_en_cq_moder_sample(priv, cq, priv->tx_ring[cq->ring]->packets,
+				priv->tx_ring[cq->ring]->bytes);
 	if (!clean_complete)
 		return budget;
 
@@ -586,44 +578,41 @@ int mlx4_en_poll_tx_cq(struct napi_struct *napi, int budget)
 	return 0;
 }
 
-static struct mlx4_en_tx_desc *mlx4_en_bounce_to_desc(struct mlx4_en_priv *priv,
-						      struct mlx4_en_tx_ring *ring,
-						      u32 index,
-						      unsigned int desc_size)
+/* Fill the TXBBs left before the end of the ring with a single
+ * unsignaled NOP, so the next descriptor starts at index 0 and is never
+ * built or unmapped in two pieces.
+ */
+static void mlx4_en_pad_ring_edge(struct mlx4_en_tx_ring *ring, u32 index,
+				  __be32 owner_bit)
 {
-	u32 copy = (ring->size - index) * TXBB_SIZE;
-	int i;
+	struct mlx4_en_tx_desc *tx_desc = ring->buf + index * TXBB_SIZE;
+	struct mlx4_en_tx_info *tx_info = &ring->tx_info[index];
+	u32 nr_txbb = ring->size - index;
 #ifdef CONFIG_INFINIBAND_WQE_FORMAT
-	__be32 owner_bit = (ring->prod & ring->size) ?
-			   cpu_to_be32(MLX4_EN_BIT_DESC_OWN) : 0;
-#endif
+	u32 i;
 
-	for (i = desc_size - copy - 4; i >= 0; i -= 4) {
-		if ((i & (TXBB_SIZE - 1)) == 0) {
-			wmb();
-#ifdef CONFIG_INFINIBAND_WQE_FORMAT
-			*((u32 *) (ring->buf + i)) =
-				(*((u32 *) (ring->bounce_buf + copy + i)) &
-				 WQE_FORMAT_1_MASK) |
-				  owner_bit;
-			continue;
+	for (i = 1; i < nr_txbb; i++)
+		*((__be32 *)(ring->buf + (index + i) * TXBB_SIZE)) = owner_bit;
 #endif
-		}
 
-		*((u32 *) (ring->buf + i)) =
-			*((u32 *) (ring->bounce_buf + copy + i));
-	}
+	tx_info->skb = NULL;
+	tx_info->nr_txbb = nr_txbb;
+	tx_info->nr_bytes = 0;
+	tx_info->nr_maps = 0;
+	tx_info->inl = 1;
+	tx_info->ts_requested = 0;
 
-	for (i = copy - 4; i >= 4; i -= 4) {
-		if ((i & (TXBB_SIZE - 1)) == 0)
-			wmb();
+	tx_desc->ctrl.vlan_tag = 0;
+	tx_desc->ctrl.ins_vlan = 0;
+	tx_desc->ctrl.fence_size = (nr_txbb * TXBB_SIZE / DS_SIZE) & 0x3f;
+	tx_desc->ctrl.srcrb_flags = 0;
 
-		*((u32 *) (ring->buf + index * TXBB_SIZE + i)) =
-			*((u32 *) (ring->bounce_buf + i));
-	}
+	/* Ensure the NOP hits memory before setting its ownership to HW */
+	wmb();
+	tx_desc->ctrl.owner_opcode = cpu_to_be32(MLX4_OPCODE_NOP) | owner_bit;
 
-	/* Return real descriptor location */
-	return ring->buf + index * TXBB_SIZE;
+	ring->prod += nr_txbb;
+	ring->tx_edge_pad++;
 }
 
 /* Decide if skb can be inlined in tx descriptor to avoid dma mapping
@@ -667,8 +656,9 @@ static int inline_size(const struct sk_buff *skb)
 
 static int get_real_size(const struct sk_buff *skb,
 			 const struct skb_shared_info *shinfo,
-			 struct net_device *dev, int *lso_header_size,
-			 bool *inline_ok, void **pfrag)
+			 struct net_device *dev,
+			 const struct mlx4_en_tx_ring *ring,
+			 int *lso_header_size, bool *inline_ok, void **pfrag)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
 	int real_size;
@@ -697,7 +687,7 @@ static int get_real_size(const struct sk_buff *skb,
 		}
 	} else {
 		*lso_header_size = 0;
-		*inline_ok = is_inline(priv->prof->inline_thold, skb,
+		*inline_ok = is_inline(ring->inline_thold, skb,
 				       shinfo, pfrag);
 
 		if (*inline_ok)
@@ -809,6 +799,42 @@ static void mlx4_bf_copy(void __iomem *dst, const void *src,
 	__iowrite64_copy(dst, src, bytecnt / 8);
 }
 
+/* Re-evaluate the ring's inline and BlueFlame choice once per
+ * MLX4_EN_TX_POLICY_WINDOW sends. When the stack batches with xmit_more,
+ * one doorbell covers several descriptors: BlueFlame then only adds MMIO
+ * write-combining cost, and compact descriptors let the HW fetch more of
+ * them per read, so inlining is limited to inline_bulk_thold (never
+ * above inline_thold) unless the traffic is mostly that small anyway.
+ * The default of 44 bytes is what inline_size() fits in the first TXBB,
+ * so only runt frames stay inline; raising it keeps small packets inline
+ * at the cost of two-TXBB descriptors.
+ */
+static void mlx4_en_tx_policy(struct mlx4_en_priv *priv,
+			      struct mlx4_en_tx_ring *ring)
+{
+	unsigned long doorbells = ring->tx_bf + ring->tx_doorbell;
+	unsigned long sends = doorbells + ring->xmit_more;
+	unsigned long win_sends = sends - ring->policy_sends;
+	unsigned long win_doorbells = doorbells - ring->policy_doorbells;
+	unsigned long avg_size;
+	int thold = priv->prof->inline_thold;
+	int bulk_thold = min(thold, priv->prof->inline_bulk_thold);
+	bool bulk;
+
+	avg_size = win_sends ? (ring->bytes - ring->policy_bytes) / win_sends : 0;
+	bulk = win_sends >= win_doorbells * MLX4_EN_TX_BULK_BATCH;
+
+	if (bulk && avg_size > bulk_thold)
+		thold = bulk_thold;
+	ring->inline_thold = thold;
+	ring->bf_active = ring->bf_enabled && !bulk;
+
+	ring->policy_sends = sends;
+	ring->policy_doorbells = doorbells;
+	ring->policy_bytes = ring->bytes;
+	ring->policy_budget = MLX4_EN_TX_POLICY_WINDOW;
+}
+
 netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct skb_shared_info *shinfo = skb_shinfo(skb);
@@ -831,7 +857,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 	int i_frag;
 	int lso_header_size;
 	void *fragptr = NULL;
-	bool bounce = false;
+	bool padded = false;
 	bool send_doorbell;
 	bool stop_queue;
 	bool inline_ok;
@@ -850,7 +876,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 	/* fetch ring->cons far ahead before needing it to avoid stall */
 	ring_cons = ACCESS_ONCE(ring->cons);
 
-	real_size = get_real_size(skb, shinfo, dev, &lso_header_size,
+	real_size = get_real_size(skb, shinfo, dev, ring, &lso_header_size,
 				  &inline_ok, &fragptr);
 	if (unlikely(!real_size))
 		goto tx_drop;
@@ -887,14 +913,18 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 	index = ring->prod & ring->size_mask;
 	bf_index = ring->prod;
 
-	/* See if we have enough space for whole descriptor TXBB for setting
-	 * SW ownership on next descriptor; if not, use a bounce buffer. */
-	if (likely(index + nr_txbb <= ring->size)) {
-		tx_desc = ring->buf + index * TXBB_SIZE;
-	} else {
-		tx_desc = (struct mlx4_en_tx_desc *) ring->bounce_buf;
-		bounce = true;
+	/* The descriptor must not cross the end of the ring; if it would,
+	 * pad the ring edge with a NOP and start over at index 0.
+	 */
+	if (unlikely(index + nr_txbb > ring->size)) {
+		mlx4_en_pad_ring_edge(ring, index, owner_bit);
+		padded = true;
+		index = 0;
+		bf_index = ring->prod;
+		owner_bit = (ring->prod & ring->size) ?
+			cpu_to_be32(MLX4_EN_BIT_DESC_OWN) : 0;
 	}
+	tx_desc = ring->buf + index * TXBB_SIZE;
 
 	/* Save skb in tx_info ring */
 	tx_info = &ring->tx_info[index];
@@ -1035,9 +1065,11 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 	ring->bytes += tx_info->nr_bytes;
 	netdev_tx_sent_queue(ring->tx_queue, tx_info->nr_bytes);
 	AVG_PERF_COUNTER(priv->pstats.tx_pktsz_avg, skb->len);
-	if (tx_info->inl)
+	if (tx_info->inl) {
 		build_inline_wqe(tx_desc, skb, shinfo, real_size, &vlan_tag,
 				 tx_ind, fragptr, owner_bit);
+		ring->tx_inline++;
+	}
 
 #ifdef HAVE_SKB_INNER_NETWORK_HEADER
 	if (skb->encapsulation) {
@@ -1053,15 +1085,11 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	ring->prod += nr_txbb;
 
-	/* If we used a bounce buffer then copy descriptor back into place */
-	if (unlikely(bounce))
-		tx_desc = mlx4_en_bounce_to_desc(priv, ring, index, desc_size);
-
 	skb_tx_timestamp(skb);
 
 	/* Check available TXBBs And 2K spare for prefetch */
 	stop_queue = (int)(ring->prod - ring_cons) >
-		      ring->size - HEADROOM - MAX_DESC_TXBBS;
+		      ring->size - HEADROOM - MAX_XMIT_TXBBS;
 	if (unlikely(stop_queue)) {
 		netif_tx_stop_queue(ring->tx_queue);
 		ring->queue_stopped++;
@@ -1074,7 +1102,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	real_size = (real_size / 16) & 0x3f;
 
-	if (ring->bf_enabled && desc_size <= MAX_BF && !bounce &&
+	if (ring->bf_active && desc_size <= MAX_BF && !padded &&
 	    !skb_vlan_tag_present(skb) && send_doorbell) {
 		tx_desc->ctrl.bf_qpn = ring->doorbell_qpn |
 				       cpu_to_be32(real_size);
@@ -1094,6 +1122,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		wmb();
 
 		ring->bf.offset ^= ring->bf.buf_size;
+		ring->tx_bf++;
 	} else {
 		tx_desc->ctrl.vlan_tag = cpu_to_be16(vlan_tag);
 #ifdef HAVE_NETIF_F_HW_VLAN_STAG_RX
@@ -1126,6 +1155,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 #endif
 				  ring->doorbell_qpn,
 				  ring->bf.uar->map + MLX4_SEND_DOORBELL);
+			ring->tx_doorbell++;
 #ifdef HAVE_SK_BUFF_XMIT_MORE
 		} else {
 			ring->xmit_more++;
@@ -1133,6 +1163,9 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		}
 	}
 
+	if (unlikely(!--ring->policy_budget))
+		mlx4_en_tx_policy(priv, ring);
+
 	if (unlikely(stop_queue)) {
 		/* If queue was emptied after the if (stop_queue) , and before
 		 * the netif_tx_stop_queue() - need to wake the queue,
@@ -1144,7 +1177,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 
 		ring_cons = ACCESS_ONCE(ring->cons);
 		if (unlikely(((int)(ring->prod - ring_cons)) <=
-			     ring->size - HEADROOM - MAX_DESC_TXBBS)) {
+			     ring->size - HEADROOM - MAX_XMIT_TXBBS)) {
 			netif_tx_wake_queue(ring->tx_queue);
 			ring->wake_queue++;
 		}
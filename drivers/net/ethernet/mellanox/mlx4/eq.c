@@ -38,6 +38,8 @@
 #include <linux/mm.h>
 #include <linux/dma-mapping.h>
 #include <linux/printk.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 
 #include <linux/mlx4/cmd.h>
 #include <linux/cpu_rmap.h>
@@ -49,6 +51,10 @@ enum {
 	MLX4_IRQNAME_SIZE	= 32
 };
 
+static int eq_budget;
+module_param(eq_budget, int, 0644);
+MODULE_PARM_DESC(eq_budget, "Max EQEs handled per MSI-X interrupt before deferring the rest to a tasklet (0 = unlimited)");
+
 enum {
 	MLX4_NUM_ASYNC_EQE	= 0x100,
 	MLX4_NUM_SPARE_EQE	= 0x80,
@@ -461,6 +467,9 @@ void mlx4_master_handle_slave_flr(struct work_struct *work)
 			mlx4_dbg(dev, "mlx4_handle_slave_flr: "
 				 "clean slave: %d\n", i);
 
+			/* let a command the slave posted before the FLR finish */
+			flush_work(&priv->mfunc.master.slave_comm[i].work);
+
 			/* In case of 'Reset flow' FLR can be generated for
 			 * a slave before mlx4_load_one is done.
 			 * make sure interface is up before trying to delete
@@ -483,7 +492,8 @@ void mlx4_master_handle_slave_flr(struct work_struct *work)
 	}
 }
 
-static int mlx4_eq_int(struct mlx4_dev *dev, struct mlx4_eq *eq)
+static int mlx4_eq_int(struct mlx4_dev *dev, struct mlx4_eq *eq, int budget,
+		       bool *done)
 {
 	struct mlx4_priv *priv = mlx4_priv(dev);
 	struct mlx4_eqe *eqe;
@@ -503,7 +513,14 @@ static int mlx4_eq_int(struct mlx4_dev *dev, struct mlx4_eq *eq)
 #endif
 	int eqe_size = dev->caps.eqe_size;
 
-	while ((eqe = next_eqe_sw(eq, dev->caps.eqe_factor, eqe_size))) {
+	*done = false;
+	while (budget <= 0 || eqes_found < budget) {
+		eqe = next_eqe_sw(eq, dev->caps.eqe_factor, eqe_size);
+		if (!eqe) {
+			*done = true;
+			break;
+		}
+
 		/*
 		 * Make sure we read EQ entry contents after we've
 		 * checked the ownership bit.
@@ -838,7 +855,7 @@ static int mlx4_eq_int(struct mlx4_dev *dev, struct mlx4_eq *eq)
 		};
 
 		++eq->cons_index;
-		eqes_found = 1;
+		++eqes_found;
 		++set_ci;
 
 		/*
@@ -854,7 +871,10 @@ static int mlx4_eq_int(struct mlx4_dev *dev, struct mlx4_eq *eq)
 		}
 	}
 
-	eq_set_ci(eq, 1);
+	/* Only re-arm the EQ once it has been drained; otherwise the poll
+	 * tasklet will pick up where we left off.
+	 */
+	eq_set_ci(eq, *done);
 
 	/* cqn is 24bit wide but is initialized such that its higher bits
 	 * are ones too. Thus, if we got any event, cqn's high bits should be off
@@ -871,22 +891,58 @@ static irqreturn_t mlx4_interrupt(int irq, void *dev_ptr)
 	struct mlx4_dev *dev = dev_ptr;
 	struct mlx4_priv *priv = mlx4_priv(dev);
 	int work = 0;
+	bool done;
 	int i;
 
 	writel(priv->eq_table.clr_mask, priv->eq_table.clr_int);
 
+	/* The legacy interrupt is shared by all EQs, so it is never budgeted */
 	for (i = 0; i < dev->caps.num_comp_vectors + 1; ++i)
-		work |= mlx4_eq_int(dev, &priv->eq_table.eq[i]);
+		work |= mlx4_eq_int(dev, &priv->eq_table.eq[i], 0, &done);
 
 	return IRQ_RETVAL(work);
 }
 
+static void mlx4_eq_poll_tasklet(unsigned long data)
+{
+	struct mlx4_eq *eq = (struct mlx4_eq *)data;
+	bool done;
+	int n;
+
+	/* The completion and event handlers expect to run from the hard
+	 * interrupt (e.g. napi_schedule_irqoff()), so keep IRQs off.
+	 */
+	local_irq_disable();
+	n = mlx4_eq_int(eq->dev, eq, eq_budget, &done);
+	local_irq_enable();
+
+	eq->stats.polls++;
+	eq->stats.eqes += n;
+	if (!done)
+		tasklet_schedule(&eq->poll_task);
+}
+
 static irqreturn_t mlx4_msi_x_interrupt(int irq, void *eq_ptr)
 {
 	struct mlx4_eq  *eq  = eq_ptr;
 	struct mlx4_dev *dev = eq->dev;
-
-	mlx4_eq_int(dev, eq);
+	ktime_t start = ktime_get();
+	bool done;
+	u64 delta;
+	int n;
+
+	n = mlx4_eq_int(dev, eq, eq_budget, &done);
+	if (!done)
+		tasklet_schedule(&eq->poll_task);
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	eq->stats.irqs++;
+	eq->stats.eqes += n;
+	eq->stats.irq_time_ns += delta;
+	if (n > eq->stats.max_eqes_per_irq)
+		eq->stats.max_eqes_per_irq = n;
+	if (delta > eq->stats.max_irq_time_ns)
+		eq->stats.max_irq_time_ns = delta;
 
 	/* MSI-X vectors always belong to us */
 	return IRQ_HANDLED;
@@ -1084,6 +1140,8 @@ static int mlx4_create_eq(struct mlx4_dev *dev, int nent,
 	spin_lock_init(&eq->tasklet_ctx.lock);
 	tasklet_init(&eq->tasklet_ctx.task, mlx4_cq_tasklet_cb,
 		     (unsigned long)&eq->tasklet_ctx);
+	tasklet_init(&eq->poll_task, mlx4_eq_poll_tasklet, (unsigned long)eq);
+	memset(&eq->stats, 0, sizeof(eq->stats));
 
 	return err;
 
@@ -1133,6 +1191,7 @@ static void mlx4_free_eq(struct mlx4_dev *dev,
 		mlx4_warn(dev, "HW2SW_EQ failed (%d)\n", err);
 
 	synchronize_irq(eq->irq);
+	tasklet_kill(&eq->poll_task);
 	tasklet_disable(&eq->tasklet_ctx.task);
 
 	mlx4_mtt_cleanup(dev, &eq->mtt);
@@ -1199,6 +1258,30 @@ int mlx4_alloc_eq_table(struct mlx4_dev *dev)
 	return 0;
 }
 
+static ssize_t show_eq_stats(struct device *d, struct device_attribute *attr,
+			     char *buf)
+{
+	struct mlx4_dev_persistent *persist = dev_get_drvdata(d);
+	struct mlx4_priv *priv = mlx4_priv(persist->dev);
+	struct mlx4_eq_stats *st;
+	ssize_t len = 0;
+	int i;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "eqn irqs polls eqes max_eqes_per_irq irq_time_ns max_irq_time_ns\n");
+	for (i = 0; i < persist->dev->caps.num_comp_vectors + 1; i++) {
+		st = &priv->eq_table.eq[i].stats;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%d %llu %llu %llu %u %llu %llu\n",
+				 priv->eq_table.eq[i].eqn, st->irqs, st->polls,
+				 st->eqes, st->max_eqes_per_irq,
+				 st->irq_time_ns, st->max_irq_time_ns);
+	}
+
+	return len;
+}
+static DEVICE_ATTR(eq_stats, S_IRUGO, show_eq_stats, NULL);
+
 void mlx4_free_eq_table(struct mlx4_dev *dev)
 {
 	kfree(mlx4_priv(dev)->eq_table.eq);
@@ -1334,6 +1417,9 @@ int mlx4_init_eq_table(struct mlx4_dev *dev)
 	/* arm ASYNC eq */
 	eq_set_ci(&priv->eq_table.eq[MLX4_EQ_ASYNC], 1);
 
+	if (device_create_file(&dev->persist->pdev->dev, &dev_attr_eq_stats))
+		mlx4_warn(dev, "Failed to create eq_stats sysfs file\n");
+
 	return 0;
 
 err_out_unmap:
@@ -1370,6 +1456,8 @@ void mlx4_cleanup_eq_table(struct mlx4_dev *dev)
 	struct mlx4_priv *priv = mlx4_priv(dev);
 	int i;
 
+	device_remove_file(&dev->persist->pdev->dev, &dev_attr_eq_stats);
+
 	mlx4_MAP_EQ(dev, get_async_ev_mask(dev), 1,
 		    priv->eq_table.eq[MLX4_EQ_ASYNC].eqn);
 
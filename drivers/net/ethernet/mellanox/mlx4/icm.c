@@ -35,6 +35,7 @@
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 #include <linux/mlx4/cmd.h>
 
@@ -145,7 +146,6 @@ struct mlx4_icm *mlx4_alloc_icm(struct mlx4_dev *dev, int npages,
 			return NULL;
 	}
 
-	icm->refcount = 0;
 	INIT_LIST_HEAD(&icm->chunk_list);
 
 	cur_order = get_order(MLX4_ICM_ALLOC_SIZE);
@@ -246,6 +246,54 @@ int mlx4_UNMAP_ICM_AUX(struct mlx4_dev *dev)
 			MLX4_CMD_TIME_CLASS_B, MLX4_CMD_NATIVE);
 }
 
+/*
+ * Fill the flat page arrays of a lowmem table for chunk i, so that
+ * mlx4_table_find() can index them directly instead of walking the
+ * chunk scatterlists.  DMA mapping can merge pages but not split them,
+ * so the DMA address of each page is derived from its mapped segment.
+ */
+static void mlx4_table_set_pages(struct mlx4_icm_table *table, u32 i)
+{
+	int pages_per_chunk = MLX4_TABLE_CHUNK_SIZE >> PAGE_SHIFT;
+	int base = i * pages_per_chunk;
+	struct mlx4_icm_chunk *chunk;
+	int virt_idx = 0;
+	int dma_idx = 0;
+	u32 off;
+	int j;
+
+	if (!table->page_virt)
+		return;
+
+	list_for_each_entry(chunk, &table->icm[i]->chunk_list, list) {
+		for (j = 0; j < chunk->npages; ++j)
+			for (off = 0; off < chunk->mem[j].length &&
+			     virt_idx < pages_per_chunk; off += PAGE_SIZE)
+				table->page_virt[base + virt_idx++] =
+					lowmem_page_address(sg_page(&chunk->mem[j])) +
+					off;
+
+		for (j = 0; j < chunk->nsg; ++j)
+			for (off = 0; off < sg_dma_len(&chunk->mem[j]) &&
+			     dma_idx < pages_per_chunk; off += PAGE_SIZE)
+				table->page_dma[base + dma_idx++] =
+					sg_dma_address(&chunk->mem[j]) + off;
+	}
+}
+
+static void mlx4_table_clear_pages(struct mlx4_icm_table *table, u32 i)
+{
+	int pages_per_chunk = MLX4_TABLE_CHUNK_SIZE >> PAGE_SHIFT;
+
+	if (!table->page_virt)
+		return;
+
+	memset(&table->page_virt[i * pages_per_chunk], 0,
+	       pages_per_chunk * sizeof(*table->page_virt));
+	memset(&table->page_dma[i * pages_per_chunk], 0,
+	       pages_per_chunk * sizeof(*table->page_dma));
+}
+
 int mlx4_table_get(struct mlx4_dev *dev, struct mlx4_icm_table *table, u32 obj,
 		   gfp_t gfp)
 {
@@ -253,12 +301,18 @@ int mlx4_table_get(struct mlx4_dev *dev, struct mlx4_icm_table *table, u32 obj,
 			(MLX4_TABLE_CHUNK_SIZE / table->obj_size);
 	int ret = 0;
 
+	/*
+	 * A non-zero count means the chunk is mapped and stays mapped
+	 * while we hold our reference; only the first user of a chunk
+	 * needs the mutex to allocate and map it.
+	 */
+	if (atomic_inc_not_zero(&table->refcount[i]))
+		return 0;
+
 	mutex_lock(&table->mutex);
 
-	if (table->icm[i]) {
-		++table->icm[i]->refcount;
+	if (atomic_inc_not_zero(&table->refcount[i]))
 		goto out;
-	}
 
 	table->icm[i] = mlx4_alloc_icm(dev, MLX4_TABLE_CHUNK_SIZE >> PAGE_SHIFT,
 				       (table->lowmem ? gfp : GFP_HIGHUSER) |
@@ -276,7 +330,11 @@ int mlx4_table_get(struct mlx4_dev *dev, struct mlx4_icm_table *table, u32 obj,
 		goto out;
 	}
 
-	++table->icm[i]->refcount;
+	mlx4_table_set_pages(table, i);
+
+	/* publish the chunk before lockless getters can see it */
+	smp_wmb();
+	atomic_set(&table->refcount[i], 1);
 
 out:
 	mutex_unlock(&table->mutex);
@@ -290,64 +348,46 @@ void mlx4_table_put(struct mlx4_dev *dev, struct mlx4_icm_table *table, u32 obj)
 
 	i = (obj & (table->num_obj - 1)) / (MLX4_TABLE_CHUNK_SIZE / table->obj_size);
 
-	mutex_lock(&table->mutex);
+	/* only the final put takes the mutex to unmap the chunk */
+	if (!atomic_dec_and_mutex_lock(&table->refcount[i], &table->mutex))
+		return;
 
-	if (--table->icm[i]->refcount == 0) {
-		offset = (u64) i * MLX4_TABLE_CHUNK_SIZE;
-		mlx4_UNMAP_ICM(dev, table->virt + offset,
-			       MLX4_TABLE_CHUNK_SIZE / MLX4_ICM_PAGE_SIZE);
-		mlx4_free_icm(dev, table->icm[i], table->coherent);
-		table->icm[i] = NULL;
-	}
+	offset = (u64) i * MLX4_TABLE_CHUNK_SIZE;
+	mlx4_UNMAP_ICM(dev, table->virt + offset,
+		       MLX4_TABLE_CHUNK_SIZE / MLX4_ICM_PAGE_SIZE);
+	mlx4_table_clear_pages(table, i);
+	mlx4_free_icm(dev, table->icm[i], table->coherent);
+	table->icm[i] = NULL;
 
 	mutex_unlock(&table->mutex);
 }
 
+/*
+ * The caller must hold a reference on obj (taken with mlx4_table_get),
+ * which keeps its page entries stable, so no lock is needed here.
+ */
 void *mlx4_table_find(struct mlx4_icm_table *table, u32 obj,
 			dma_addr_t *dma_handle)
 {
-	int offset, dma_offset, i;
 	u64 idx;
-	struct mlx4_icm_chunk *chunk;
-	struct mlx4_icm *icm;
-	struct page *page = NULL;
+	u32 offset;
+	void *virt;
 
-	if (!table->lowmem)
+	if (!table->lowmem || !table->page_virt)
 		return NULL;
 
-	mutex_lock(&table->mutex);
-
 	idx = (u64) (obj & (table->num_obj - 1)) * table->obj_size;
-	icm = table->icm[idx / MLX4_TABLE_CHUNK_SIZE];
-	dma_offset = offset = idx % MLX4_TABLE_CHUNK_SIZE;
+	offset = idx & ~PAGE_MASK;
+	idx >>= PAGE_SHIFT;
 
-	if (!icm)
-		goto out;
+	virt = table->page_virt[idx];
+	if (!virt)
+		return NULL;
 
-	list_for_each_entry(chunk, &icm->chunk_list, list) {
-		for (i = 0; i < chunk->npages; ++i) {
-			if (dma_handle && dma_offset >= 0) {
-				if (sg_dma_len(&chunk->mem[i]) > dma_offset)
-					*dma_handle = sg_dma_address(&chunk->mem[i]) +
-						dma_offset;
-				dma_offset -= sg_dma_len(&chunk->mem[i]);
-			}
-			/*
-			 * DMA mapping can merge pages but not split them,
-			 * so if we found the page, dma_handle has already
-			 * been assigned to.
-			 */
-			if (chunk->mem[i].length > offset) {
-				page = sg_page(&chunk->mem[i]);
-				goto out;
-			}
-			offset -= chunk->mem[i].length;
-		}
-	}
+	if (dma_handle)
+		*dma_handle = table->page_dma[idx] + offset;
 
-out:
-	mutex_unlock(&table->mutex);
-	return page ? lowmem_page_address(page) + offset : NULL;
+	return virt + offset;
 }
 
 int mlx4_table_get_range(struct mlx4_dev *dev, struct mlx4_icm_table *table,
@@ -392,6 +432,7 @@ int mlx4_init_icm_table(struct mlx4_dev *dev, struct mlx4_icm_table *table,
 	unsigned chunk_size;
 	int i;
 	u64 size;
+	u64 pages;
 
 	obj_per_chunk = MLX4_TABLE_CHUNK_SIZE / obj_size;
 	num_icm = (nobj + obj_per_chunk - 1) / obj_per_chunk;
@@ -399,6 +440,18 @@ int mlx4_init_icm_table(struct mlx4_dev *dev, struct mlx4_icm_table *table,
 	table->icm      = kcalloc(num_icm, sizeof *table->icm, GFP_KERNEL);
 	if (!table->icm)
 		return -ENOMEM;
+	table->refcount = kcalloc(num_icm, sizeof *table->refcount, GFP_KERNEL);
+	if (!table->refcount)
+		goto err_icm;
+	table->page_virt = NULL;
+	table->page_dma  = NULL;
+	if (use_lowmem) {
+		pages = (u64) num_icm * (MLX4_TABLE_CHUNK_SIZE >> PAGE_SHIFT);
+		table->page_virt = vzalloc(pages * sizeof *table->page_virt);
+		table->page_dma  = vzalloc(pages * sizeof *table->page_dma);
+		if (!table->page_virt || !table->page_dma)
+			goto err_pages;
+	}
 	table->virt     = virt;
 	table->num_icm  = num_icm;
 	table->num_obj  = nobj;
@@ -425,11 +478,13 @@ int mlx4_init_icm_table(struct mlx4_dev *dev, struct mlx4_icm_table *table,
 			goto err;
 		}
 
+		mlx4_table_set_pages(table, i);
+
 		/*
 		 * Add a reference to this ICM chunk so that it never
 		 * gets freed (since it contains reserved firmware objects).
 		 */
-		++table->icm[i]->refcount;
+		atomic_set(&table->refcount[i], 1);
 	}
 
 	return 0;
@@ -442,6 +497,11 @@ err:
 			mlx4_free_icm(dev, table->icm[i], use_coherent);
 		}
 
+err_pages:
+	vfree(table->page_dma);
+	vfree(table->page_virt);
+	kfree(table->refcount);
+err_icm:
 	kfree(table->icm);
 
 	return -ENOMEM;
@@ -458,5 +518,8 @@ void mlx4_cleanup_icm_table(struct mlx4_dev *dev, struct mlx4_icm_table *table)
 			mlx4_free_icm(dev, table->icm[i], table->coherent);
 		}
 
+	vfree(table->page_dma);
+	vfree(table->page_virt);
+	kfree(table->refcount);
 	kfree(table->icm);
 }
@@ -56,7 +56,6 @@ struct mlx4_icm_chunk {
 
 struct mlx4_icm {
 	struct list_head	chunk_list;
-	int			refcount;
 };
 
 struct mlx4_icm_iter {
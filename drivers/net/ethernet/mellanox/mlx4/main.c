@@ -42,6 +42,7 @@
 #include <linux/io-mapping.h>
 #include <linux/delay.h>
 #include <linux/kmod.h>
+#include <linux/sched.h>
 
 #include <linux/mlx4/device.h>
 #include <linux/mlx4/doorbell.h>
@@ -82,6 +83,10 @@ static int enable_sys_tune = 0;
 module_param(enable_sys_tune, int, 0444);
 MODULE_PARM_DESC(enable_sys_tune, "Tune the cpu's for better performance (default 0)");
 
+static bool fast_probe;
+module_param(fast_probe, bool, 0444);
+MODULE_PARM_DESC(fast_probe, "Probe devices asynchronously, so several HCAs initialize in parallel (default 0)");
+
 int mlx4_blck_lb = 1;
 module_param_named(block_loopback, mlx4_blck_lb, int, 0644);
 MODULE_PARM_DESC(block_loopback, "Block multicast loopback packets if > 0 "
@@ -4190,6 +4195,75 @@ static int mlx4_check_dev_cap(struct mlx4_dev *dev, struct mlx4_dev_cap *dev_cap
 	return 0;
 }
 
+static const char *const mlx4_probe_phase_str[] = {
+	[MLX4_PROBE_RESET]	= "reset",
+	[MLX4_PROBE_CMD]	= "cmd_init",
+	[MLX4_PROBE_FW]		= "fw_init",
+	[MLX4_PROBE_HCA]	= "hca_init",
+	[MLX4_PROBE_EQ]		= "eq_msix",
+	[MLX4_PROBE_SETUP]	= "hca_setup",
+	[MLX4_PROBE_PORTS]	= "port_init",
+	[MLX4_PROBE_REGISTER]	= "register",
+};
+
+/* Charge the time since the previous mark to @phase. Phases entered
+ * more than once (the slave_start retries) accumulate.
+ */
+static void mlx4_probe_mark(struct mlx4_priv *priv,
+			    enum mlx4_probe_phase phase)
+{
+	u64 now = local_clock();
+
+	priv->probe_ns[phase] += now - priv->probe_stamp;
+	priv->probe_stamp = now;
+}
+
+static ssize_t show_probe_timing(struct device *device,
+				 struct device_attribute *attr, char *buf)
+{
+	struct mlx4_priv *priv = container_of(attr, struct mlx4_priv,
+					      probe_attr);
+	u64 total = 0;
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < MLX4_PROBE_NUM_PHASES; i++) {
+		len += sprintf(buf + len, "%-10s %llu us\n",
+			       mlx4_probe_phase_str[i],
+			       div_u64(priv->probe_ns[i], NSEC_PER_USEC));
+		total += priv->probe_ns[i];
+	}
+	len += sprintf(buf + len, "%-10s %llu us\n", "total",
+		       div_u64(total, NSEC_PER_USEC));
+
+	return len;
+}
+
+static void mlx4_probe_report(struct mlx4_priv *priv)
+{
+	struct mlx4_dev *dev = &priv->dev;
+	u64 total = 0;
+	int i;
+
+	for (i = 0; i < MLX4_PROBE_NUM_PHASES; i++) {
+		mlx4_dbg(dev, "probe phase %s took %llu us\n",
+			 mlx4_probe_phase_str[i],
+			 div_u64(priv->probe_ns[i], NSEC_PER_USEC));
+		total += priv->probe_ns[i];
+	}
+	mlx4_info(dev, "Device initialized in %llu ms\n",
+		  div_u64(total, NSEC_PER_MSEC));
+
+	sysfs_attr_init(&priv->probe_attr.attr);
+	priv->probe_attr.attr.name = "probe_timing";
+	priv->probe_attr.attr.mode = S_IRUGO;
+	priv->probe_attr.show = show_probe_timing;
+	if (device_create_file(&dev->persist->pdev->dev, &priv->probe_attr)) {
+		mlx4_warn(dev, "Failed to create probe timing file\n");
+		priv->probe_attr.attr.name = NULL;
+	}
+}
+
 static int mlx4_load_one(struct pci_dev *pdev, int pci_dev_data,
 			 int total_vfs, int *nvfs, struct mlx4_priv *priv,
 			 int reset_flow)
@@ -4213,6 +4287,9 @@ static int mlx4_load_one(struct pci_dev *pdev, int pci_dev_data,
 
 	dev = &priv->dev;
 
+	memset(priv->probe_ns, 0, sizeof(priv->probe_ns));
+	priv->probe_stamp = local_clock();
+
 	INIT_LIST_HEAD(&priv->dev_list);
 	INIT_LIST_HEAD(&priv->ctx_list);
 	spin_lock_init(&priv->ctx_lock);
@@ -4263,6 +4340,7 @@ static int mlx4_load_one(struct pci_dev *pdev, int pci_dev_data,
 			mlx4_err(dev, "Failed to reset HCA, aborting\n");
 			goto err_sriov;
 		}
+		mlx4_probe_mark(priv, MLX4_PROBE_RESET);
 
 		if (total_vfs) {
 			dev->flags = MLX4_FLAG_MASTER;
@@ -4284,6 +4362,7 @@ slave_start:
 		mlx4_err(dev, "Failed to init command interface, aborting\n");
 		goto err_sriov;
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_CMD);
 
 	/* In slave functions, the communication channel must be initialized
 	 * before posting commands. Also, init num_slaves before calling
@@ -4307,6 +4386,7 @@ slave_start:
 		mlx4_err(dev, "Failed to init fw, aborting.\n");
 		goto err_mfunc;
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_FW);
 
 	if (mlx4_is_master(dev)) {
 		/* when we hit the goto slave_start below, dev_cap already initialized */
@@ -4385,6 +4465,7 @@ slave_start:
 		} else
 			goto err_fw;
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_HCA);
 
 	if (mlx4_is_master(dev) && (dev_cap->flags2 & MLX4_DEV_CAP_FLAG2_SYS_EQS)) {
 		u64 dev_flags = mlx4_enable_sriov(dev, pdev, total_vfs,
@@ -4464,6 +4545,7 @@ slave_start:
 			goto err_close;
 		}
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_HCA);
 
 	err = mlx4_alloc_eq_table(dev);
 	if (err)
@@ -4479,6 +4561,7 @@ slave_start:
 		mlx4_err(dev, "INTx is not supported in multi-function mode, aborting\n");
 		goto err_free_eq;
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_EQ);
 
 	if (!mlx4_is_slave(dev)) {
 		err = mlx4_init_steering(dev);
@@ -4510,12 +4593,14 @@ slave_start:
 			goto err_steer;
 		}
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_SETUP);
 
 	for (port = 1; port <= dev->caps.num_ports; port++) {
 		err = mlx4_init_port_info(dev, port);
 		if (err)
 			goto err_port;
 	}
+	mlx4_probe_mark(priv, MLX4_PROBE_PORTS);
 
 	priv->v2p.port1 = 1;
 	priv->v2p.port2 = 2;
@@ -4523,6 +4608,8 @@ slave_start:
 	err = mlx4_register_device(dev);
 	if (err)
 		goto err_port;
+	mlx4_probe_mark(priv, MLX4_PROBE_REGISTER);
+	mlx4_probe_report(priv);
 
 	mlx4_request_modules(dev);
 
@@ -4836,6 +4923,8 @@ static void mlx4_unload_one(struct pci_dev *pdev)
 
 	pci_dev_data = priv->pci_dev_data;
 
+	if (priv->probe_attr.attr.name)
+		device_remove_file(&dev->persist->pdev->dev, &priv->probe_attr);
 	mlx4_stop_sense(dev);
 	mlx4_unregister_device(dev);
 
@@ -5315,6 +5404,14 @@ static int __init mlx4_init(void)
 	if (!mlx4_wq)
 		return -ENOMEM;
 
+#ifdef HAVE_DEVICE_DRIVER_PROBE_TYPE
+	if (fast_probe)
+		mlx4_driver.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS;
+#else
+	if (fast_probe)
+		pr_warn("mlx4_core: fast_probe is not supported by this kernel\n");
+#endif
+
 	ret = pci_register_driver(&mlx4_driver);
 	if (ret < 0)
 		destroy_workqueue(mlx4_wq);
@@ -36,6 +36,8 @@
 
 #include <linux/mlx4/cmd.h>
 #include <linux/export.h>
+#include <linux/jhash.h>
+#include <linux/vmalloc.h>
 
 #include "mlx4.h"
 
@@ -80,18 +82,85 @@ static int mlx4_QP_FLOW_STEERING_DETACH(struct mlx4_dev *dev, u64 regid)
 	return err;
 }
 
-static int mlx4_READ_ENTRY(struct mlx4_dev *dev, int index,
-			   struct mlx4_cmd_mailbox *mailbox)
+static int __mlx4_READ_ENTRY(struct mlx4_dev *dev, int index,
+			     struct mlx4_cmd_mailbox *mailbox)
 {
 	return mlx4_cmd_box(dev, 0, mailbox->dma, index, 0, MLX4_CMD_READ_MCG,
 			    MLX4_CMD_TIME_CLASS_A, MLX4_CMD_NATIVE);
 }
 
+/*
+ * The MGM/AMGM tables are only ever written by this file, under
+ * mcg_table.mutex, so a host copy of each entry taken on its first read
+ * or write stays coherent with the firmware and lets later lookups skip
+ * READ_MCG altogether.  Entries are allocated on first use; if that
+ * fails the entry is simply not shadowed.
+ */
+static void mlx4_mgm_shadow_set(struct mlx4_dev *dev, int index,
+				struct mlx4_mgm *mgm)
+{
+	struct mlx4_mcg_table *mcg_table = &mlx4_priv(dev)->mcg_table;
+
+	if (!mcg_table->shadow || index < 0 || index >= mcg_table->shadow_size)
+		return;
+
+	if (!mcg_table->shadow[index]) {
+		mcg_table->shadow[index] =
+			kmalloc(mlx4_get_mgm_entry_size(dev), GFP_KERNEL);
+		if (!mcg_table->shadow[index])
+			return;
+	}
+	memcpy(mcg_table->shadow[index], mgm, mlx4_get_mgm_entry_size(dev));
+}
+
+static void mlx4_mgm_shadow_drop(struct mlx4_dev *dev, int index)
+{
+	struct mlx4_mcg_table *mcg_table = &mlx4_priv(dev)->mcg_table;
+
+	if (!mcg_table->shadow || index < 0 || index >= mcg_table->shadow_size)
+		return;
+
+	kfree(mcg_table->shadow[index]);
+	mcg_table->shadow[index] = NULL;
+}
+
+static int mlx4_READ_ENTRY(struct mlx4_dev *dev, int index,
+			   struct mlx4_cmd_mailbox *mailbox)
+{
+	struct mlx4_mcg_table *mcg_table = &mlx4_priv(dev)->mcg_table;
+	int err;
+
+	if (mcg_table->shadow && index >= 0 && index < mcg_table->shadow_size) {
+		if (mcg_table->shadow[index]) {
+			memcpy(mailbox->buf, mcg_table->shadow[index],
+			       mlx4_get_mgm_entry_size(dev));
+			mcg_table->shadow_hits++;
+			return 0;
+		}
+		mcg_table->shadow_misses++;
+	}
+
+	err = __mlx4_READ_ENTRY(dev, index, mailbox);
+	if (!err)
+		mlx4_mgm_shadow_set(dev, index, mailbox->buf);
+
+	return err;
+}
+
 static int mlx4_WRITE_ENTRY(struct mlx4_dev *dev, int index,
 			    struct mlx4_cmd_mailbox *mailbox)
 {
-	return mlx4_cmd(dev, mailbox->dma, index, 0, MLX4_CMD_WRITE_MCG,
-			MLX4_CMD_TIME_CLASS_A, MLX4_CMD_NATIVE);
+	int err;
+
+	err = mlx4_cmd(dev, mailbox->dma, index, 0, MLX4_CMD_WRITE_MCG,
+		       MLX4_CMD_TIME_CLASS_A, MLX4_CMD_NATIVE);
+	/* on failure the firmware entry is unknown, re-read it next time */
+	if (err)
+		mlx4_mgm_shadow_drop(dev, index);
+	else
+		mlx4_mgm_shadow_set(dev, index, mailbox->buf);
+
+	return err;
 }
 
 static int mlx4_WRITE_PROMISC(struct mlx4_dev *dev, u8 port, u8 steer,
@@ -121,6 +190,69 @@ static int mlx4_GID_HASH(struct mlx4_dev *dev, struct mlx4_cmd_mailbox *mailbox,
 	return err;
 }
 
+static void mlx4_mgid_hash_flush(struct mlx4_mcg_table *mcg_table)
+{
+	struct mlx4_mgid_hash *entry;
+	struct hlist_node *tmp;
+	int i;
+
+	for (i = 0; i < MLX4_MGID_HASH_SIZE; i++)
+		hlist_for_each_entry_safe(entry, tmp, &mcg_table->mgid_hash[i],
+					  node) {
+			hlist_del(&entry->node);
+			kfree(entry);
+		}
+	mcg_table->mgid_hash_count = 0;
+}
+
+/*
+ * MGID_HASH is a pure function of the GID and op_mod, so remember its
+ * results instead of asking the firmware again on every attach/detach.
+ */
+static int mlx4_mgid_hash(struct mlx4_dev *dev, u8 *gid, u8 op_mod, u16 *hash)
+{
+	struct mlx4_mcg_table *mcg_table = &mlx4_priv(dev)->mcg_table;
+	struct mlx4_cmd_mailbox *mailbox;
+	struct mlx4_mgid_hash *entry;
+	struct hlist_head *bucket;
+	int err;
+
+	bucket = &mcg_table->mgid_hash[jhash(gid, 16, op_mod) &
+				       (MLX4_MGID_HASH_SIZE - 1)];
+	hlist_for_each_entry(entry, bucket, node) {
+		if (entry->op_mod == op_mod && !memcmp(entry->gid, gid, 16)) {
+			*hash = entry->hash;
+			mcg_table->mgid_hash_hits++;
+			return 0;
+		}
+	}
+	mcg_table->mgid_hash_misses++;
+
+	mailbox = mlx4_alloc_cmd_mailbox(dev);
+	if (IS_ERR(mailbox))
+		return -ENOMEM;
+	memcpy(mailbox->buf, gid, 16);
+
+	err = mlx4_GID_HASH(dev, mailbox, hash, op_mod);
+	mlx4_free_cmd_mailbox(dev, mailbox);
+	if (err)
+		return err;
+
+	if (mcg_table->mgid_hash_count >= MLX4_MGID_HASH_MAX)
+		mlx4_mgid_hash_flush(mcg_table);
+
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (entry) {
+		memcpy(entry->gid, gid, 16);
+		entry->op_mod = op_mod;
+		entry->hash = *hash;
+		hlist_add_head(&entry->node, bucket);
+		mcg_table->mgid_hash_count++;
+	}
+
+	return 0;
+}
+
 static struct mlx4_promisc_qp *get_promisc_qp(struct mlx4_dev *dev, u8 port,
 					      enum mlx4_steer_type steer,
 					      u32 qpn)
@@ -697,23 +829,13 @@ static int find_entry(struct mlx4_dev *dev, u8 port,
 		      struct mlx4_cmd_mailbox *mgm_mailbox,
 		      int *prev, int *index)
 {
-	struct mlx4_cmd_mailbox *mailbox;
 	struct mlx4_mgm *mgm = mgm_mailbox->buf;
-	u8 *mgid;
 	int err;
 	u16 hash = 0;
 	u8 op_mod = (prot == MLX4_PROT_ETH) ?
 		!!(dev->caps.flags & MLX4_DEV_CAP_FLAG_VEP_MC_STEER) : 0;
 
-	mailbox = mlx4_alloc_cmd_mailbox(dev);
-	if (IS_ERR(mailbox))
-		return -ENOMEM;
-	mgid = mailbox->buf;
-
-	memcpy(mgid, gid, 16);
-
-	err = mlx4_GID_HASH(dev, mailbox, &hash, op_mod);
-	mlx4_free_cmd_mailbox(dev, mailbox);
+	err = mlx4_mgid_hash(dev, gid, op_mod, &hash);
 	if (err)
 		return err;
 
@@ -1637,28 +1759,124 @@ int mlx4_unicast_promisc_remove(struct mlx4_dev *dev, u32 qpn, u8 port)
 }
 EXPORT_SYMBOL_GPL(mlx4_unicast_promisc_remove);
 
+/* Compare every shadowed MGM/AMGM entry against the firmware copy. */
+static ssize_t show_mcg_shadow(struct device *d, struct device_attribute *attr,
+			       char *buf)
+{
+	struct mlx4_priv *priv = container_of(attr, struct mlx4_priv,
+					      mcg_table.shadow_attr);
+	struct mlx4_mcg_table *mcg_table = &priv->mcg_table;
+	struct mlx4_dev *dev = &priv->dev;
+	struct mlx4_cmd_mailbox *mailbox;
+	int entries = 0, mismatches = 0, errors = 0;
+	ssize_t len = 0;
+	int i;
+
+	mailbox = mlx4_alloc_cmd_mailbox(dev);
+	if (IS_ERR(mailbox))
+		return PTR_ERR(mailbox);
+
+	mutex_lock(&mcg_table->mutex);
+	for (i = 0; i < mcg_table->shadow_size; i++) {
+		if (!mcg_table->shadow[i])
+			continue;
+		entries++;
+		if (__mlx4_READ_ENTRY(dev, i, mailbox)) {
+			errors++;
+			continue;
+		}
+		if (memcmp(mailbox->buf, mcg_table->shadow[i],
+			   mlx4_get_mgm_entry_size(dev))) {
+			if (!mismatches)
+				mlx4_warn(dev, "MGM shadow of entry %x differs from firmware\n",
+					  i);
+			mismatches++;
+		}
+	}
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "entries %d\nmismatches %d\nread_errors %d\n",
+			 entries, mismatches, errors);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "shadow_hits %llu\nshadow_misses %llu\n",
+			 mcg_table->shadow_hits, mcg_table->shadow_misses);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "mgid_hash_hits %llu\nmgid_hash_misses %llu\n",
+			 mcg_table->mgid_hash_hits,
+			 mcg_table->mgid_hash_misses);
+	mutex_unlock(&mcg_table->mutex);
+
+	mlx4_free_cmd_mailbox(dev, mailbox);
+	return len;
+}
+
 int mlx4_init_mcg_table(struct mlx4_dev *dev)
 {
 	struct mlx4_priv *priv = mlx4_priv(dev);
+	struct mlx4_mcg_table *mcg_table = &priv->mcg_table;
 	int err;
+	int i;
 
 	/* No need for mcg_table when fw managed the mcg table*/
 	if (dev->caps.steering_mode ==
 	    MLX4_STEERING_MODE_DEVICE_MANAGED)
 		return 0;
-	err = mlx4_bitmap_init(&priv->mcg_table.bitmap, dev->caps.num_amgms,
+	err = mlx4_bitmap_init(&mcg_table->bitmap, dev->caps.num_amgms,
 			       dev->caps.num_amgms - 1, 0, 0);
 	if (err)
 		return err;
 
-	mutex_init(&priv->mcg_table.mutex);
+	mutex_init(&mcg_table->mutex);
+
+	for (i = 0; i < MLX4_MGID_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&mcg_table->mgid_hash[i]);
+	mcg_table->mgid_hash_count = 0;
+	mcg_table->shadow_hits = 0;
+	mcg_table->shadow_misses = 0;
+	mcg_table->mgid_hash_hits = 0;
+	mcg_table->mgid_hash_misses = 0;
+
+	mcg_table->shadow_size = dev->caps.num_mgms + dev->caps.num_amgms;
+	mcg_table->shadow = vzalloc(mcg_table->shadow_size *
+				    sizeof(*mcg_table->shadow));
+	if (!mcg_table->shadow) {
+		mlx4_warn(dev, "Failed to allocate MGM shadow, using firmware reads\n");
+		mcg_table->shadow_size = 0;
+		mcg_table->shadow_attr.attr.name = NULL;
+		return 0;
+	}
+
+	sysfs_attr_init(&mcg_table->shadow_attr.attr);
+	mcg_table->shadow_attr.attr.name = "mcg_shadow";
+	mcg_table->shadow_attr.attr.mode = S_IRUSR;
+	mcg_table->shadow_attr.show = show_mcg_shadow;
+	if (device_create_file(&dev->persist->pdev->dev,
+			       &mcg_table->shadow_attr)) {
+		mlx4_warn(dev, "Failed to create MGM shadow check file\n");
+		mcg_table->shadow_attr.attr.name = NULL;
+	}
 
 	return 0;
 }
 
 void mlx4_cleanup_mcg_table(struct mlx4_dev *dev)
 {
-	if (dev->caps.steering_mode !=
+	struct mlx4_mcg_table *mcg_table = &mlx4_priv(dev)->mcg_table;
+	int i;
+
+	if (dev->caps.steering_mode ==
 	    MLX4_STEERING_MODE_DEVICE_MANAGED)
-		mlx4_bitmap_cleanup(&mlx4_priv(dev)->mcg_table.bitmap);
+		return;
+
+	if (mcg_table->shadow_attr.attr.name)
+		device_remove_file(&dev->persist->pdev->dev,
+				   &mcg_table->shadow_attr);
+	if (mcg_table->shadow) {
+		for (i = 0; i < mcg_table->shadow_size; i++)
+			kfree(mcg_table->shadow[i]);
+		vfree(mcg_table->shadow);
+		mcg_table->shadow = NULL;
+	}
+	mlx4_mgid_hash_flush(mcg_table);
+	mlx4_bitmap_cleanup(&mcg_table->bitmap);
 }
@@ -260,13 +260,27 @@ struct mlx4_bitmap {
 	u32			effective_len;
 	spinlock_t		lock;
 	unsigned long	       *table;
+	unsigned long	       *full;	/* one bit per full word of table */
+};
+
+/* Per-CPU cache of free segments for the smallest buddy orders */
+#define MLX4_BUDDY_PCP_ORDERS	3
+#define MLX4_BUDDY_PCP_SIZE	16
+#define MLX4_BUDDY_PCP_BATCH	(MLX4_BUDDY_PCP_SIZE / 2)
+
+struct mlx4_buddy_pcp {
+	spinlock_t		lock;
+	u32			cnt[MLX4_BUDDY_PCP_ORDERS];
+	u32			seg[MLX4_BUDDY_PCP_ORDERS][MLX4_BUDDY_PCP_SIZE];
 };
 
 struct mlx4_buddy {
 	unsigned long	      **bits;
 	unsigned int	       *num_free;
+	u32		       *hint;	/* no free block below, per order */
 	u32			max_order;
 	spinlock_t		lock;
+	struct mlx4_buddy_pcp __percpu *pcp;
 };
 
 struct mlx4_icm;
@@ -280,6 +294,10 @@ struct mlx4_icm_table {
 	int			coherent;
 	struct mutex		mutex;
 	struct mlx4_icm	      **icm;
+	atomic_t	       *refcount;
+	/* lowmem tables only: per-page CPU and DMA addresses */
+	void		      **page_virt;
+	dma_addr_t	       *page_dma;
 };
 
 #define MLX4_MPT_FLAG_SW_OWNS	    (0xfUL << 28)
@@ -402,6 +420,15 @@ struct mlx4_eq_tasklet {
 	spinlock_t lock;
 };
 
+struct mlx4_eq_stats {
+	u64			irqs;
+	u64			polls;
+	u64			eqes;
+	u32			max_eqes_per_irq;
+	u64			irq_time_ns;
+	u64			max_irq_time_ns;
+};
+
 struct mlx4_eq {
 	struct mlx4_dev	       *dev;
 	void __iomem	       *doorbell;
@@ -414,6 +441,9 @@ struct mlx4_eq {
 	struct mlx4_mtt		mtt;
 	u32			ncqs;
 	struct mlx4_eq_tasklet	tasklet_ctx;
+	/* continues EQ polling when an interrupt exhausts its budget */
+	struct tasklet_struct	poll_task;
+	struct mlx4_eq_stats	stats;
 	struct mlx4_active_ports actv_ports;
 	u32			ref_count;
 	u8			name_priority;
@@ -567,13 +597,23 @@ struct resource_allocator {
 	int *guaranteed;
 };
 
+/* Guards the tree and the slave lists of one resource type */
+struct mlx4_tracker_lock {
+	spinlock_t	lock;
+	u64		stamp;		/* local_clock() when taken */
+	u64		acquired;
+	u64		hold_ns;
+	u64		max_hold_ns;
+} ____cacheline_aligned_in_smp;
+
 struct mlx4_resource_tracker {
-	spinlock_t lock;
+	struct mlx4_tracker_lock lock[MLX4_NUM_OF_RESOURCE_TYPE];
 	/* tree for each resources */
 	struct rb_root res_tree[MLX4_NUM_OF_RESOURCE_TYPE];
 	/* num_of_slave's lists, one per slave */
 	struct slave_list *slave_list;
 	struct resource_allocator res_alloc[MLX4_NUM_OF_RESOURCE_TYPE];
+	struct device_attribute stats_attr;
 };
 
 #define SLAVE_EVENT_EQ_SIZE	128
@@ -596,6 +636,24 @@ struct mlx4_master_qp0_state {
 	int port_active;
 };
 
+/* Bound on slaves whose comm channel commands are serviced at once */
+#define MLX4_COMM_WORKERS	8
+
+struct mlx4_priv;
+
+struct mlx4_slave_comm {
+	struct work_struct	work;
+	struct mlx4_priv       *priv;
+	int			slave;
+	u64			queued;		/* local_clock() at dispatch */
+	u64			cmds;
+	u64			spurious;
+	u64			queue_ns;
+	u64			max_queue_ns;
+	u64			service_ns;
+	u64			max_service_ns;
+};
+
 struct mlx4_mfunc_master_ctx {
 	struct mlx4_slave_state *slave_state;
 	struct mlx4_vf_admin_state *vf_admin;
@@ -607,6 +665,9 @@ struct mlx4_mfunc_master_ctx {
 	struct mlx4_resource_tracker res_tracker;
 	struct workqueue_struct *comm_wq;
 	struct work_struct	comm_work;
+	struct workqueue_struct *comm_slave_wq;
+	struct mlx4_slave_comm	*slave_comm;
+	struct device_attribute	comm_stats_attr;
 	struct work_struct	slave_event_work;
 	struct work_struct	slave_flr_event_work;
 	spinlock_t		slave_state_lock;
@@ -685,12 +746,20 @@ struct mlx4_mr_table {
 	u64			mpt_base;
 	struct mlx4_icm_table	mtt_table;
 	struct mlx4_icm_table	dmpt_table;
+	struct device_attribute	buddy_attr;
 };
 
+#define MLX4_CQ_ARRAY_MAX_LOG_SIZE	14
+
 struct mlx4_cq_table {
 	struct mlx4_bitmap	bitmap;
 	spinlock_t		lock;
 	struct radix_tree_root	tree;
+	/* Direct indexed by the low bits of the CQN, holds the first CQ
+	 * inserted for each slot. Lookups fall back to the tree on a miss.
+	 */
+	struct mlx4_cq __rcu  **array;
+	u32			array_mask;
 	struct mlx4_icm_table	table;
 	struct mlx4_icm_table	cmpt_table;
 };
@@ -737,10 +806,30 @@ struct mlx4_qp_table {
 	struct mlx4_icm_table	cmpt_table;
 };
 
+#define MLX4_MGID_HASH_SIZE	256
+#define MLX4_MGID_HASH_MAX	4096
+
+struct mlx4_mgid_hash {
+	struct hlist_node	node;
+	u8			gid[16];
+	u8			op_mod;
+	u16			hash;
+};
+
 struct mlx4_mcg_table {
 	struct mutex		mutex;
 	struct mlx4_bitmap	bitmap;
 	struct mlx4_icm_table	table;
+	/* host copy of MGM/AMGM entries, indexed like the firmware table */
+	struct mlx4_mgm	      **shadow;
+	int			shadow_size;
+	struct hlist_head	mgid_hash[MLX4_MGID_HASH_SIZE];
+	int			mgid_hash_count;
+	u64			shadow_hits;
+	u64			shadow_misses;
+	u64			mgid_hash_hits;
+	u64			mgid_hash_misses;
+	struct device_attribute	shadow_attr;
 };
 
 struct mlx4_catas_err {
@@ -752,17 +841,26 @@ struct mlx4_catas_err {
 #define MLX4_MAX_MAC_NUM	128
 #define MLX4_MAC_TABLE_SIZE	(MLX4_MAX_MAC_NUM << 3)
 
+/* Index hash over the port MAC/VLAN/GID tables; chains end with -1 */
+#define MLX4_PORT_HASH_BITS	6
+#define MLX4_PORT_HASH_SIZE	(1 << MLX4_PORT_HASH_BITS)
+
 struct mlx4_mac_table {
 	__be64			entries[MLX4_MAX_MAC_NUM];
 	int			refs[MLX4_MAX_MAC_NUM];
 	struct mutex		mutex;
 	int			total;
 	int			max;
+	s16			hash[MLX4_PORT_HASH_SIZE];
+	s16			next[MLX4_MAX_MAC_NUM];
+	DECLARE_BITMAP(used, MLX4_MAX_MAC_NUM);
 };
 
 struct mlx4_roce_info {
 	struct mlx4_roce_addr_table	addr_table;
 	struct mutex			mutex;
+	s16				gid_hash[MLX4_PORT_HASH_SIZE];
+	s16				gid_next[MLX4_ROCE_MAX_GIDS];
 };
 
 #define MLX4_MAX_VLAN_NUM	128
@@ -774,6 +872,9 @@ struct mlx4_vlan_table {
 	struct mutex		mutex;
 	int			total;
 	int			max;
+	s16			hash[MLX4_PORT_HASH_SIZE];
+	s16			next[MLX4_MAX_VLAN_NUM];
+	DECLARE_BITMAP(used, MLX4_MAX_VLAN_NUM);
 };
 
 #define SET_PORT_GEN_ALL_VALID		0x7
@@ -878,6 +979,18 @@ enum {
 	MLX4_USE_RR	= 1,
 };
 
+enum mlx4_probe_phase {
+	MLX4_PROBE_RESET,
+	MLX4_PROBE_CMD,
+	MLX4_PROBE_FW,
+	MLX4_PROBE_HCA,
+	MLX4_PROBE_EQ,
+	MLX4_PROBE_SETUP,
+	MLX4_PROBE_PORTS,
+	MLX4_PROBE_REGISTER,
+	MLX4_PROBE_NUM_PHASES
+};
+
 struct mlx4_priv {
 	struct mlx4_dev		dev;
 
@@ -931,6 +1044,11 @@ struct mlx4_priv {
 
 	atomic_t		opreq_count;
 	struct work_struct	opreq_task;
+
+	/* time spent in each phase of the last mlx4_load_one() */
+	u64			probe_ns[MLX4_PROBE_NUM_PHASES];
+	u64			probe_stamp;
+	struct device_attribute	probe_attr;
 };
 
 static inline struct mlx4_priv *mlx4_priv(struct mlx4_dev *dev)
@@ -1394,9 +1512,10 @@ static inline u32 get_param_h(u64 *arg)
 	return (u32)(*arg >> 32);
 }
 
-static inline spinlock_t *mlx4_tlock(struct mlx4_dev *dev)
+static inline struct mlx4_tracker_lock *mlx4_tlock(struct mlx4_dev *dev,
+						   enum mlx4_resource type)
 {
-	return &mlx4_priv(dev)->mfunc.master.res_tracker.lock;
+	return &mlx4_priv(dev)->mfunc.master.res_tracker.lock[type];
 }
 
 #define NOT_MASKED_PD_BITS 17
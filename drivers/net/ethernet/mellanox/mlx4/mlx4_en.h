@@ -128,15 +128,34 @@
 #define STAMP_SHIFT		31
 #define STAMP_VAL		0x7fffffff
 #define STATS_DELAY		(HZ / 4)
+/* Stop polling hardware counters when nobody read them for this long */
+#define MLX4_EN_STATS_IDLE	(60 * HZ)
 #define SERVICE_TASK_DELAY	(HZ / 4)
+#define MLX4_EN_RX_MODE_DELAY	(HZ / 100)
+#define MLX4_EN_RX_MODE_BUDGET	64
 #define MAX_NUM_OF_FS_RULES	256
 
-#define MLX4_EN_FILTER_HASH_SHIFT 4
+#define MLX4_EN_FILTER_HASH_SHIFT 8
 #define MLX4_EN_FILTER_EXPIRY_QUOTA 60
+#define MLX4_EN_FILTER_LOAD	2
+#define MLX4_EN_FILTER_MAX	(1 << 16)
 
 /* Typical TSO descriptor with 16 gather entries is 352 bytes... */
 #define MAX_DESC_SIZE		512
 #define MAX_DESC_TXBBS		(MAX_DESC_SIZE / TXBB_SIZE)
+/* A descriptor that would cross the ring edge is preceded by a NOP that
+ * pads the rest of the ring, so one xmit may consume up to this many TXBBs.
+ */
+#define MAX_XMIT_TXBBS		(2 * MAX_DESC_TXBBS - 1)
+
+/* Per-ring TX inline/BlueFlame policy, see mlx4_en_tx_policy() */
+#define MLX4_EN_TX_POLICY_WINDOW	64
+#define MLX4_EN_TX_BULK_BATCH		4
+/* Default inline_bulk_thold: the largest packet whose inline descriptor
+ * is a single TXBB (44 bytes)
+ */
+#define MLX4_EN_INLINE_BULK_THOLD	(MLX4_INLINE_ALIGN - CTRL_SIZE - \
+					 sizeof(struct mlx4_wqe_inline_seg))
 
 /*
  * OS related constants and tunables
@@ -211,6 +230,7 @@ enum {
 
 #define MLX4_EN_TX_COAL_PKTS	16
 #define MLX4_EN_TX_COAL_TIME	8
+#define MLX4_EN_TX_COAL_TIME_HIGH	64
 
 #define MLX4_EN_RX_RATE_LOW		400000
 #define MLX4_EN_RX_COAL_TIME_LOW	0
@@ -221,6 +241,13 @@ enum {
 #define MLX4_EN_SAMPLE_INTERVAL		0
 #define MLX4_EN_AVG_PKT_SMALL		256
 
+/* Adaptive moderation samples a CQ every MLX4_EN_MODER_EVENTS NAPI polls,
+ * provided at least MLX4_EN_MODER_MIN_USECS, or the ethtool
+ * rate_sample_interval if longer, passed since the last sample.
+ */
+#define MLX4_EN_MODER_EVENTS		8
+#define MLX4_EN_MODER_MIN_USECS		500
+
 #define MLX4_EN_AUTO_CONF	0xffff
 
 #define MLX4_EN_DEF_RX_PAUSE	1
@@ -233,6 +260,14 @@ enum {
 
 #define SMALL_PACKET_SIZE      (256 - NET_IP_ALIGN)
 #define HEADER_COPY_SIZE       (128 - NET_IP_ALIGN)
+/* Per-ring RX copybreak and header copy limits; a header copy length of
+ * MLX4_EN_HDR_COPY_AUTO sizes the copy from the parsed L2-L4 headers.
+ */
+#define MLX4_EN_MAX_COPYBREAK	(1024 - NET_IP_ALIGN)
+#define MLX4_EN_MAX_HDR_COPY	SMALL_PACKET_SIZE
+#define MLX4_EN_HDR_COPY_AUTO	0
+/* VXLAN header following the outer UDP header of tunneled packets */
+#define MLX4_EN_TUNNEL_HDR_LEN	8
 #define MLX4_LOOPBACK_TEST_PAYLOAD (HEADER_COPY_SIZE - ETH_HLEN)
 
 #define MLX4_EN_MIN_MTU		46
@@ -294,6 +329,16 @@ enum cq_type {
 #define XNOR(x, y)		(!(x) == !(y))
 
 
+/* skbs completed by one TX CQ poll, released after the ring consumer
+ * index is published
+ */
+#define MLX4_EN_TX_BULK_SKBS	64
+
+struct mlx4_en_tx_bulk {
+	int nr;
+	struct sk_buff *skbs[MLX4_EN_TX_BULK_SKBS];
+};
+
 struct mlx4_en_tx_info {
 	struct sk_buff *skb;
 	dma_addr_t	map0_dma;
@@ -350,6 +395,27 @@ struct mlx4_en_rx_alloc {
 	u32		page_size;
 };
 
+/* Extra RX page cache entries on top of the pages the ring keeps in flight */
+#define MLX4_EN_PAGE_CACHE_SPARE	64
+
+struct mlx4_en_page_cache_entry {
+	struct page	*page;
+	dma_addr_t	dma;
+	u32		page_size;
+	/* the last fragment of the page was released by the ring */
+	bool		done;
+};
+
+/* FIFO of exhausted, still mapped RX pages. A page is recycled once the
+ * ring and the stack have released all of its fragments.
+ */
+struct mlx4_en_page_cache {
+	struct mlx4_en_page_cache_entry *buf;
+	u32		size_mask;
+	u32		head;
+	u32		tail;
+};
+
 struct mlx4_en_tx_ring {
 	/* cache line used and dirtied in tx completion
 	 * (mlx4_en_free_tx_buf())
@@ -365,6 +431,17 @@ struct mlx4_en_tx_ring {
 	unsigned long		tx_csum;
 	unsigned long		tso_packets;
 	unsigned long		xmit_more;
+	unsigned long		tx_edge_pad;
+	unsigned long		tx_inline;
+	unsigned long		tx_bf;
+	unsigned long		tx_doorbell;
+	/* adaptive inline/BlueFlame policy state */
+	unsigned long		policy_sends;
+	unsigned long		policy_doorbells;
+	unsigned long		policy_bytes;
+	u16			policy_budget;
+	u16			inline_thold;
+	bool			bf_active;
 	struct mlx4_bf		bf;
 	unsigned long		queue_stopped;
 
@@ -381,7 +458,6 @@ struct mlx4_en_tx_ring {
 	__be32			mr_key;
 	void			*buf;
 	struct mlx4_en_tx_info	*tx_info;
-	u8			*bounce_buf;
 	struct mlx4_qp_context	context;
 	int			qpn;
 	enum mlx4_qp_state	qp_state;
@@ -400,6 +476,7 @@ struct mlx4_en_rx_desc {
 struct mlx4_en_rx_ring {
 	struct mlx4_hwq_resources wqres;
 	struct mlx4_en_rx_alloc page_alloc[MLX4_EN_MAX_RX_FRAGS];
+	struct mlx4_en_page_cache page_cache;
 	u32 size ;	/* number of Rx descs*/
 	u32 actual_size;
 	u32 size_mask;
@@ -422,6 +499,13 @@ struct mlx4_en_rx_ring {
 	unsigned long csum_ok;
 	unsigned long csum_none;
 	unsigned long csum_complete;
+	unsigned long pages_reused;
+	unsigned long pages_allocated;
+	unsigned long pages_waived;
+	unsigned long mc_loopback_dropped;
+	unsigned long hdr_pulls;
+	u16 copybreak;
+	u16 hdr_copy;
 	int hwtstamp_rx_filter;
 	cpumask_var_t affinity_mask;
 #ifdef CONFIG_COMPAT_LRO_ENABLED
@@ -441,6 +525,13 @@ struct mlx4_en_cq {
 	enum cq_type is_tx;
 	u16 moder_time;
 	u16 moder_cnt;
+	/* adaptive moderation state, owned by NAPI */
+	u16 moder_events;
+	u16 moder_target;
+	unsigned long moder_packets;
+	unsigned long moder_bytes;
+	ktime_t moder_stamp;
+	struct work_struct moder_work;
 	struct mlx4_cqe *buf;
 #define MLX4_EN_OPCODE_ERROR	0x1e
 #if !(defined(HAVE_IRQ_DESC_GET_IRQ_DATA) && defined(HAVE_IRQ_TO_DESC_EXPORTED))
@@ -474,6 +565,7 @@ struct mlx4_en_port_profile {
 	u8 tx_ppp;
 	int rss_rings;
 	int inline_thold;
+	int inline_bulk_thold;
 	int inline_scatter_thold;
 };
 
@@ -482,6 +574,7 @@ struct mlx4_en_profile {
 	int rss_xor;
 #endif
 	int udp_rss;
+	int rx_page_reuse;
 	u8 rss_mask;
 	u32 active_ports;
 	u32 small_pkt_int;
@@ -490,6 +583,21 @@ struct mlx4_en_profile {
 	struct mlx4_en_port_profile prof[MLX4_MAX_PORTS + 1];
 };
 
+/* Read-mostly copy of the timecounter state needed to convert a CQE
+ * timestamp, so the RX/TX hot path never writes a shared cacheline.
+ */
+struct mlx4_en_ts_snapshot {
+	seqcount_t		seq;
+	u32			mult;
+	u32			shift;
+	u64			mask;
+	u64			cycle_last;
+	u64			nsec;
+#ifdef HAVE_CYCLECOUNTER_CYC2NS_4_PARAMS
+	u64			frac;
+#endif
+} ____cacheline_aligned_in_smp;
+
 struct mlx4_en_dev {
 	struct mlx4_dev         *dev;
 	struct pci_dev		*pdev;
@@ -508,10 +616,11 @@ struct mlx4_en_dev {
 	u32                     priv_pdn;
 	spinlock_t              uar_lock;
 	u8			mac_removed[MLX4_MAX_PORTS + 1];
-	rwlock_t		clock_lock;
+	spinlock_t		clock_lock; /* serializes timecounter updates */
 	u32			nominal_c_mult;
 	struct cyclecounter	cycles;
 	struct timecounter	clock;
+	struct mlx4_en_ts_snapshot ts_snapshot;
 	unsigned long		last_overflow_check;
 	unsigned long		overflow_period;
 #if defined (HAVE_PTP_CLOCK_INFO) && (defined (CONFIG_PTP_1588_CLOCK) || defined(CONFIG_PTP_1588_CLOCK_MODULE))
@@ -550,7 +659,10 @@ enum mlx4_en_mclist_act {
 
 struct mlx4_en_mc_list {
 	struct list_head	list;
+	struct hlist_node	hlist;
 	enum mlx4_en_mclist_act	action;
+	u8			attached;
+	u8			in_filter;	/* set in the port mcast filter */
 	u8			addr[ETH_ALEN];
 	u64			reg_id;
 	u64			tunnel_reg_id;
@@ -589,12 +701,24 @@ enum {
 	MLX4_EN_FLAG_RX_FILTER_NEEDED	= (1 << 3),
 	MLX4_EN_FLAG_FORCE_PROMISC	= (1 << 4),
 	MLX4_EN_FLAG_RX_CSUM_NON_TCP_UDP	= (1 << 5),
+	/* firmware drops our looped-back multicast on the RX QPs */
+	MLX4_EN_FLAG_RX_FILTER_HW	= (1 << 6),
+	/* port multicast filter holds exactly the addresses in mc_list */
+	MLX4_EN_FLAG_MC_FLTR_SYNC	= (1 << 7),
 };
 
 #define PORT_BEACON_MAX_LIMIT (65535)
 #define MLX4_EN_MAC_HASH_SIZE (1 << BITS_PER_BYTE)
 #define MLX4_EN_MAC_HASH_IDX 5
 
+/* Two-hash Bloom filter over the MACs in mac_hash, used to skip the
+ * mac_hash walk for multicast frames that were not sent by us.
+ */
+#define MLX4_EN_MAC_FILTER_BITS		(2 << BITS_PER_BYTE)
+#define MLX4_EN_MAC_FILTER_IDX1(mac)	((mac)[MLX4_EN_MAC_HASH_IDX])
+#define MLX4_EN_MAC_FILTER_IDX2(mac)	\
+	((1 << BITS_PER_BYTE) | ((mac)[4] ^ (mac)[3]))
+
 struct mlx4_en_stats_bitmap {
 	DECLARE_BITMAP(bitmap, NUM_ALL_STATS);
 	struct mutex mutex; /* for mutual access to stats bitmap */
@@ -624,11 +748,6 @@ struct mlx4_en_priv {
 	/* To allow rules removal while port is going down */
 	struct list_head ethtool_list;
 
-	unsigned long last_moder_packets[MAX_RX_RINGS];
-	unsigned long last_moder_tx_packets;
-	unsigned long last_moder_bytes[MAX_RX_RINGS];
-	unsigned long last_moder_jiffies;
-	int last_moder_time[MAX_RX_RINGS];
 	u16 rx_usecs;
 	u16 rx_frames;
 	u16 tx_usecs;
@@ -637,8 +756,13 @@ struct mlx4_en_priv {
 	u16 rx_usecs_low;
 	u32 pkt_rate_high;
 	u16 rx_usecs_high;
+	u16 tx_usecs_low;
+	u16 tx_usecs_high;
 	u16 sample_interval;
 	u16 adaptive_rx_coal;
+	u16 adaptive_tx_coal;
+	u16 rx_copybreak;
+	u16 rx_hdr_copy;
 	u32 msg_enable;
 	u32 loopback_ok;
 	u32 validate_loopback;
@@ -675,10 +799,15 @@ struct mlx4_en_priv {
 	struct mlx4_en_cq **tx_cq;
 	struct mlx4_en_cq *rx_cq[MAX_RX_RINGS];
 	struct mlx4_qp drop_qp;
-	struct work_struct rx_mode_task;
+	struct delayed_work rx_mode_task;
 	struct work_struct watchdog_task;
+	DECLARE_BITMAP(tx_hung, MAX_TX_RINGS);	/* set by tx_timeout */
+	DECLARE_BITMAP(tx_down, MAX_TX_RINGS);	/* failed ring recovery */
+	bool full_restart;	/* watchdog must restart the whole port */
 	struct work_struct linkstate_task;
 	struct delayed_work stats_task;
+	unsigned long stats_jiffies;	/* last hardware counter fetch */
+	unsigned long stats_demand;	/* last time stats were read */
 	struct delayed_work service_task;
 	struct work_struct vxlan_add_task;
 	struct work_struct vxlan_del_task;
@@ -694,6 +823,9 @@ struct mlx4_en_priv {
 	struct mlx4_en_stats_bitmap stats_bitmap;
 	struct list_head mc_list;
 	struct list_head curr_list;
+	struct hlist_head mc_hash[MLX4_EN_MAC_HASH_SIZE];	/* curr_list */
+	unsigned long rx_mode_pending;
+	unsigned long rx_mode_applied;
 	u64 broadcast_id;
 	struct mlx4_en_stat_out_mbox hw_stats;
 	int vids[128];
@@ -702,6 +834,7 @@ struct mlx4_en_priv {
 	u32 counter_index;
 	struct en_port *vf_ports[MLX4_MAX_NUM_VF];
 	struct hlist_head mac_hash[MLX4_EN_MAC_HASH_SIZE];
+	DECLARE_BITMAP(mac_filter, MLX4_EN_MAC_FILTER_BITS);
 	struct hwtstamp_config hwtstamp_config;
 
 #ifndef CONFIG_COMPAT_DISABLE_DCB
@@ -714,8 +847,17 @@ struct mlx4_en_priv {
 #ifdef CONFIG_RFS_ACCEL
 	spinlock_t filters_lock;
 	int last_filter_id;
-	struct list_head filters;
-	struct hlist_head filter_hash[1 << MLX4_EN_FILTER_HASH_SHIFT];
+	struct list_head filters[MAX_RX_RINGS];	/* per RX ring, for expiry */
+	struct hlist_head *filter_hash;
+	u32 filter_hash_shift;
+	u32 filter_hash_max_shift;
+	u32 filter_count;
+	u32 filter_max;
+	u32 filter_expire_next;
+	unsigned long filter_collisions;
+	unsigned long filter_expired;
+	unsigned long filter_expire_latency;	/* worst, in msecs */
+	struct work_struct filter_resize_task;
 #endif
 	u64 tunnel_reg_id;
 	__be16 vxlan_port;
@@ -739,6 +881,7 @@ struct mlx4_mac_entry {
 	struct hlist_node hlist;
 	unsigned char mac[ETH_ALEN + 2];
 	u64 reg_id;
+	bool seen;		/* still in the uc list, see do_uc_filter */
 	struct rcu_head rcu;
 };
 
@@ -868,6 +1011,7 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 int mlx4_en_start_port(struct net_device *dev);
 void mlx4_en_stop_port(struct net_device *dev, int detach);
 int mlx4_en_get_vport_stats(struct mlx4_en_dev *mdev, u8 port);
+void mlx4_en_refresh_stats(struct mlx4_en_priv *priv);
 void mlx4_en_set_stats_bitmap(struct mlx4_dev *dev,
 			      struct mlx4_en_stats_bitmap *stats_bitmap,
 			      u8 rx_ppp, u8 rx_pause,
@@ -885,7 +1029,10 @@ void mlx4_en_destroy_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq **pcq);
 int mlx4_en_activate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
 			int cq_idx);
 void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq);
+void __mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq);
 int mlx4_en_set_cq_moder(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq);
+void mlx4_en_cq_moder_sample(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
+			     unsigned long packets, unsigned long bytes);
 int mlx4_en_arm_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq);
 
 void mlx4_en_tx_irq(struct mlx4_cq *mcq);
@@ -942,6 +1089,7 @@ void mlx4_en_fill_qp_context(struct mlx4_en_priv *priv, int size, int stride,
 void mlx4_en_sqp_event(struct mlx4_qp *qp, enum mlx4_event event);
 int mlx4_en_map_buffer(struct mlx4_buf *buf);
 void mlx4_en_unmap_buffer(struct mlx4_buf *buf);
+void mlx4_en_update_mcast_lb_filter(struct mlx4_en_priv *priv, int loopback);
 int mlx4_en_change_mcast_loopback(struct mlx4_en_priv *priv, struct mlx4_qp *qp,
 				  int loopback);
 void mlx4_en_calc_rx_buf(struct net_device *dev);
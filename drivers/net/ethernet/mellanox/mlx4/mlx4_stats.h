@@ -69,10 +69,26 @@ struct mlx4_en_port_stats {
 	unsigned long rx_chksum_none;
 	unsigned long rx_chksum_complete;
 	unsigned long tx_chksum_offload;
+	unsigned long rx_pages_reused;
+	unsigned long rx_pages_allocated;
+	unsigned long rx_pages_waived;
+	unsigned long rx_mc_loopback_dropped;
+	unsigned long tx_edge_padding;
+	unsigned long rx_hdr_pulls;
+	unsigned long rfs_filters;
+	unsigned long rfs_collisions;
+	unsigned long rfs_expired;
+	unsigned long rfs_expire_latency;
+	unsigned long rx_mode_pending;
+	unsigned long rx_mode_applied;
+	unsigned long tx_ring_recoveries;
+	unsigned long tx_ring_recovery_usecs;
+	unsigned long port_restarts;
+	unsigned long port_restart_usecs;
 #ifdef CONFIG_COMPAT_LRO_ENABLED
-#define NUM_PORT_STATS		13
+#define NUM_PORT_STATS		29
 #else
-#define NUM_PORT_STATS		10
+#define NUM_PORT_STATS		26
 #endif
 };
 
@@ -83,7 +99,9 @@ struct mlx4_en_perf_stats {
 	u16 tx_coal_avg;
 	u16 rx_coal_avg;
 	u32 napi_quota;
-#define NUM_PERF_COUNTERS		6
+	u32 tx_batch_avg;
+	u64 tx_cycles_avg;
+#define NUM_PERF_COUNTERS		8
 };
 
 #define NUM_MAIN_STATS	21
@@ -37,55 +37,53 @@
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/vmalloc.h>
+#include <linux/percpu.h>
 
 #include <linux/mlx4/cmd.h>
 
 #include "mlx4.h"
 #include "icm.h"
 
-static u32 mlx4_buddy_alloc(struct mlx4_buddy *buddy, int order)
+/* Called with buddy->lock held */
+static u32 __mlx4_buddy_alloc(struct mlx4_buddy *buddy, int order)
 {
 	int o;
 	int m;
 	u32 seg;
 
-	spin_lock(&buddy->lock);
-
 	for (o = order; o <= buddy->max_order; ++o)
 		if (buddy->num_free[o]) {
 			m = 1 << (buddy->max_order - o);
-			seg = find_first_bit(buddy->bits[o], m);
+			seg = find_next_bit(buddy->bits[o], m, buddy->hint[o]);
 			if (seg < m)
 				goto found;
 		}
 
-	spin_unlock(&buddy->lock);
 	return -1;
 
  found:
 	clear_bit(seg, buddy->bits[o]);
 	--buddy->num_free[o];
+	buddy->hint[o] = seg;
 
 	while (o > order) {
 		--o;
 		seg <<= 1;
 		set_bit(seg ^ 1, buddy->bits[o]);
 		++buddy->num_free[o];
+		buddy->hint[o] = min(buddy->hint[o], seg ^ 1);
 	}
 
-	spin_unlock(&buddy->lock);
-
 	seg <<= order;
 
 	return seg;
 }
 
-static void mlx4_buddy_free(struct mlx4_buddy *buddy, u32 seg, int order)
+/* Called with buddy->lock held */
+static void __mlx4_buddy_free(struct mlx4_buddy *buddy, u32 seg, int order)
 {
 	seg >>= order;
 
-	spin_lock(&buddy->lock);
-
 	while (test_bit(seg ^ 1, buddy->bits[order])) {
 		clear_bit(seg ^ 1, buddy->bits[order]);
 		--buddy->num_free[order];
@@ -95,13 +93,112 @@ static void mlx4_buddy_free(struct mlx4_buddy *buddy, u32 seg, int order)
 
 	set_bit(seg, buddy->bits[order]);
 	++buddy->num_free[order];
+	buddy->hint[order] = min(buddy->hint[order], seg);
+}
 
+/* Called with pcp->lock held; the lock order is pcp->lock, buddy->lock */
+static void mlx4_buddy_pcp_flush(struct mlx4_buddy *buddy,
+				 struct mlx4_buddy_pcp *pcp, int order, u32 cnt)
+{
+	spin_lock(&buddy->lock);
+	while (cnt-- && pcp->cnt[order])
+		__mlx4_buddy_free(buddy, pcp->seg[order][--pcp->cnt[order]],
+				  order);
+	spin_unlock(&buddy->lock);
+}
+
+static void mlx4_buddy_pcp_drain(struct mlx4_buddy *buddy)
+{
+	struct mlx4_buddy_pcp *pcp;
+	int cpu, o;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(buddy->pcp, cpu);
+		spin_lock(&pcp->lock);
+		for (o = 0; o < MLX4_BUDDY_PCP_ORDERS; o++)
+			mlx4_buddy_pcp_flush(buddy, pcp, o, MLX4_BUDDY_PCP_SIZE);
+		spin_unlock(&pcp->lock);
+	}
+}
+
+/* Small orders are served from a per-CPU magazine, refilled and flushed
+ * in batches, so most MTT allocations never touch buddy->lock.
+ */
+static u32 mlx4_buddy_alloc(struct mlx4_buddy *buddy, int order)
+{
+	struct mlx4_buddy_pcp *pcp;
+	u32 seg = -1;
+	u32 n, i;
+
+	if (order < MLX4_BUDDY_PCP_ORDERS) {
+		pcp = get_cpu_ptr(buddy->pcp);
+		spin_lock(&pcp->lock);
+		if (!pcp->cnt[order]) {
+			spin_lock(&buddy->lock);
+			for (n = 0; n < MLX4_BUDDY_PCP_BATCH; n++) {
+				seg = __mlx4_buddy_alloc(buddy, order);
+				if (seg == -1)
+					break;
+				pcp->seg[order][n] = seg;
+			}
+			spin_unlock(&buddy->lock);
+			/* The buddy hands out ascending segments; stack them
+			 * so the lowest one is popped first.
+			 */
+			for (i = 0; i < n / 2; i++)
+				swap(pcp->seg[order][i],
+				     pcp->seg[order][n - 1 - i]);
+			pcp->cnt[order] = n;
+		}
+		if (pcp->cnt[order])
+			seg = pcp->seg[order][--pcp->cnt[order]];
+		spin_unlock(&pcp->lock);
+		put_cpu_ptr(buddy->pcp);
+
+		if (seg != -1)
+			return seg;
+	}
+
+	spin_lock(&buddy->lock);
+	seg = __mlx4_buddy_alloc(buddy, order);
+	spin_unlock(&buddy->lock);
+
+	/* Segments parked in other CPUs' magazines may be what is missing */
+	if (seg == -1) {
+		mlx4_buddy_pcp_drain(buddy);
+		spin_lock(&buddy->lock);
+		seg = __mlx4_buddy_alloc(buddy, order);
+		spin_unlock(&buddy->lock);
+	}
+
+	return seg;
+}
+
+static void mlx4_buddy_free(struct mlx4_buddy *buddy, u32 seg, int order)
+{
+	struct mlx4_buddy_pcp *pcp;
+
+	if (order < MLX4_BUDDY_PCP_ORDERS) {
+		pcp = get_cpu_ptr(buddy->pcp);
+		spin_lock(&pcp->lock);
+		if (pcp->cnt[order] == MLX4_BUDDY_PCP_SIZE)
+			mlx4_buddy_pcp_flush(buddy, pcp, order,
+					     MLX4_BUDDY_PCP_BATCH);
+		pcp->seg[order][pcp->cnt[order]++] = seg;
+		spin_unlock(&pcp->lock);
+		put_cpu_ptr(buddy->pcp);
+		return;
+	}
+
+	spin_lock(&buddy->lock);
+	__mlx4_buddy_free(buddy, seg, order);
 	spin_unlock(&buddy->lock);
 }
 
 static int mlx4_buddy_init(struct mlx4_buddy *buddy, int max_order)
 {
 	int i, s;
+	int cpu;
 
 	buddy->max_order = max_order;
 	spin_lock_init(&buddy->lock);
@@ -110,9 +207,15 @@ static int mlx4_buddy_init(struct mlx4_buddy *buddy, int max_order)
 			      GFP_KERNEL);
 	buddy->num_free = kcalloc((buddy->max_order + 1), sizeof *buddy->num_free,
 				  GFP_KERNEL);
-	if (!buddy->bits || !buddy->num_free)
+	buddy->hint = kcalloc(buddy->max_order + 1, sizeof(*buddy->hint),
+			      GFP_KERNEL);
+	buddy->pcp = alloc_percpu(struct mlx4_buddy_pcp);
+	if (!buddy->bits || !buddy->num_free || !buddy->hint || !buddy->pcp)
 		goto err_out;
 
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(buddy->pcp, cpu)->lock);
+
 	for (i = 0; i <= buddy->max_order; ++i) {
 		s = BITS_TO_LONGS(1 << (buddy->max_order - i));
 		buddy->bits[i] = kcalloc(s, sizeof (long), GFP_KERNEL | __GFP_NOWARN);
@@ -133,6 +236,8 @@ err_out_free:
 		kvfree(buddy->bits[i]);
 
 err_out:
+	free_percpu(buddy->pcp);
+	kfree(buddy->hint);
 	kfree(buddy->bits);
 	kfree(buddy->num_free);
 
@@ -146,10 +251,52 @@ static void mlx4_buddy_cleanup(struct mlx4_buddy *buddy)
 	for (i = 0; i <= buddy->max_order; ++i)
 		kvfree(buddy->bits[i]);
 
+	free_percpu(buddy->pcp);
+	kfree(buddy->hint);
 	kfree(buddy->bits);
 	kfree(buddy->num_free);
 }
 
+/* Free blocks per order, segments cached per CPU, and the share of free
+ * space that sits in blocks too small for a request of that order.
+ */
+static ssize_t show_mtt_buddy(struct device *d, struct device_attribute *attr,
+			      char *buf)
+{
+	struct mlx4_priv *priv = container_of(attr, struct mlx4_priv,
+					      mr_table.buddy_attr);
+	struct mlx4_buddy *buddy = &priv->mr_table.mtt_buddy;
+	u32 cached[MLX4_BUDDY_PCP_ORDERS] = {0};
+	u64 total = 0, usable;
+	ssize_t len = 0;
+	int cpu, o;
+
+	for_each_possible_cpu(cpu)
+		for (o = 0; o < MLX4_BUDDY_PCP_ORDERS; o++)
+			cached[o] += per_cpu_ptr(buddy->pcp, cpu)->cnt[o];
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "order free_blocks cached unusable_pct\n");
+
+	spin_lock(&buddy->lock);
+	for (o = 0; o <= buddy->max_order; o++)
+		total += (u64)buddy->num_free[o] << o;
+
+	usable = total;
+	for (o = 0; o <= buddy->max_order; o++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%5d %11u %6u %12llu\n", o,
+				 buddy->num_free[o],
+				 o < MLX4_BUDDY_PCP_ORDERS ? cached[o] : 0,
+				 total ? div64_u64((total - usable) * 100,
+						   total) : 0);
+		usable -= (u64)buddy->num_free[o] << o;
+	}
+	spin_unlock(&buddy->lock);
+
+	return len;
+}
+
 u32 __mlx4_alloc_mtt_range(struct mlx4_dev *dev, int order)
 {
 	struct mlx4_mr_table *mr_table = &mlx4_priv(dev)->mr_table;
@@ -174,6 +321,36 @@ u32 __mlx4_alloc_mtt_range(struct mlx4_dev *dev, int order)
 	return offset;
 }
 
+/* The firmware-owned MTTs must be the first segments of the table, so
+ * they are taken straight from the buddy, never through a magazine.
+ */
+static u32 mlx4_reserve_mtt_range(struct mlx4_dev *dev, int order)
+{
+	struct mlx4_mr_table *mr_table = &mlx4_priv(dev)->mr_table;
+	struct mlx4_buddy *buddy = &mr_table->mtt_buddy;
+	int seg_order = max_t(int, order - log_mtts_per_seg, 0);
+	u32 seg;
+	u32 offset;
+
+	spin_lock(&buddy->lock);
+	seg = __mlx4_buddy_alloc(buddy, seg_order);
+	spin_unlock(&buddy->lock);
+	if (seg == -1)
+		return -1;
+
+	offset = seg * (1 << log_mtts_per_seg);
+
+	if (mlx4_table_get_range(dev, &mr_table->mtt_table, offset,
+				 offset + (1 << order) - 1)) {
+		spin_lock(&buddy->lock);
+		__mlx4_buddy_free(buddy, seg, seg_order);
+		spin_unlock(&buddy->lock);
+		return -1;
+	}
+
+	return offset;
+}
+
 static u32 mlx4_alloc_mtt_range(struct mlx4_dev *dev, int order)
 {
 	u64 in_param = 0;
@@ -932,10 +1109,20 @@ int mlx4_init_mr_table(struct mlx4_dev *dev)
 	if (err)
 		goto err_buddy;
 
+	sysfs_attr_init(&mr_table->buddy_attr.attr);
+	mr_table->buddy_attr.attr.name = "mtt_buddy";
+	mr_table->buddy_attr.attr.mode = S_IRUGO;
+	mr_table->buddy_attr.show = show_mtt_buddy;
+	if (device_create_file(&dev->persist->pdev->dev,
+			       &mr_table->buddy_attr)) {
+		mlx4_warn(dev, "Failed to create MTT buddy stats file\n");
+		mr_table->buddy_attr.attr.name = NULL;
+	}
+
 	if (dev->caps.reserved_mtts) {
 		priv->reserved_mtts =
-			mlx4_alloc_mtt_range(dev,
-					     fls(dev->caps.reserved_mtts - 1));
+			mlx4_reserve_mtt_range(dev,
+					       fls(dev->caps.reserved_mtts - 1));
 		if (priv->reserved_mtts < 0) {
 			mlx4_warn(dev, "MTT table of order %u is too small\n",
 				  mr_table->mtt_buddy.max_order);
@@ -947,6 +1134,9 @@ int mlx4_init_mr_table(struct mlx4_dev *dev)
 	return 0;
 
 err_reserve_mtts:
+	if (mr_table->buddy_attr.attr.name)
+		device_remove_file(&dev->persist->pdev->dev,
+				   &mr_table->buddy_attr);
 	mlx4_buddy_cleanup(&mr_table->mtt_buddy);
 
 err_buddy:
@@ -965,6 +1155,9 @@ void mlx4_cleanup_mr_table(struct mlx4_dev *dev)
 	if (priv->reserved_mtts >= 0)
 		mlx4_free_mtt_range(dev, priv->reserved_mtts,
 				    fls(dev->caps.reserved_mtts - 1));
+	if (mr_table->buddy_attr.attr.name)
+		device_remove_file(&dev->persist->pdev->dev,
+				   &mr_table->buddy_attr);
 	mlx4_buddy_cleanup(&mr_table->mtt_buddy);
 	mlx4_bitmap_cleanup(&mr_table->mpt_bitmap);
 }
@@ -34,6 +34,8 @@
 #include <linux/if_ether.h>
 #include <linux/if_vlan.h>
 #include <linux/export.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
 
 #include <linux/mlx4/cmd.h>
 
@@ -49,6 +51,44 @@
 #define MLX4_FLAG_V_IGNORE_FCS_MASK	0x2
 #define MLX4_IGNORE_FCS_MASK		0x1
 
+/*
+ * The MAC, VLAN and RoCE GID tables are small arrays whose index is
+ * meaningful to the firmware, so they are indexed by chains of array
+ * indices rather than by a separately allocated hash table.
+ */
+static void mlx4_port_hash_add(s16 *hash, s16 *next, u32 bucket, int index)
+{
+	next[index] = hash[bucket];
+	hash[bucket] = index;
+}
+
+static void mlx4_port_hash_del(s16 *hash, s16 *next, u32 bucket, int index)
+{
+	s16 *p;
+
+	for (p = &hash[bucket]; *p >= 0; p = &next[*p]) {
+		if (*p == index) {
+			*p = next[index];
+			return;
+		}
+	}
+}
+
+static inline u32 mlx4_mac_bucket(u64 mac)
+{
+	return hash_64(mac & MLX4_MAC_MASK, MLX4_PORT_HASH_BITS);
+}
+
+static inline u32 mlx4_vlan_bucket(u16 vlan)
+{
+	return hash_32(vlan, MLX4_PORT_HASH_BITS);
+}
+
+static inline u32 mlx4_gid_bucket(const u8 *gid)
+{
+	return jhash(gid, MLX4_GID_LEN, 0) & (MLX4_PORT_HASH_SIZE - 1);
+}
+
 void mlx4_init_mac_table(struct mlx4_dev *dev, struct mlx4_mac_table *table)
 {
 	int i;
@@ -58,6 +98,9 @@ void mlx4_init_mac_table(struct mlx4_dev *dev, struct mlx4_mac_table *table)
 		table->entries[i] = 0;
 		table->refs[i]	 = 0;
 	}
+	for (i = 0; i < MLX4_PORT_HASH_SIZE; i++)
+		table->hash[i] = -1;
+	bitmap_zero(table->used, MLX4_MAX_MAC_NUM);
 	table->max   = 1 << dev->caps.log_num_macs;
 	table->total = 0;
 }
@@ -71,10 +114,48 @@ void mlx4_init_vlan_table(struct mlx4_dev *dev, struct mlx4_vlan_table *table)
 		table->entries[i] = 0;
 		table->refs[i]	 = 0;
 	}
+	for (i = 0; i < MLX4_PORT_HASH_SIZE; i++)
+		table->hash[i] = -1;
+	bitmap_zero(table->used, MLX4_MAX_VLAN_NUM);
 	table->max   = (1 << dev->caps.log_num_vlans) - MLX4_VLAN_REGULAR;
 	table->total = 0;
 }
 
+/*
+ * Rebuild the GID index after the table was written.  Entries are linked
+ * from the highest index down, so every chain is in ascending index order.
+ * Updates hold roce->mutex, and so do lookups.
+ */
+static void mlx4_roce_gid_hash_rebuild(struct mlx4_roce_info *roce)
+{
+	int i;
+
+	for (i = 0; i < MLX4_PORT_HASH_SIZE; i++)
+		roce->gid_hash[i] = -1;
+
+	for (i = MLX4_ROCE_MAX_GIDS - 1; i >= 0; i--)
+		mlx4_port_hash_add(roce->gid_hash, roce->gid_next,
+				   mlx4_gid_bucket(roce->addr_table.addr[i].gid),
+				   i);
+}
+
+/* Lowest index holding gid outside [skip, skip + nskip), or -1 */
+static int mlx4_roce_gid_lookup(struct mlx4_roce_info *roce, const u8 *gid,
+				int skip, int nskip)
+{
+	int i;
+
+	for (i = roce->gid_hash[mlx4_gid_bucket(gid)]; i >= 0;
+	     i = roce->gid_next[i]) {
+		if (i >= skip && i < skip + nskip)
+			continue;
+		if (!memcmp(roce->addr_table.addr[i].gid, gid, MLX4_GID_LEN))
+			return i;
+	}
+
+	return -1;
+}
+
 void mlx4_init_roce_gid_table(struct mlx4_dev *dev,
 			      struct mlx4_roce_info *roce)
 {
@@ -82,6 +163,7 @@ void mlx4_init_roce_gid_table(struct mlx4_dev *dev,
 
 	mutex_init(&roce->mutex);
 	memset(addr_table, 0, sizeof(*addr_table));
+	mlx4_roce_gid_hash_rebuild(roce);
 }
 
 static int validate_index(struct mlx4_dev *dev,
@@ -101,7 +183,7 @@ static int find_index(struct mlx4_dev *dev,
 {
 	int i;
 
-	for (i = 0; i < MLX4_MAX_MAC_NUM; i++) {
+	for (i = table->hash[mlx4_mac_bucket(mac)]; i >= 0; i = table->next[i]) {
 		if (table->refs[i] &&
 		    (MLX4_MAC_MASK & mac) ==
 		    (MLX4_MAC_MASK & be64_to_cpu(table->entries[i])))
@@ -140,7 +222,7 @@ int mlx4_find_cached_mac(struct mlx4_dev *dev, u8 port, u64 mac, int *idx)
 	struct mlx4_mac_table *table = &info->mac_table;
 	int i;
 
-	for (i = 0; i < MLX4_MAX_MAC_NUM; i++) {
+	for (i = table->hash[mlx4_mac_bucket(mac)]; i >= 0; i = table->next[i]) {
 		if (!table->refs[i])
 			continue;
 
@@ -159,36 +241,29 @@ int __mlx4_register_mac(struct mlx4_dev *dev, u8 port, u64 mac)
 	struct mlx4_port_info *info = &mlx4_priv(dev)->port[port];
 	struct mlx4_mac_table *table = &info->mac_table;
 	int i, err = 0;
-	int free = -1;
+	int free;
 
 	mlx4_dbg(dev, "Registering MAC: 0x%llx for port %d\n",
 		 (unsigned long long) mac, port);
 
 	mutex_lock(&table->mutex);
-	for (i = 0; i < MLX4_MAX_MAC_NUM; i++) {
-		if (!table->refs[i]) {
-			if (free < 0)
-				free = i;
-			continue;
-		}
-
-		if ((MLX4_MAC_MASK & mac) ==
-		     (MLX4_MAC_MASK & be64_to_cpu(table->entries[i]))) {
-			/* MAC already registered, increment ref count */
-			err = i;
-			++table->refs[i];
-			goto out;
-		}
+	i = find_index(dev, table, mac);
+	if (i >= 0) {
+		/* MAC already registered, increment ref count */
+		err = i;
+		++table->refs[i];
+		goto out;
 	}
 
-	mlx4_dbg(dev, "Free MAC index is %d\n", free);
-
 	if (table->total == table->max) {
 		/* No free mac entries */
 		err = -ENOSPC;
 		goto out;
 	}
 
+	free = find_first_zero_bit(table->used, MLX4_MAX_MAC_NUM);
+	mlx4_dbg(dev, "Free MAC index is %d\n", free);
+
 	/* Register new MAC */
 	table->entries[free] = cpu_to_be64(mac | MLX4_MAC_VALID);
 
@@ -200,6 +275,8 @@ int __mlx4_register_mac(struct mlx4_dev *dev, u8 port, u64 mac)
 		goto out;
 	}
 	table->refs[free] = 1;
+	set_bit(free, table->used);
+	mlx4_port_hash_add(table->hash, table->next, mlx4_mac_bucket(mac), free);
 	err = free;
 	++table->total;
 out:
@@ -268,6 +345,8 @@ void __mlx4_unregister_mac(struct mlx4_dev *dev, u8 port, u64 mac)
 		goto out;
 	}
 
+	mlx4_port_hash_del(table->hash, table->next, mlx4_mac_bucket(mac), index);
+	clear_bit(index, table->used);
 	table->entries[index] = 0;
 	mlx4_set_port_mac_table(dev, port, table->entries);
 	--table->total;
@@ -314,6 +393,9 @@ int __mlx4_replace_mac(struct mlx4_dev *dev, u8 port, int qpn, u64 new_mac)
 	if (err)
 		goto out;
 
+	mlx4_port_hash_del(table->hash, table->next,
+			   mlx4_mac_bucket(be64_to_cpu(table->entries[index])),
+			   index);
 	table->entries[index] = cpu_to_be64(new_mac | MLX4_MAC_VALID);
 
 	err = mlx4_set_port_mac_table(dev, port, table->entries);
@@ -321,7 +403,10 @@ int __mlx4_replace_mac(struct mlx4_dev *dev, u8 port, int qpn, u64 new_mac)
 		mlx4_err(dev, "Failed adding MAC: 0x%llx\n",
 			 (unsigned long long) new_mac);
 		table->entries[index] = 0;
+		goto out;
 	}
+	mlx4_port_hash_add(table->hash, table->next, mlx4_mac_bucket(new_mac),
+			   index);
 out:
 	mutex_unlock(&table->mutex);
 	return err;
@@ -355,7 +440,7 @@ int mlx4_find_cached_vlan(struct mlx4_dev *dev, u8 port, u16 vid, int *idx)
 	struct mlx4_vlan_table *table = &mlx4_priv(dev)->port[port].vlan_table;
 	int i;
 
-	for (i = 0; i < MLX4_MAX_VLAN_NUM; ++i) {
+	for (i = table->hash[mlx4_vlan_bucket(vid)]; i >= 0; i = table->next[i]) {
 		if (table->refs[i] &&
 		    (vid == (MLX4_VLAN_MASK &
 			      be32_to_cpu(table->entries[i])))) {
@@ -374,7 +459,7 @@ int __mlx4_register_vlan(struct mlx4_dev *dev, u8 port, u16 vlan,
 {
 	struct mlx4_vlan_table *table = &mlx4_priv(dev)->port[port].vlan_table;
 	int i, err = 0;
-	int free = -1;
+	int free;
 
 	mutex_lock(&table->mutex);
 
@@ -384,23 +469,17 @@ int __mlx4_register_vlan(struct mlx4_dev *dev, u8 port, u16 vlan,
 		goto out;
 	}
 
-	for (i = MLX4_VLAN_REGULAR; i < MLX4_MAX_VLAN_NUM; i++) {
-		if (free < 0 && (table->refs[i] == 0)) {
-			free = i;
-			continue;
-		}
-
-		if (table->refs[i] &&
-		    (vlan == (MLX4_VLAN_MASK &
-			      be32_to_cpu(table->entries[i])))) {
-			/* Vlan already registered, increase references count */
-			*index = i;
-			++table->refs[i];
-			goto out;
-		}
+	if (!mlx4_find_cached_vlan(dev, port, vlan, &i) &&
+	    i >= MLX4_VLAN_REGULAR) {
+		/* Vlan already registered, increase references count */
+		*index = i;
+		++table->refs[i];
+		goto out;
 	}
 
-	if (free < 0) {
+	free = find_next_zero_bit(table->used, MLX4_MAX_VLAN_NUM,
+				  MLX4_VLAN_REGULAR);
+	if (free >= MLX4_MAX_VLAN_NUM) {
 		err = -ENOMEM;
 		goto out;
 	}
@@ -417,6 +496,9 @@ int __mlx4_register_vlan(struct mlx4_dev *dev, u8 port, u16 vlan,
 		goto out;
 	}
 
+	set_bit(free, table->used);
+	mlx4_port_hash_add(table->hash, table->next, mlx4_vlan_bucket(vlan),
+			   free);
 	*index = free;
 	++table->total;
 out:
@@ -467,6 +549,9 @@ void __mlx4_unregister_vlan(struct mlx4_dev *dev, u8 port, u16 vlan)
 			 table->refs[index], index);
 		goto out;
 	}
+	mlx4_port_hash_del(table->hash, table->next, mlx4_vlan_bucket(vlan),
+			   index);
+	clear_bit(index, table->used);
 	table->entries[index] = 0;
 	mlx4_set_port_vlan_table(dev, port, table->entries);
 	--table->total;
@@ -621,6 +706,7 @@ static int mlx4_reset_roce_port_gids(struct mlx4_dev *dev, int slave,
 	/* Zero-out gids belonging to that slave in the port GID table */
 	for (i = 0, offset = base; i < num_gids; offset++, i++)
 		memcpy(t->addr[offset].gid, &mlx4_zgid, MLX4_GID_LEN);
+	mlx4_roce_gid_hash_rebuild(&priv->port[port].roce);
 
 	err = mlx4_update_roce_addr_table(dev, port, t, MLX4_CMD_NATIVE);
 	mutex_unlock(&(priv->port[port].roce.mutex));
@@ -717,21 +803,6 @@ static inline bool roce_table_entry_is_valid(struct mlx4_dev *dev, int inmod, vo
 	}
 }
 
-static inline bool roce_table_entry_has_gid(int inmod, void *e, u8 *gid)
-{
-	struct roce_gid_table_mbox_entry *gid_e = (struct roce_gid_table_mbox_entry *)e;
-	struct roce_adr_table_mbox_entry *adr_e = (struct roce_adr_table_mbox_entry *)e;
-
-	switch (inmod) {
-	case MLX4_SET_PORT_GID_TABLE:
-		return memcmp(gid_e->gid, gid, MLX4_GID_LEN) ? false : true;
-	case MLX4_SET_PORT_ROCE_ADDR:
-		return memcmp(adr_e->gid, gid, MLX4_GID_LEN) ? false : true;
-	default:
-		return false;
-	}
-}
-
 bool roce_table_entry_is_eq(int inmod, void *e1, void *e2)
 {
 	struct roce_gid_table_mbox_entry *gid_e1 = (struct roce_gid_table_mbox_entry *)e1;
@@ -951,26 +1022,25 @@ static int mlx4_common_set_port(struct mlx4_dev *dev, int slave, u32 in_mod,
 				}
 			}
 			mutex_lock(&(priv->port[port].roce.mutex));
-			/* check for duplicates with other VFs */
-			for (i = 0; i < MLX4_ROCE_MAX_GIDS; i++) {
-				struct mlx4_roce_addr *a = &priv->port[port].roce.addr_table.addr[i];
-
-				if (i >= base && i < base + num_gids)
-					continue; /* don't compare to slave's current gids */
+			/* check for duplicates with other VFs, skipping the
+			 * slave's current gids
+			 */
+			mbox = (void *)(inbox->buf);
+			for (j = 0;
+			     j < num_gids;
+			     j++, mbox = roce_table_entry_next(in_modifier, mbox)) {
+				struct mlx4_roce_addr a;
 
-				if (!memcmp(a->gid, mlx4_zgid, MLX4_GID_LEN))
+				if (roce_table_entry_is_empty(in_modifier, mbox))
 					continue;
 
-				mbox = (void *)(inbox->buf);
-				for (j = 0;
-				     j < num_gids;
-				     j++, mbox = roce_table_entry_next(in_modifier, mbox)) {
-					if (roce_table_entry_has_gid(in_modifier, mbox, a->gid)) {
-						mutex_unlock(&(priv->port[port].roce.mutex));
-						pr_err("Duplicate GID for slave %d with another slave\n", slave);
-						return -EINVAL;
-					}
-
+				roce_table_entry_copy(in_modifier, mbox, &a);
+				if (mlx4_roce_gid_lookup(&priv->port[port].roce,
+							 a.gid, base,
+							 num_gids) >= 0) {
+					mutex_unlock(&(priv->port[port].roce.mutex));
+					pr_err("Duplicate GID for slave %d with another slave\n", slave);
+					return -EINVAL;
 				}
 			}
 			/* add GIDs to HW */
@@ -988,6 +1058,7 @@ static int mlx4_common_set_port(struct mlx4_dev *dev, int slave, u32 in_mod,
 				if (in_modifier == MLX4_SET_PORT_GID_TABLE)
 					a->type = slave_st->slave_gid_type;
 			}
+			mlx4_roce_gid_hash_rebuild(&priv->port[port].roce);
 			mutex_unlock(&(priv->port[port].roce.mutex));
 			err = mlx4_update_roce_addr_table(dev, port, &priv->port[port].roce.addr_table, MLX4_CMD_NATIVE);
 			return err;
@@ -1379,14 +1450,10 @@ int mlx4_get_slave_from_roce_gid(struct mlx4_dev *dev, int port, u8 *gid,
 	num_vfs = bitmap_weight(slaves_pport.slaves,
 				dev->persist->num_vfs + 1) - 1;
 
-	for (i = 0; i < MLX4_ROCE_MAX_GIDS; i++) {
-		struct mlx4_roce_addr *a = &priv->port[port].roce.addr_table.addr[i];
-
-		if (!memcmp(a->gid, gid, MLX4_GID_LEN)) {
-			found_ix = i;
-			break;
-		}
-	}
+	/* The hash chains are relinked on every GID table update */
+	mutex_lock(&priv->port[port].roce.mutex);
+	found_ix = mlx4_roce_gid_lookup(&priv->port[port].roce, gid, 0, 0);
+	mutex_unlock(&priv->port[port].roce.mutex);
 
 	if (found_ix >= 0) {
 		/* Calculate a slave_gid which is the slave number in the gid
@@ -460,6 +460,96 @@ void mlx4_init_quotas(struct mlx4_dev *dev)
 	dev->quotas.mpt =
 		priv->mfunc.master.res_tracker.res_alloc[RES_MPT].quota[pf];
 }
+/* The tracker lock is taken per resource type, so VFs working on different
+ * object types (e.g. QPs and MTTs) no longer serialize on one device-wide
+ * lock. Hold times are accounted per type.
+ */
+static void tracker_lock(struct mlx4_dev *dev, enum mlx4_resource type)
+{
+	struct mlx4_tracker_lock *tl = mlx4_tlock(dev, type);
+
+	spin_lock(&tl->lock);
+	tl->stamp = local_clock();
+}
+
+static void tracker_unlock(struct mlx4_dev *dev, enum mlx4_resource type)
+{
+	struct mlx4_tracker_lock *tl = mlx4_tlock(dev, type);
+	u64 held = local_clock() - tl->stamp;
+
+	tl->acquired++;
+	tl->hold_ns += held;
+	if (held > tl->max_hold_ns)
+		tl->max_hold_ns = held;
+	spin_unlock(&tl->lock);
+}
+
+static void tracker_lock_irq(struct mlx4_dev *dev, enum mlx4_resource type)
+{
+	local_irq_disable();
+	tracker_lock(dev, type);
+}
+
+static void tracker_unlock_irq(struct mlx4_dev *dev, enum mlx4_resource type)
+{
+	tracker_unlock(dev, type);
+	local_irq_enable();
+}
+
+const char *mlx4_resource_type_to_str(enum mlx4_resource t)
+{
+	switch (t) {
+	case RES_QP:
+		return "QP";
+	case RES_CQ:
+		return "CQ";
+	case RES_SRQ:
+		return "SRQ";
+	case RES_XRCD:
+		return "XRCD";
+	case RES_MPT:
+		return "MPT";
+	case RES_MTT:
+		return "MTT";
+	case RES_MAC:
+		return "MAC";
+	case RES_VLAN:
+		return "VLAN";
+	case RES_COUNTER:
+		return "COUNTER";
+	case RES_FS_RULE:
+		return "FS_RULE";
+	case RES_EQ:
+		return "EQ";
+	default:
+		return "INVALID RESOURCE";
+	}
+}
+
+static ssize_t show_tracker_stats(struct device *d,
+				  struct device_attribute *attr, char *buf)
+{
+	struct mlx4_priv *priv = container_of(attr, struct mlx4_priv,
+					      mfunc.master.res_tracker.stats_attr);
+	struct mlx4_tracker_lock *tl;
+	ssize_t len = 0;
+	int t;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "type      acquired  avg_hold_ns  max_hold_ns\n");
+	for (t = 0; t < MLX4_NUM_OF_RESOURCE_TYPE; t++) {
+		tl = mlx4_tlock(&priv->dev, t);
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%-8s %9llu %12llu %12llu\n",
+				 mlx4_resource_type_to_str(t), tl->acquired,
+				 tl->acquired ?
+				 div64_u64(tl->hold_ns, tl->acquired) : 0,
+				 tl->max_hold_ns);
+	}
+
+	return len;
+}
+
 int mlx4_init_resource_tracker(struct mlx4_dev *dev)
 {
 	struct mlx4_priv *priv = mlx4_priv(dev);
@@ -595,7 +685,18 @@ int mlx4_init_resource_tracker(struct mlx4_dev *dev)
 			}
 		}
 	}
-	spin_lock_init(&priv->mfunc.master.res_tracker.lock);
+	for (t = 0; t < MLX4_NUM_OF_RESOURCE_TYPE; t++)
+		spin_lock_init(&mlx4_tlock(dev, t)->lock);
+
+	sysfs_attr_init(&priv->mfunc.master.res_tracker.stats_attr.attr);
+	priv->mfunc.master.res_tracker.stats_attr.attr.name = "tracker_stats";
+	priv->mfunc.master.res_tracker.stats_attr.attr.mode = S_IRUGO;
+	priv->mfunc.master.res_tracker.stats_attr.show = show_tracker_stats;
+	if (device_create_file(&dev->persist->pdev->dev,
+			       &priv->mfunc.master.res_tracker.stats_attr)) {
+		mlx4_warn(dev, "Failed to create resource tracker stats file\n");
+		priv->mfunc.master.res_tracker.stats_attr.attr.name = NULL;
+	}
 	return 0;
 
 no_mem_err:
@@ -642,6 +743,10 @@ void mlx4_free_resource_tracker(struct mlx4_dev *dev,
 			}
 			kfree(priv->mfunc.master.res_tracker.slave_list);
 			priv->mfunc.master.res_tracker.slave_list = NULL;
+			if (priv->mfunc.master.res_tracker.stats_attr.attr.name)
+				device_remove_file(&dev->persist->pdev->dev,
+						   &priv->mfunc.master.res_tracker.stats_attr);
+			priv->mfunc.master.res_tracker.stats_attr.attr.name = NULL;
 		}
 	}
 }
@@ -811,36 +916,6 @@ static int mpt_mask(struct mlx4_dev *dev)
 	return dev->caps.num_mpts - 1;
 }
 
-const char *mlx4_resource_type_to_str(enum mlx4_resource t)
-{
-	switch (t) {
-	case RES_QP:
-		return "QP";
-	case RES_CQ:
-		return "CQ";
-	case RES_SRQ:
-		return "SRQ";
-	case RES_XRCD:
-		return "XRCD";
-	case RES_MPT:
-		return "MPT";
-	case RES_MTT:
-		return "MTT";
-	case RES_MAC:
-		return "MAC";
-	case RES_VLAN:
-		return "VLAN";
-	case RES_COUNTER:
-		return "COUNTER";
-	case RES_FS_RULE:
-		return "FS_RULE";
-	case RES_EQ:
-		return "EQ";
-	default:
-		return "INVALID RESOURCE";
-	}
-}
-
 static void *find_res(struct mlx4_dev *dev, u64 res_id,
 		      enum mlx4_resource type)
 {
@@ -857,7 +932,7 @@ static int _get_res(struct mlx4_dev *dev, int slave, u64 res_id,
 	struct res_common *r;
 	int err = 0;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	r = find_res(dev, res_id, type);
 	if (!r) {
 		err = -ENONET;
@@ -886,7 +961,7 @@ static int _get_res(struct mlx4_dev *dev, int slave, u64 res_id,
 		*((struct res_common **)res) = r;
 
 exit:
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 	return err;
 }
 
@@ -904,14 +979,14 @@ int mlx4_get_slave_from_resource_id(struct mlx4_dev *dev,
 
 	if (type == RES_QP)
 		id &= 0x7fffff;
-	spin_lock(mlx4_tlock(dev));
+	tracker_lock(dev, type);
 
 	r = find_res(dev, id, type);
 	if (r) {
 		*slave = r->owner;
 		err = 0;
 	}
-	spin_unlock(mlx4_tlock(dev));
+	tracker_unlock(dev, type);
 
 	return err;
 }
@@ -921,13 +996,13 @@ static void put_res(struct mlx4_dev *dev, int slave, u64 res_id,
 {
 	struct res_common *r;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	r = find_res(dev, res_id, type);
 	if (r) {
 		r->state = r->from_state;
 		r->func_name = "";
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 }
 
 static struct res_common *alloc_qp_tr(int id)
@@ -1135,7 +1210,7 @@ static int add_res_range(struct mlx4_dev *dev, int slave, u64 base, int count,
 		}
 	}
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	for (i = 0; i < count; ++i) {
 		if (find_res(dev, base + i, type)) {
 			err = -EEXIST;
@@ -1147,7 +1222,7 @@ static int add_res_range(struct mlx4_dev *dev, int slave, u64 base, int count,
 		list_add_tail(&res_arr[i]->list,
 			      &tracker->slave_list[slave].res_list[type]);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 	kfree(res_arr);
 
 	return 0;
@@ -1158,7 +1233,7 @@ undo:
 		list_del_init(&res_arr[i]->list);
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 
 	for (i = 0; i < count; ++i)
 		kfree(res_arr[i]);
@@ -1306,7 +1381,7 @@ static int rem_res_range(struct mlx4_dev *dev, int slave, u64 base, int count,
 	struct mlx4_resource_tracker *tracker = &priv->mfunc.master.res_tracker;
 	struct res_common *r;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	for (i = base; i < base + count; ++i) {
 		r = res_tracker_lookup(&tracker->res_tree[type], i);
 		if (!r) {
@@ -1331,7 +1406,7 @@ static int rem_res_range(struct mlx4_dev *dev, int slave, u64 base, int count,
 	err = 0;
 
 out:
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 
 	return err;
 }
@@ -1345,7 +1420,7 @@ static int qp_res_start_move_to(struct mlx4_dev *dev, int slave, int qpn,
 	struct res_qp *r;
 	int err = 0;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_QP);
 	r = res_tracker_lookup(&tracker->res_tree[RES_QP], qpn);
 	if (!r)
 		err = -ENOENT;
@@ -1396,7 +1471,7 @@ static int qp_res_start_move_to(struct mlx4_dev *dev, int slave, int qpn,
 		}
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_QP);
 
 	return err;
 }
@@ -1409,7 +1484,7 @@ static int mr_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 	struct res_mpt *r;
 	int err = 0;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_MPT);
 	r = res_tracker_lookup(&tracker->res_tree[RES_MPT], index);
 	if (!r)
 		err = -ENOENT;
@@ -1449,7 +1524,7 @@ static int mr_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 		}
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_MPT);
 
 	return err;
 }
@@ -1462,7 +1537,7 @@ static int eq_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 	struct res_eq *r;
 	int err = 0;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_EQ);
 	r = res_tracker_lookup(&tracker->res_tree[RES_EQ], index);
 	if (!r)
 		err = -ENOENT;
@@ -1497,7 +1572,7 @@ static int eq_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 		}
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_EQ);
 
 	return err;
 }
@@ -1510,7 +1585,7 @@ static int cq_res_start_move_to(struct mlx4_dev *dev, int slave, int cqn,
 	struct res_cq *r;
 	int err;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_CQ);
 	r = res_tracker_lookup(&tracker->res_tree[RES_CQ], cqn);
 	if (!r) {
 		err = -ENOENT;
@@ -1537,7 +1612,7 @@ static int cq_res_start_move_to(struct mlx4_dev *dev, int slave, int cqn,
 			*cq = r;
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_CQ);
 
 	return err;
 }
@@ -1550,7 +1625,7 @@ static int srq_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 	struct res_srq *r;
 	int err = 0;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_SRQ);
 	r = res_tracker_lookup(&tracker->res_tree[RES_SRQ], index);
 	if (!r) {
 		err = -ENOENT;
@@ -1573,7 +1648,7 @@ static int srq_res_start_move_to(struct mlx4_dev *dev, int slave, int index,
 			*srq = r;
 	}
 
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_SRQ);
 
 	return err;
 }
@@ -1585,11 +1660,11 @@ static void res_abort_move(struct mlx4_dev *dev, int slave,
 	struct mlx4_resource_tracker *tracker = &priv->mfunc.master.res_tracker;
 	struct res_common *r;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	r = res_tracker_lookup(&tracker->res_tree[type], id);
 	if (r && (r->owner == slave))
 		r->state = r->from_state;
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 }
 
 static void res_end_move(struct mlx4_dev *dev, int slave,
@@ -1599,11 +1674,11 @@ static void res_end_move(struct mlx4_dev *dev, int slave,
 	struct mlx4_resource_tracker *tracker = &priv->mfunc.master.res_tracker;
 	struct res_common *r;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	r = res_tracker_lookup(&tracker->res_tree[type], id);
 	if (r && (r->owner == slave))
 		r->state = r->to_state;
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 }
 
 static int valid_reserved(struct mlx4_dev *dev, int slave, int qpn)
@@ -2973,7 +3048,7 @@ static int get_containing_mtt(struct mlx4_dev *dev, int slave, int start,
 	struct res_mtt *mtt;
 	int err = -EINVAL;
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_MTT);
 	list_for_each_entry(mtt, &tracker->slave_list[slave].res_list[RES_MTT],
 			    com.list) {
 		if (!check_mtt_range(dev, slave, start, len, mtt)) {
@@ -2984,7 +3059,7 @@ static int get_containing_mtt(struct mlx4_dev *dev, int slave, int start,
 			break;
 		}
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_MTT);
 
 	return err;
 }
@@ -4378,7 +4453,7 @@ static int _move_all_busy(struct mlx4_dev *dev, int slave,
 	int busy;
 
 	busy = 0;
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, type);
 	list_for_each_entry_safe(r, tmp, rlist, list) {
 		if (r->owner == slave) {
 			if (!r->removing) {
@@ -4397,7 +4472,7 @@ static int _move_all_busy(struct mlx4_dev *dev, int slave,
 			}
 		}
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, type);
 
 	return busy;
 }
@@ -4440,9 +4515,9 @@ static void rem_slave_qps(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_qps: Could not move all qps to busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_QP);
 	list_for_each_entry_safe(qp, tmp, qp_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_QP);
 		if (qp->com.owner == slave) {
 			qpn = qp->com.res_id;
 			detach_qp(dev, slave, qp);
@@ -4450,11 +4525,11 @@ static void rem_slave_qps(struct mlx4_dev *dev, int slave)
 			while (state != 0) {
 				switch (state) {
 				case RES_QP_RESERVED:
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_QP);
 					rb_erase(&qp->com.node,
 						 &tracker->res_tree[RES_QP]);
 					list_del(&qp->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_QP);
 					if (!valid_reserved(dev, slave, qpn)) {
 						__mlx4_qp_release_range(dev, qpn, 1);
 						mlx4_release_resource(dev, slave,
@@ -4490,9 +4565,9 @@ static void rem_slave_qps(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_QP);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_QP);
 }
 
 static void rem_slave_srqs(struct mlx4_dev *dev, int slave)
@@ -4514,9 +4589,9 @@ static void rem_slave_srqs(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_srqs: Could not move all srqs - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_SRQ);
 	list_for_each_entry_safe(srq, tmp, srq_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_SRQ);
 		if (srq->com.owner == slave) {
 			srqn = srq->com.res_id;
 			state = srq->com.from_state;
@@ -4524,11 +4599,11 @@ static void rem_slave_srqs(struct mlx4_dev *dev, int slave)
 				switch (state) {
 				case RES_SRQ_ALLOCATED:
 					__mlx4_srq_free_icm(dev, srqn);
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_SRQ);
 					rb_erase(&srq->com.node,
 						 &tracker->res_tree[RES_SRQ]);
 					list_del(&srq->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_SRQ);
 					mlx4_release_resource(dev, slave,
 							      RES_SRQ, 1, 0);
 					kfree(srq);
@@ -4556,9 +4631,9 @@ static void rem_slave_srqs(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_SRQ);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_SRQ);
 }
 
 static void rem_slave_cqs(struct mlx4_dev *dev, int slave)
@@ -4580,9 +4655,9 @@ static void rem_slave_cqs(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_cqs: Could not move all cqs - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_CQ);
 	list_for_each_entry_safe(cq, tmp, cq_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_CQ);
 		if (cq->com.owner == slave && !atomic_read(&cq->ref_count)) {
 			cqn = cq->com.res_id;
 			state = cq->com.from_state;
@@ -4590,11 +4665,11 @@ static void rem_slave_cqs(struct mlx4_dev *dev, int slave)
 				switch (state) {
 				case RES_CQ_ALLOCATED:
 					__mlx4_cq_free_icm(dev, cqn);
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_CQ);
 					rb_erase(&cq->com.node,
 						 &tracker->res_tree[RES_CQ]);
 					list_del(&cq->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_CQ);
 					mlx4_release_resource(dev, slave,
 							      RES_CQ, 1, 0);
 					kfree(cq);
@@ -4619,9 +4694,9 @@ static void rem_slave_cqs(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_CQ);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_CQ);
 }
 
 static void rem_slave_mrs(struct mlx4_dev *dev, int slave)
@@ -4643,9 +4718,9 @@ static void rem_slave_mrs(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_mrs: Could not move all mpts - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_MPT);
 	list_for_each_entry_safe(mpt, tmp, mpt_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_MPT);
 		if (mpt->com.owner == slave) {
 			mptn = mpt->com.res_id;
 			state = mpt->com.from_state;
@@ -4653,11 +4728,11 @@ static void rem_slave_mrs(struct mlx4_dev *dev, int slave)
 				switch (state) {
 				case RES_MPT_RESERVED:
 					__mlx4_mpt_release(dev, mpt->key);
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_MPT);
 					rb_erase(&mpt->com.node,
 						 &tracker->res_tree[RES_MPT]);
 					list_del(&mpt->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_MPT);
 					mlx4_release_resource(dev, slave,
 							      RES_MPT, 1, 0);
 					kfree(mpt);
@@ -4687,9 +4762,9 @@ static void rem_slave_mrs(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_MPT);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_MPT);
 }
 
 static void rem_slave_mtts(struct mlx4_dev *dev, int slave)
@@ -4711,9 +4786,9 @@ static void rem_slave_mtts(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_mtts: Could not move all mtts  - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_MTT);
 	list_for_each_entry_safe(mtt, tmp, mtt_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_MTT);
 		if (mtt->com.owner == slave) {
 			base = mtt->com.res_id;
 			state = mtt->com.from_state;
@@ -4722,11 +4797,11 @@ static void rem_slave_mtts(struct mlx4_dev *dev, int slave)
 				case RES_MTT_ALLOCATED:
 					__mlx4_free_mtt_range(dev, base,
 							      mtt->order);
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_MTT);
 					rb_erase(&mtt->com.node,
 						 &tracker->res_tree[RES_MTT]);
 					list_del(&mtt->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_MTT);
 					mlx4_release_resource(dev, slave, RES_MTT,
 							      1 << mtt->order, 0);
 					kfree(mtt);
@@ -4738,9 +4813,9 @@ static void rem_slave_mtts(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_MTT);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_MTT);
 }
 
 static void rem_slave_fs_rule(struct mlx4_dev *dev, int slave)
@@ -4761,9 +4836,9 @@ static void rem_slave_fs_rule(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_fs_rule: Could not move all mtts to busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_FS_RULE);
 	list_for_each_entry_safe(fs_rule, tmp, fs_rule_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_FS_RULE);
 		if (fs_rule->com.owner == slave) {
 			base = fs_rule->com.res_id;
 			state = fs_rule->com.from_state;
@@ -4776,11 +4851,11 @@ static void rem_slave_fs_rule(struct mlx4_dev *dev, int slave)
 						       MLX4_CMD_TIME_CLASS_A,
 						       MLX4_CMD_NATIVE);
 
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_FS_RULE);
 					rb_erase(&fs_rule->com.node,
 						 &tracker->res_tree[RES_FS_RULE]);
 					list_del(&fs_rule->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_FS_RULE);
 					kfree(fs_rule);
 					state = 0;
 					break;
@@ -4790,9 +4865,9 @@ static void rem_slave_fs_rule(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_FS_RULE);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_FS_RULE);
 }
 
 static void rem_slave_eqs(struct mlx4_dev *dev, int slave)
@@ -4813,20 +4888,20 @@ static void rem_slave_eqs(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_eqs: Could not move all eqs - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_EQ);
 	list_for_each_entry_safe(eq, tmp, eq_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_EQ);
 		if (eq->com.owner == slave) {
 			eqn = eq->com.res_id;
 			state = eq->com.from_state;
 			while (state != 0) {
 				switch (state) {
 				case RES_EQ_RESERVED:
-					spin_lock_irq(mlx4_tlock(dev));
+					tracker_lock_irq(dev, RES_EQ);
 					rb_erase(&eq->com.node,
 						 &tracker->res_tree[RES_EQ]);
 					list_del(&eq->com.list);
-					spin_unlock_irq(mlx4_tlock(dev));
+					tracker_unlock_irq(dev, RES_EQ);
 					kfree(eq);
 					state = 0;
 					break;
@@ -4848,9 +4923,9 @@ static void rem_slave_eqs(struct mlx4_dev *dev, int slave)
 				}
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_EQ);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_EQ);
 }
 
 static void rem_slave_counters(struct mlx4_dev *dev, int slave)
@@ -4874,7 +4949,7 @@ static void rem_slave_xrcdns(struct mlx4_dev *dev, int slave)
 		mlx4_warn(dev, "rem_slave_xrcdns: Could not move all xrcdns - too busy for slave %d\n",
 			  slave);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_XRCD);
 	list_for_each_entry_safe(xrcd, tmp, xrcdn_list, com.list) {
 		if (xrcd->com.owner == slave) {
 			xrcdn = xrcd->com.res_id;
@@ -4884,7 +4959,7 @@ static void rem_slave_xrcdns(struct mlx4_dev *dev, int slave)
 			__mlx4_xrcd_free(dev, xrcdn);
 		}
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_XRCD);
 }
 
 void mlx4_delete_all_resources_for_slave(struct mlx4_dev *dev, int slave)
@@ -4973,20 +5048,20 @@ void mlx4_vf_immed_vlan_work_handler(struct work_struct *_work)
 	upd_context = mailbox->buf;
 	upd_context->qp_mask = cpu_to_be64(1ULL << MLX4_UPD_QP_MASK_VSD);
 
-	spin_lock_irq(mlx4_tlock(dev));
+	tracker_lock_irq(dev, RES_QP);
 	list_for_each_entry_safe(qp, tmp, qp_list, com.list) {
-		spin_unlock_irq(mlx4_tlock(dev));
+		tracker_unlock_irq(dev, RES_QP);
 		if (qp->com.owner == work->slave) {
 			if (qp->com.from_state != RES_QP_HW ||
 			    !qp->sched_queue ||  /* no INIT2RTR trans yet */
 			    mlx4_is_qp_reserved(dev, qp->local_qpn) ||
 			    qp->qpc_flags & (1 << MLX4_RSS_QPC_FLAG_OFFSET)) {
-				spin_lock_irq(mlx4_tlock(dev));
+				tracker_lock_irq(dev, RES_QP);
 				continue;
 			}
 			port = (qp->sched_queue >> 6 & 1) + 1;
 			if (port != work->port) {
-				spin_lock_irq(mlx4_tlock(dev));
+				tracker_lock_irq(dev, RES_QP);
 				continue;
 			}
 			if (MLX4_QP_ST_RC == ((qp->qpc_flags >> 16) & 0xff))
@@ -5033,9 +5108,9 @@ void mlx4_vf_immed_vlan_work_handler(struct work_struct *_work)
 				errors++;
 			}
 		}
-		spin_lock_irq(mlx4_tlock(dev));
+		tracker_lock_irq(dev, RES_QP);
 	}
-	spin_unlock_irq(mlx4_tlock(dev));
+	tracker_unlock_irq(dev, RES_QP);
 	mlx4_free_cmd_mailbox(dev, mailbox);
 
 	if (errors)
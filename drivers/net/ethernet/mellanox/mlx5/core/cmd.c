@@ -289,6 +289,7 @@ static int mlx5_internal_err_ret_value(struct mlx5_core_dev *dev, u16 op, u32 *s
 	case MLX5_CMD_OP_DESTROY_FLOW_TABLE:
 	case MLX5_CMD_OP_DESTROY_FLOW_GROUP:
 	case MLX5_CMD_OP_DELETE_FLOW_TABLE_ENTRY:
+	case MLX5_CMD_OP_DEALLOC_FLOW_COUNTER:
 	case MLX5_CMD_OP_SET_DC_CNAK_TRACE:
 		return MLX5_CMD_STAT_OK;
 
@@ -391,6 +392,8 @@ static int mlx5_internal_err_ret_value(struct mlx5_core_dev *dev, u16 op, u32 *s
 	case MLX5_CMD_OP_QUERY_FLOW_GROUP:
 	case MLX5_CMD_OP_SET_FLOW_TABLE_ENTRY:
 	case MLX5_CMD_OP_QUERY_FLOW_TABLE_ENTRY:
+	case MLX5_CMD_OP_ALLOC_FLOW_COUNTER:
+	case MLX5_CMD_OP_QUERY_FLOW_COUNTER:
 		*status = MLX5_DRIVER_STATUS_ABORTED;
 		*synd = MLX5_DRIVER_SYND;
 		return -EIO;
@@ -733,6 +736,15 @@ const char *mlx5_command_str(int command)
 	case MLX5_CMD_OP_DELETE_FLOW_TABLE_ENTRY:
 		return "DELETE_FLOW_TABLE_ENTRY";
 
+	case MLX5_CMD_OP_ALLOC_FLOW_COUNTER:
+		return "ALLOC_FLOW_COUNTER";
+
+	case MLX5_CMD_OP_DEALLOC_FLOW_COUNTER:
+		return "DEALLOC_FLOW_COUNTER";
+
+	case MLX5_CMD_OP_QUERY_FLOW_COUNTER:
+		return "QUERY_FLOW_COUNTER";
+
 	case MLX5_CMD_OP_MODIFY_NIC_VPORT_CONTEXT:
 		return "MODIFY_NIC_VPORT_CONTEXT";
 
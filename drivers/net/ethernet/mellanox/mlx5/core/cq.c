@@ -39,13 +39,25 @@
 #include <linux/mlx5/cq.h>
 #include "mlx5_core.h"
 
+static struct mlx5_core_cq *mlx5_cq_lookup(struct mlx5_cq_table *table,
+					  u32 cqn)
+{
+	struct mlx5_core_cq *cq;
+
+	cq = mlx5_rsc_array_lookup(&table->array, cqn);
+	if (likely(cq && cq->cqn == cqn))
+		return cq;
+
+	return radix_tree_lookup(&table->tree, cqn);
+}
+
 void mlx5_cq_completion(struct mlx5_core_dev *dev, u32 cqn)
 {
 	struct mlx5_core_cq *cq;
 	struct mlx5_cq_table *table = &dev->priv.cq_table;
 
 	rcu_read_lock();
-	cq = radix_tree_lookup(&table->tree, cqn);
+	cq = mlx5_cq_lookup(table, cqn);
 	if (unlikely(!cq)) {
 		rcu_read_unlock();
 		mlx5_core_warn(dev, "Completion event for bogus CQ 0x%x\n", cqn);
@@ -64,7 +76,7 @@ void mlx5_cq_event(struct mlx5_core_dev *dev, u32 cqn, int event_type)
 	struct mlx5_core_cq *cq;
 
 	rcu_read_lock();
-	cq = radix_tree_lookup(&table->tree, cqn);
+	cq = mlx5_cq_lookup(table, cqn);
 	if (!cq) {
 		rcu_read_unlock();
 		mlx5_core_warn(dev, "Async event for bogus CQ 0x%x\n", cqn);
@@ -100,6 +112,8 @@ int mlx5_core_create_cq(struct mlx5_core_dev *dev, struct mlx5_core_cq *cq,
 
 	spin_lock_irq(&table->lock);
 	err = radix_tree_insert(&table->tree, cq->cqn, cq);
+	if (!err)
+		mlx5_rsc_array_insert(&table->array, cq->cqn, cq);
 	spin_unlock_irq(&table->lock);
 	if (err)
 		goto err_cmd;
@@ -132,6 +146,7 @@ int mlx5_core_destroy_cq(struct mlx5_core_dev *dev, struct mlx5_core_cq *cq)
 
 	spin_lock_irq(&table->lock);
 	tmp = radix_tree_delete(&table->tree, cq->cqn);
+	mlx5_rsc_array_remove(&table->array, cq->cqn, cq);
 	spin_unlock_irq(&table->lock);
 	synchronize_rcu();
 	if (!tmp) {
@@ -228,6 +243,7 @@ int mlx5_init_cq_table(struct mlx5_core_dev *dev)
 	memset(table, 0, sizeof(*table));
 	spin_lock_init(&table->lock);
 	INIT_RADIX_TREE(&table->tree, GFP_ATOMIC);
+	mlx5_rsc_array_init(&table->array, MLX5_CAP_GEN(dev, log_max_cq));
 	err = mlx5_cq_debugfs_init(dev);
 
 	return err;
@@ -236,4 +252,5 @@ int mlx5_init_cq_table(struct mlx5_core_dev *dev)
 void mlx5_cleanup_cq_table(struct mlx5_core_dev *dev)
 {
 	mlx5_cq_debugfs_cleanup(dev);
+	mlx5_rsc_array_cleanup(&dev->priv.cq_table.array);
 }
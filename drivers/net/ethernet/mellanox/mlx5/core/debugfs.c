@@ -81,12 +81,26 @@ enum {
 	EQ_NUM_EQES,
 	EQ_INTR,
 	EQ_LOG_PG_SZ,
+	EQ_IRQS,
+	EQ_POLLS,
+	EQ_EQES,
+	EQ_EQES_PER_IRQ,
+	EQ_MAX_EQES_PER_IRQ,
+	EQ_IRQ_TIME_NS,
+	EQ_MAX_IRQ_TIME_NS,
 };
 
 static char *eq_fields[] = {
-	[EQ_NUM_EQES]	= "num_eqes",
-	[EQ_INTR]	= "intr",
-	[EQ_LOG_PG_SZ]	= "log_page_size",
+	[EQ_NUM_EQES]		= "num_eqes",
+	[EQ_INTR]		= "intr",
+	[EQ_LOG_PG_SZ]		= "log_page_size",
+	[EQ_IRQS]		= "irqs",
+	[EQ_POLLS]		= "polls",
+	[EQ_EQES]		= "eqes",
+	[EQ_EQES_PER_IRQ]	= "eqes_per_irq",
+	[EQ_MAX_EQES_PER_IRQ]	= "max_eqes_per_irq",
+	[EQ_IRQ_TIME_NS]	= "irq_time_ns",
+	[EQ_MAX_IRQ_TIME_NS]	= "max_irq_time_ns",
 };
 
 enum {
@@ -444,6 +458,25 @@ static u64 eq_read_field(struct mlx5_core_dev *dev, struct mlx5_eq *eq,
 	u64 param = 0;
 	int err;
 
+	/* software counters, no need to query the device */
+	switch (index) {
+	case EQ_IRQS:
+		return eq->stats.irqs;
+	case EQ_POLLS:
+		return eq->stats.polls;
+	case EQ_EQES:
+		return eq->stats.eqes;
+	case EQ_EQES_PER_IRQ:
+		return eq->stats.irqs ?
+		       div64_u64(eq->stats.eqes, eq->stats.irqs) : 0;
+	case EQ_MAX_EQES_PER_IRQ:
+		return eq->stats.max_eqes_per_irq;
+	case EQ_IRQ_TIME_NS:
+		return eq->stats.irq_time_ns;
+	case EQ_MAX_IRQ_TIME_NS:
+		return eq->stats.max_irq_time_ns;
+	}
+
 	out = kzalloc(sizeof(*out), GFP_KERNEL);
 	if (!out)
 		return param;
@@ -79,6 +79,7 @@
 
 #define MLX5E_TX_CQ_POLL_BUDGET        128
 #define MLX5E_UPDATE_STATS_INTERVAL    200 /* msecs */
+#define MLX5E_STATS_IDLE               (60 * HZ) /* stop polling when unread */
 #define MLX5E_SQ_BF_BUDGET             16
 
 #define MLX5E_INDICATE_WQE_ERR	       0xffff
@@ -317,6 +318,7 @@ struct mlx5e_pport_stats {
 
 static const char rq_stats_strings[][ETH_GSTRING_LEN] = {
 	"packets",
+	"bytes",
 	"csum_none",
 	"csum_good",
 	"csum_sw",
@@ -327,17 +329,19 @@ static const char rq_stats_strings[][ETH_GSTRING_LEN] = {
 
 struct mlx5e_rq_stats {
 	u64 packets;
+	u64 bytes;
 	u64 csum_none;
 	u64 csum_good;
 	u64 csum_sw;
 	u64 lro_packets;
 	u64 lro_bytes;
 	u64 wqe_err;
-#define NUM_RQ_STATS 7
+#define NUM_RQ_STATS 8
 };
 
 static const char sq_stats_strings[][ETH_GSTRING_LEN] = {
 	"packets",
+	"bytes",
 	"tso_packets",
 	"tso_bytes",
 	"csum_offload_none",
@@ -350,6 +354,7 @@ static const char sq_stats_strings[][ETH_GSTRING_LEN] = {
 
 struct mlx5e_sq_stats {
 	u64 packets;
+	u64 bytes;
 	u64 tso_packets;
 	u64 tso_bytes;
 	u64 csum_offload_none;
@@ -358,7 +363,16 @@ struct mlx5e_sq_stats {
 	u64 wake;
 	u64 dropped;
 	u64 nop;
-#define NUM_SQ_STATS 9
+#define NUM_SQ_STATS 10
+};
+
+/* Netdev totals summed from the channel software counters */
+struct mlx5e_sw_stats {
+	u64 rx_packets;
+	u64 rx_bytes;
+	u64 tx_packets;
+	u64 tx_bytes;
+	u64 tx_dropped;
 };
 
 static const char qcounter_stats_strings[][ETH_GSTRING_LEN] = {
@@ -760,6 +774,11 @@ struct mlx5e_priv {
 	struct work_struct         update_carrier_work;
 	struct work_struct         set_rx_mode_work;
 	struct delayed_work        update_stats_work;
+	unsigned long              stats_demand; /* jiffies of last read */
+	spinlock_t                 sw_stats_lock; /* channel stats vs close */
+	struct mlx5e_sw_stats      sw_stats_closed; /* of closed channels */
+	int                        sw_stats_first; /* live channels are */
+	int                        sw_stats_end;   /* [first, end) */
 
 	struct mlx5_core_dev      *mdev;
 	struct net_device         *netdev;
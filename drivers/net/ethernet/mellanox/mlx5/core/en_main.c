@@ -291,7 +291,11 @@ static void mlx5e_update_stats_work(struct work_struct *work)
 	struct mlx5e_priv *priv = container_of(dwork, struct mlx5e_priv,
 					       update_stats_work);
 	mutex_lock(&priv->state_lock);
-	if (test_bit(MLX5E_STATE_OPENED, &priv->state) && !priv->internal_error) {
+	/* Poll only while someone reads the counters; mlx5e_get_stats()
+	 * restarts the work when it has gone idle.
+	 */
+	if (test_bit(MLX5E_STATE_OPENED, &priv->state) && !priv->internal_error &&
+	    time_before(jiffies, priv->stats_demand + MLX5E_STATS_IDLE)) {
 		mlx5e_update_stats(priv);
 		schedule_delayed_work(dwork,
 				      msecs_to_jiffies(
@@ -1244,6 +1248,39 @@ err_napi_del:
 	return err;
 }
 
+static void mlx5e_add_channel_sw_stats(struct mlx5e_channel *c,
+				       struct mlx5e_sw_stats *s)
+{
+	struct mlx5e_sq_stats *sq_stats;
+	int tc;
+
+	s->rx_packets += c->rq.stats.packets;
+	s->rx_bytes   += c->rq.stats.bytes;
+	for (tc = 0; tc < c->num_tc; tc++) {
+		sq_stats = &c->sq[tc].stats;
+
+		s->tx_packets += sq_stats->packets;
+		s->tx_bytes   += sq_stats->bytes;
+		s->tx_dropped += sq_stats->dropped;
+	}
+}
+
+/* Keep the netdev totals monotonic across channel reopen: fold the
+ * final counters of a quiesced channel into sw_stats_closed and drop it
+ * from the live range read by mlx5e_get_stats() before it is freed.
+ */
+static void mlx5e_retire_channel_sw_stats(struct mlx5e_channel *c)
+{
+	struct mlx5e_priv *priv = c->priv;
+	unsigned long flags;
+
+	spin_lock_irqsave(&priv->sw_stats_lock, flags);
+	mlx5e_add_channel_sw_stats(c, &priv->sw_stats_closed);
+	if (c->ix < priv->sw_stats_end)
+		priv->sw_stats_first = c->ix + 1;
+	spin_unlock_irqrestore(&priv->sw_stats_lock, flags);
+}
+
 static void mlx5e_close_channel(struct mlx5e_channel *c)
 {
 	mlx5e_close_rq(&c->rq);
@@ -1252,6 +1289,7 @@ static void mlx5e_close_channel(struct mlx5e_channel *c)
 	mlx5e_close_cq(&c->rq.cq);
 	mlx5e_close_tx_cqs(c);
 	netif_napi_del(&c->napi);
+	mlx5e_retire_channel_sw_stats(c);
 	kfree(c);
 }
 
@@ -1385,6 +1423,11 @@ static int mlx5e_open_channels(struct mlx5e_priv *priv)
 		}
 	}
 
+	spin_lock_irq(&priv->sw_stats_lock);
+	priv->sw_stats_first = 0;
+	priv->sw_stats_end = nch;
+	spin_unlock_irq(&priv->sw_stats_lock);
+
 	return 0;
 
 err_close_channels:
@@ -1424,6 +1467,11 @@ static void mlx5e_close_channels(struct mlx5e_priv *priv)
 	for (i = 0; i < priv->params.num_channels; i++)
 		mlx5e_close_channel(priv->channel[i]);
 
+	spin_lock_irq(&priv->sw_stats_lock);
+	priv->sw_stats_first = 0;
+	priv->sw_stats_end = 0;
+	spin_unlock_irq(&priv->sw_stats_lock);
+
 	if (priv->counter_set_id >= 0) {
 		mlx5_vport_dealloc_q_counter(priv->mdev, priv->counter_set_id);
 		priv->counter_set_id = -1;
@@ -1850,6 +1898,7 @@ int mlx5e_open_locked(struct net_device *netdev)
 	mlx5e_update_carrier(priv);
 	mlx5e_set_rx_mode_core(priv);
 
+	priv->stats_demand = jiffies;
 	schedule_delayed_work(&priv->update_stats_work, 0);
 	err = mlx5e_sysfs_create(netdev);
 	if (err)
@@ -2015,20 +2064,39 @@ static struct net_device_stats *mlx5e_get_stats(struct net_device *dev)
 {
 	struct mlx5e_priv *priv = netdev_priv(dev);
 	struct mlx5e_vport_stats *vstats = &priv->stats.vport;
+	struct mlx5e_sw_stats sw;
+	unsigned long flags;
+	int i;
 
 #ifndef HAVE_NDO_GET_STATS64
 	struct net_device_stats *stats = &priv->netdev_stats;
 #endif
 
-	stats->rx_packets = vstats->rx_packets;
-	stats->rx_bytes   = vstats->rx_bytes;
-	stats->tx_packets = vstats->tx_packets;
-	stats->tx_bytes   = vstats->tx_bytes;
+	/* Error and multicast counters are from the last poll; resume
+	 * polling if it went idle.
+	 */
+	priv->stats_demand = jiffies;
+	if (test_bit(MLX5E_STATE_OPENED, &priv->state) &&
+	    !priv->internal_error &&
+	    !delayed_work_pending(&priv->update_stats_work))
+		schedule_delayed_work(&priv->update_stats_work, 0);
+
+	/* Packet and byte totals are summed from the channels directly */
+	spin_lock_irqsave(&priv->sw_stats_lock, flags);
+	sw = priv->sw_stats_closed;
+	for (i = priv->sw_stats_first; i < priv->sw_stats_end; i++)
+		mlx5e_add_channel_sw_stats(priv->channel[i], &sw);
+	spin_unlock_irqrestore(&priv->sw_stats_lock, flags);
+
+	stats->rx_packets = sw.rx_packets;
+	stats->rx_bytes   = sw.rx_bytes;
+	stats->tx_packets = sw.tx_packets;
+	stats->tx_bytes   = sw.tx_bytes;
 	stats->multicast  = vstats->rx_multicast_packets +
 			    vstats->tx_multicast_packets;
 	stats->tx_errors  = vstats->tx_error_packets;
 	stats->rx_errors  = vstats->rx_error_packets;
-	stats->tx_dropped = vstats->tx_queue_dropped;
+	stats->tx_dropped = sw.tx_dropped;
 	/* TODO: replace 0s with true values */
 	stats->rx_crc_errors = 0;
 	stats->rx_length_errors = 0;
@@ -2345,6 +2413,7 @@ static void mlx5e_build_netdev_priv(struct mlx5_core_dev *mdev,
 	priv->msg_level                    = MLX5E_MSG_LEVEL;
 
 	spin_lock_init(&priv->async_events_spinlock);
+	spin_lock_init(&priv->sw_stats_lock);
 	mutex_init(&priv->state_lock);
 
 	INIT_WORK(&priv->update_carrier_work, mlx5e_update_carrier_work);
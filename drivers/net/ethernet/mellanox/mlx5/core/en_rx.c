@@ -528,6 +528,7 @@ bool mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 		}
 
 		rq->stats.packets++;
+		rq->stats.bytes += bytes_recv;
 
 #if defined HAVE_VLAN_GRO_RECEIVE || defined HAVE_VLAN_HWACCEL_RX
                 prev_cqe = cqe;
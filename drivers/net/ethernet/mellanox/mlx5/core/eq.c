@@ -32,10 +32,15 @@
 
 #include <linux/interrupt.h>
 #include <linux/module.h>
+#include <linux/ktime.h>
 #include <linux/mlx5/driver.h>
 #include <linux/mlx5/cmd.h>
 #include "mlx5_core.h"
 
+static int eq_budget;
+module_param(eq_budget, int, 0644);
+MODULE_PARM_DESC(eq_budget, "Max EQEs handled per interrupt, the rest are handled from a tasklet. 0 means no limit (default)");
+
 enum {
 	MLX5_EQE_SIZE		= sizeof(struct mlx5_eqe),
 	MLX5_EQE_OWNER_INIT_VAL	= 0x1,
@@ -207,7 +212,12 @@ static void dump_eqe(struct mlx5_core_dev *dev, void *eqe)
 	}
 }
 
-static int mlx5_eq_int(struct mlx5_core_dev *dev, struct mlx5_eq *eq)
+/* Handle up to budget EQEs (no limit if budget <= 0). Returns the number
+ * of EQEs handled. The EQ is re-armed only when it was found empty, in
+ * which case *done is set; otherwise the caller must poll again.
+ */
+static int mlx5_eq_int(struct mlx5_core_dev *dev, struct mlx5_eq *eq,
+		       int budget, bool *done)
 {
 	struct mlx5_eqe *eqe;
 	int eqes_found = 0;
@@ -218,7 +228,14 @@ static int mlx5_eq_int(struct mlx5_core_dev *dev, struct mlx5_eq *eq)
 	u32 dctn;
 	u8 port;
 
-	while ((eqe = next_eqe_sw(eq))) {
+	*done = false;
+	while (budget <= 0 || eqes_found < budget) {
+		eqe = next_eqe_sw(eq);
+		if (!eqe) {
+			*done = true;
+			break;
+		}
+
 		/*
 		 * Make sure we read EQ entry contents after we've
 		 * checked the ownership bit.
@@ -324,7 +341,7 @@ static int mlx5_eq_int(struct mlx5_core_dev *dev, struct mlx5_eq *eq)
 		}
 
 		++eq->cons_index;
-		eqes_found = 1;
+		++eqes_found;
 		++set_ci;
 
 		/* The HCA will think the queue has overflowed if we
@@ -339,17 +356,50 @@ static int mlx5_eq_int(struct mlx5_core_dev *dev, struct mlx5_eq *eq)
 		}
 	}
 
-	eq_update_ci(eq, 1);
+	eq_update_ci(eq, *done);
 
 	return eqes_found;
 }
 
+static void mlx5_eq_tasklet(unsigned long data)
+{
+	struct mlx5_eq *eq = (struct mlx5_eq *)data;
+	bool done;
+	int n;
+
+	/* Handlers expect hard interrupt context */
+	local_irq_disable();
+	n = mlx5_eq_int(eq->dev, eq, eq_budget, &done);
+	local_irq_enable();
+
+	eq->stats.polls++;
+	eq->stats.eqes += n;
+	if (!done)
+		tasklet_schedule(&eq->tasklet);
+}
+
 static irqreturn_t mlx5_msix_handler(int irq, void *eq_ptr)
 {
 	struct mlx5_eq *eq = eq_ptr;
 	struct mlx5_core_dev *dev = eq->dev;
-
-	mlx5_eq_int(dev, eq);
+	s64 start = ktime_to_ns(ktime_get());
+	u64 delta;
+	bool done;
+	int n;
+
+	n = mlx5_eq_int(dev, eq, eq_budget, &done);
+	/* The EQ stays unarmed until the tasklet drains it */
+	if (!done)
+		tasklet_schedule(&eq->tasklet);
+
+	delta = ktime_to_ns(ktime_get()) - start;
+	eq->stats.irqs++;
+	eq->stats.eqes += n;
+	eq->stats.irq_time_ns += delta;
+	if (n > eq->stats.max_eqes_per_irq)
+		eq->stats.max_eqes_per_irq = n;
+	if (delta > eq->stats.max_irq_time_ns)
+		eq->stats.max_irq_time_ns = delta;
 
 	/* MSI-X vectors always belong to us */
 	return IRQ_HANDLED;
@@ -415,6 +465,8 @@ int mlx5_create_map_eq(struct mlx5_core_dev *dev, struct mlx5_eq *eq, u8 vecidx,
 	eq->irqn = vecidx;
 	eq->dev = dev;
 	eq->doorbell = uar->map + MLX5_EQ_DOORBEL_OFFSET;
+	memset(&eq->stats, 0, sizeof(eq->stats));
+	tasklet_init(&eq->tasklet, mlx5_eq_tasklet, (unsigned long)eq);
 	err = request_irq(priv->msix_arr[vecidx].vector, mlx5_msix_handler, 0,
 			  priv->irq_info[vecidx].name, eq);
 	if (err)
@@ -458,6 +510,7 @@ int mlx5_destroy_unmap_eq(struct mlx5_core_dev *dev, struct mlx5_eq *eq)
 		mlx5_core_warn(dev, "failed to destroy a previously created eq: eqn %d\n",
 			       eq->eqn);
 	synchronize_irq(priv->msix_arr[eq->irqn].vector);
+	tasklet_kill(&eq->tasklet);
 	mlx5_buf_free(dev, &eq->buf);
 
 	return err;
@@ -162,19 +162,22 @@ int mlx5_cmd_fs_set_fte(struct mlx5_core_dev *dev,
 			unsigned int index, unsigned int group_id,
 			unsigned int flow_tag,
 			unsigned short action, int dest_size,
-			struct list_head *dests)  /* mlx5_flow_desination */
+			struct list_head *dests,  /* mlx5_flow_desination */
+			struct mlx5_fc *counter)
 {
 	u32 out[MLX5_ST_SZ_DW(set_fte_out)];
 	u32 *in;
+	int counter_size = (action & MLX5_FLOW_CONTEXT_ACTION_COUNT) ? 1 : 0;
 	unsigned int inlen = MLX5_ST_SZ_BYTES(set_fte_in) +
-		dest_size * MLX5_ST_SZ_BYTES(dest_format_struct);
+		(dest_size + counter_size) *
+		MLX5_ST_SZ_BYTES(dest_format_struct);
 	struct mlx5_flow_rule *dst;
 	void *in_flow_context;
 	void *in_match_value;
 	void *in_dests;
 	int err;
 
-	if (!dev)
+	if (!dev || (counter_size && !counter))
 		return -EINVAL;
 
 	in = mlx5_vzalloc(inlen);
@@ -194,6 +197,8 @@ int mlx5_cmd_fs_set_fte(struct mlx5_core_dev *dev,
 	MLX5_SET(flow_context, in_flow_context, action, action);
 	MLX5_SET(flow_context, in_flow_context, destination_list_size,
 		 dest_size);
+	MLX5_SET(flow_context, in_flow_context, flow_counter_list_size,
+		 counter_size);
 	in_match_value = MLX5_ADDR_OF(flow_context, in_flow_context,
 				      match_value);
 	memcpy(in_match_value, match_val, MLX5_ST_SZ_BYTES(fte_match_param));
@@ -212,6 +217,10 @@ int mlx5_cmd_fs_set_fte(struct mlx5_core_dev *dev,
 		MLX5_SET(dest_format_struct, in_dests, destination_id, id);
 		in_dests += MLX5_ST_SZ_BYTES(dest_format_struct);
 	}
+	/* The counter list follows the destination list */
+	if (counter_size)
+		MLX5_SET(flow_counter_list, in_dests, flow_counter_id,
+			 counter->id);
 	memset(out, 0, sizeof(out));
 	err = mlx5_cmd_exec_check_status(dev, in, inlen, out,
 					 sizeof(out));
@@ -239,3 +248,65 @@ int mlx5_cmd_fs_delete_fte(struct mlx5_core_dev *dev,
 
 	return mlx5_cmd_exec_check_status(dev, in, sizeof(in), out, sizeof(out));
 }
+
+int mlx5_cmd_fc_alloc(struct mlx5_core_dev *dev, u16 *id)
+{
+	u32 in[MLX5_ST_SZ_DW(alloc_flow_counter_in)];
+	u32 out[MLX5_ST_SZ_DW(alloc_flow_counter_out)];
+	int err;
+
+	memset(in, 0, sizeof(in));
+	memset(out, 0, sizeof(out));
+
+	MLX5_SET(alloc_flow_counter_in, in, opcode,
+		 MLX5_CMD_OP_ALLOC_FLOW_COUNTER);
+
+	err = mlx5_cmd_exec_check_status(dev, in, sizeof(in), out,
+					 sizeof(out));
+	if (err)
+		return err;
+
+	*id = MLX5_GET(alloc_flow_counter_out, out, flow_counter_id);
+
+	return 0;
+}
+
+int mlx5_cmd_fc_free(struct mlx5_core_dev *dev, u16 id)
+{
+	u32 in[MLX5_ST_SZ_DW(dealloc_flow_counter_in)];
+	u32 out[MLX5_ST_SZ_DW(dealloc_flow_counter_out)];
+
+	memset(in, 0, sizeof(in));
+	memset(out, 0, sizeof(out));
+
+	MLX5_SET(dealloc_flow_counter_in, in, opcode,
+		 MLX5_CMD_OP_DEALLOC_FLOW_COUNTER);
+	MLX5_SET(dealloc_flow_counter_in, in, flow_counter_id, id);
+
+	return mlx5_cmd_exec_check_status(dev, in, sizeof(in), out,
+					  sizeof(out));
+}
+
+/* Query num consecutive counters starting at base_id in a single command.
+ * out must hold query_flow_counter_out followed by num traffic_counter
+ * entries.
+ */
+int mlx5_cmd_fc_bulk_query(struct mlx5_core_dev *dev, u16 base_id,
+			   int num, u32 *out, int outlen)
+{
+	u32 in[MLX5_ST_SZ_DW(query_flow_counter_in)];
+
+	if (outlen < MLX5_ST_SZ_BYTES(query_flow_counter_out) +
+		     num * MLX5_ST_SZ_BYTES(traffic_counter))
+		return -EINVAL;
+
+	memset(in, 0, sizeof(in));
+	memset(out, 0, outlen);
+
+	MLX5_SET(query_flow_counter_in, in, opcode,
+		 MLX5_CMD_OP_QUERY_FLOW_COUNTER);
+	MLX5_SET(query_flow_counter_in, in, flow_counter_id, base_id);
+	MLX5_SET(query_flow_counter_in, in, num_of_counters, num);
+
+	return mlx5_cmd_exec_check_status(dev, in, sizeof(in), out, outlen);
+}
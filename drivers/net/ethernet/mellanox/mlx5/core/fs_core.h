@@ -140,6 +140,25 @@ struct fs_debugfs_fte {
 	struct fs_debugfs_match_criteria	match_criteria;
 };
 
+struct mlx5_fc_cache {
+	u64					packets;
+	u64					bytes;
+	unsigned long				lastuse;
+};
+
+struct mlx5_fc {
+	struct rb_node				node;
+	struct list_head			list;
+	/* last values fetched by the bulk query */
+	struct mlx5_fc_cache			cache;
+	/* hardware values at the time the counter was taken from the pool */
+	u64					base_packets;
+	u64					base_bytes;
+	u16					id;
+	bool					deleted;
+	bool					dead;
+};
+
 struct fs_fte {
 	struct fs_base				base;
 	u32					val[MLX5_ST_SZ_DW(fte_match_param)];
@@ -148,6 +167,7 @@ struct fs_fte {
 	struct list_head			dests;
 	uint32_t				index; /* index in ft */
 	u8					action; /* MLX5_FLOW_CONTEXT_ACTION */
+	struct mlx5_fc				*counter;
 	struct fs_debugfs_fte			debugfs;
 };
 
@@ -389,7 +409,8 @@ int mlx5_cmd_fs_set_fte(struct mlx5_core_dev *dev,
 			unsigned int index, unsigned int group_id,
 			unsigned int flow_tag,
 			unsigned short action, int dest_size,
-			struct list_head *dests);  /* mlx5_flow_desination */
+			struct list_head *dests,  /* mlx5_flow_desination */
+			struct mlx5_fc *counter);
 
 int mlx5_cmd_fs_delete_fte(struct mlx5_core_dev *dev,
 			   enum fs_ft_type type, unsigned int table_id,
@@ -399,6 +420,19 @@ int mlx5_cmd_update_root_ft(struct mlx5_core_dev *dev,
 			    enum fs_ft_type type,
 			    unsigned int id);
 
+int mlx5_cmd_fc_alloc(struct mlx5_core_dev *dev, u16 *id);
+int mlx5_cmd_fc_free(struct mlx5_core_dev *dev, u16 id);
+int mlx5_cmd_fc_bulk_query(struct mlx5_core_dev *dev, u16 base_id,
+			   int num, u32 *out, int outlen);
+
+/* flow counters API */
+struct mlx5_fc *mlx5_fc_alloc(struct mlx5_core_dev *dev);
+void mlx5_fc_release(struct mlx5_core_dev *dev, struct mlx5_fc *counter);
+void mlx5_fc_query_cached(struct mlx5_fc *counter,
+			  u64 *packets, u64 *bytes, u64 *lastuse);
+int mlx5_init_fc_stats(struct mlx5_core_dev *dev);
+void mlx5_cleanup_fc_stats(struct mlx5_core_dev *dev);
+
 int mlx5_init_fs(struct mlx5_core_dev *dev);
 void mlx5_cleanup_fs(struct mlx5_core_dev *dev);
 #endif
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2013-2015, Mellanox Technologies. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/rbtree.h>
+#include <linux/mlx5/driver.h>
+#include "mlx5_core.h"
+#include "fs_core.h"
+
+#define MLX5_FC_STATS_PERIOD msecs_to_jiffies(1000)
+/* Bulk query base id and size must be aligned to 4 */
+#define MLX5_FC_BULK_QUERY_ALIGN 4
+/* Max number of released counters kept allocated for reuse */
+#define MLX5_FC_POOL_MAX 1024
+
+/* locking scheme:
+ *
+ * Counters are allocated and released from flow steering context, while
+ * their hardware values are fetched by a single delayed work which owns
+ * the counters rb tree. Allocation and release never touch the tree:
+ * - mlx5_fc_alloc() takes a counter from the pool (or from firmware) and
+ *   places it on addlist, the worker moves it into the tree.
+ * - mlx5_fc_release() only marks the counter deleted, the worker takes it
+ *   out of the tree after one more query (so its final values are known)
+ *   and returns it to the pool.
+ * Readers of a single counter never lock, they read the cached values the
+ * worker wrote on its last bulk query.
+ */
+
+static void mlx5_fc_stats_insert(struct rb_root *root, struct mlx5_fc *counter)
+{
+	struct rb_node **new = &root->rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*new) {
+		struct mlx5_fc *this = rb_entry(*new, struct mlx5_fc, node);
+		int result = counter->id - this->id;
+
+		parent = *new;
+		if (result < 0)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&counter->node, parent, new);
+	rb_insert_color(&counter->node, root);
+}
+
+static void mlx5_fc_free(struct mlx5_core_dev *dev, struct mlx5_fc *counter)
+{
+	int err;
+
+	err = mlx5_cmd_fc_free(dev, counter->id);
+	if (err)
+		mlx5_core_warn(dev, "failed to free flow counter %d, err %d\n",
+			       counter->id, err);
+	kfree(counter);
+}
+
+/* Fetch all the tracked counters whose id falls in one bulk window that
+ * starts at first. Returns the first node beyond the window.
+ */
+static struct rb_node *mlx5_fc_stats_query(struct mlx5_core_dev *dev,
+					   struct mlx5_fc *first,
+					   u16 last_id, u32 *out, int outlen)
+{
+	int bulk_max = dev->priv.fc_stats.bulk_query_max;
+	struct rb_node *node;
+	u16 afirst_id;
+	int num;
+	int err;
+
+	if (bulk_max < MLX5_FC_BULK_QUERY_ALIGN) {
+		/* No bulk support, one counter per command */
+		afirst_id = first->id;
+		num = 1;
+	} else {
+		afirst_id = first->id & ~(MLX5_FC_BULK_QUERY_ALIGN - 1);
+		num = min_t(int, bulk_max,
+			    ALIGN(last_id - afirst_id + 1,
+				  MLX5_FC_BULK_QUERY_ALIGN));
+	}
+
+	err = mlx5_cmd_fc_bulk_query(dev, afirst_id, num, out, outlen);
+	if (err) {
+		mlx5_core_warn(dev, "failed to query flow counters %d-%d, err %d\n",
+			       afirst_id, afirst_id + num - 1, err);
+		goto skip;
+	}
+
+	for (node = &first->node; node; node = rb_next(node)) {
+		struct mlx5_fc *counter = rb_entry(node, struct mlx5_fc, node);
+		struct mlx5_fc_cache *c = &counter->cache;
+		void *stats;
+		u64 packets;
+		u64 bytes;
+
+		if (counter->id >= afirst_id + num)
+			break;
+
+		stats = MLX5_ADDR_OF(query_flow_counter_out, out,
+				     flow_statistics[counter->id - afirst_id]);
+		packets = MLX5_GET64(traffic_counter, stats, packets);
+		bytes = MLX5_GET64(traffic_counter, stats, octets);
+
+		if (c->packets != packets) {
+			c->packets = packets;
+			c->bytes = bytes;
+			c->lastuse = jiffies;
+		}
+	}
+
+	return node;
+
+skip:
+	for (node = &first->node; node; node = rb_next(node)) {
+		struct mlx5_fc *counter = rb_entry(node, struct mlx5_fc, node);
+
+		if (counter->id >= afirst_id + num)
+			break;
+	}
+
+	return node;
+}
+
+static void mlx5_fc_stats_work(struct work_struct *work)
+{
+	struct mlx5_core_dev *dev = container_of(work, struct mlx5_core_dev,
+						 priv.fc_stats.work.work);
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+	int outlen = MLX5_ST_SZ_BYTES(query_flow_counter_out) +
+		     fc_stats->bulk_query_max *
+		     MLX5_ST_SZ_BYTES(traffic_counter);
+	unsigned long now = jiffies;
+	struct mlx5_fc *counter;
+	struct mlx5_fc *tmp;
+	struct rb_node *node;
+	LIST_HEAD(addlist);
+	LIST_HEAD(freelist);
+	u32 *out;
+
+	spin_lock(&fc_stats->addlist_lock);
+	list_splice_tail_init(&fc_stats->addlist, &addlist);
+	if (!list_empty(&addlist) || !RB_EMPTY_ROOT(&fc_stats->counters))
+		queue_delayed_work(fc_stats->wq, &fc_stats->work,
+				   fc_stats->sampling_interval);
+	spin_unlock(&fc_stats->addlist_lock);
+
+	mutex_lock(&fc_stats->counters_lock);
+	list_for_each_entry_safe(counter, tmp, &addlist, list) {
+		list_del_init(&counter->list);
+		mlx5_fc_stats_insert(&fc_stats->counters, counter);
+	}
+
+	if (time_before(now, fc_stats->next_query) ||
+	    RB_EMPTY_ROOT(&fc_stats->counters))
+		goto unlock;
+
+	/* Counters released before this query are frozen in hardware, so
+	 * the values fetched below are final and they may leave the tree.
+	 */
+	spin_lock(&fc_stats->addlist_lock);
+	for (node = rb_first(&fc_stats->counters); node; node = rb_next(node)) {
+		counter = rb_entry(node, struct mlx5_fc, node);
+		counter->dead = counter->deleted;
+	}
+	spin_unlock(&fc_stats->addlist_lock);
+
+	out = mlx5_vzalloc(outlen);
+	if (!out) {
+		mlx5_core_warn(dev, "failed to allocate flow counters outbox\n");
+		goto unlock;
+	}
+
+	counter = rb_entry(rb_last(&fc_stats->counters), struct mlx5_fc, node);
+	node = rb_first(&fc_stats->counters);
+	while (node)
+		node = mlx5_fc_stats_query(dev,
+					   rb_entry(node, struct mlx5_fc, node),
+					   counter->id, out, outlen);
+	kvfree(out);
+
+	node = rb_first(&fc_stats->counters);
+	while (node) {
+		counter = rb_entry(node, struct mlx5_fc, node);
+		node = rb_next(node);
+		if (!counter->dead)
+			continue;
+
+		rb_erase(&counter->node, &fc_stats->counters);
+		counter->dead = false;
+		counter->deleted = false;
+
+		spin_lock(&fc_stats->addlist_lock);
+		if (fc_stats->pool_size < MLX5_FC_POOL_MAX) {
+			list_add_tail(&counter->list, &fc_stats->pool);
+			fc_stats->pool_size++;
+		} else {
+			list_add_tail(&counter->list, &freelist);
+		}
+		spin_unlock(&fc_stats->addlist_lock);
+	}
+
+	fc_stats->next_query = now + fc_stats->sampling_interval;
+unlock:
+	mutex_unlock(&fc_stats->counters_lock);
+
+	list_for_each_entry_safe(counter, tmp, &freelist, list) {
+		list_del(&counter->list);
+		mlx5_fc_free(dev, counter);
+	}
+}
+
+struct mlx5_fc *mlx5_fc_alloc(struct mlx5_core_dev *dev)
+{
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+	struct mlx5_fc *counter = NULL;
+	int err;
+
+	if (!fc_stats->wq)
+		return ERR_PTR(-EOPNOTSUPP);
+
+	spin_lock(&fc_stats->addlist_lock);
+	if (!list_empty(&fc_stats->pool)) {
+		counter = list_first_entry(&fc_stats->pool, struct mlx5_fc,
+					   list);
+		list_del(&counter->list);
+		fc_stats->pool_size--;
+	}
+	spin_unlock(&fc_stats->addlist_lock);
+
+	if (counter) {
+		/* The hardware counter is never cleared, report values
+		 * relative to the ones it had when it was released.
+		 */
+		counter->base_packets = counter->cache.packets;
+		counter->base_bytes = counter->cache.bytes;
+	} else {
+		counter = kzalloc(sizeof(*counter), GFP_KERNEL);
+		if (!counter)
+			return ERR_PTR(-ENOMEM);
+
+		err = mlx5_cmd_fc_alloc(dev, &counter->id);
+		if (err) {
+			kfree(counter);
+			return ERR_PTR(err);
+		}
+	}
+	counter->cache.lastuse = jiffies;
+
+	spin_lock(&fc_stats->addlist_lock);
+	list_add(&counter->list, &fc_stats->addlist);
+	spin_unlock(&fc_stats->addlist_lock);
+
+	mod_delayed_work(fc_stats->wq, &fc_stats->work, 0);
+
+	return counter;
+}
+
+void mlx5_fc_release(struct mlx5_core_dev *dev, struct mlx5_fc *counter)
+{
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+
+	if (!counter)
+		return;
+
+	spin_lock(&fc_stats->addlist_lock);
+	counter->deleted = true;
+	spin_unlock(&fc_stats->addlist_lock);
+
+	mod_delayed_work(fc_stats->wq, &fc_stats->work, 0);
+}
+
+void mlx5_fc_query_cached(struct mlx5_fc *counter,
+			  u64 *packets, u64 *bytes, u64 *lastuse)
+{
+	struct mlx5_fc_cache c = counter->cache;
+
+	*packets = c.packets - counter->base_packets;
+	*bytes = c.bytes - counter->base_bytes;
+	*lastuse = c.lastuse;
+}
+
+static int mlx5_fc_debugfs_show(struct seq_file *file, void *priv)
+{
+	struct mlx5_core_dev *dev = file->private;
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+	struct rb_node *node;
+
+	seq_printf(file, "%-8s %-20s %-20s %s\n", "id", "packets", "bytes",
+		   "idle_ms");
+
+	mutex_lock(&fc_stats->counters_lock);
+	for (node = rb_first(&fc_stats->counters); node; node = rb_next(node)) {
+		struct mlx5_fc *counter = rb_entry(node, struct mlx5_fc, node);
+		u64 packets;
+		u64 bytes;
+		u64 lastuse;
+
+		if (counter->deleted)
+			continue;
+
+		mlx5_fc_query_cached(counter, &packets, &bytes, &lastuse);
+		seq_printf(file, "%-8u %-20llu %-20llu %u\n", counter->id,
+			   packets, bytes,
+			   jiffies_to_msecs(jiffies - (unsigned long)lastuse));
+	}
+	seq_printf(file, "pool: %d\n", fc_stats->pool_size);
+	mutex_unlock(&fc_stats->counters_lock);
+
+	return 0;
+}
+
+static int mlx5_fc_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mlx5_fc_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations mlx5_fc_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mlx5_fc_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static bool mlx5_fc_supported(struct mlx5_core_dev *dev)
+{
+	return MLX5_CAP_GEN(dev, max_flow_counter) &&
+	       (MLX5_CAP_FLOWTABLE(dev,
+				   flow_table_properties_nic_receive.flow_counter) ||
+		MLX5_CAP_ESW_FLOWTABLE_FDB(dev, flow_counter));
+}
+
+int mlx5_init_fc_stats(struct mlx5_core_dev *dev)
+{
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+	int log_bulk;
+
+	fc_stats->counters = RB_ROOT;
+	mutex_init(&fc_stats->counters_lock);
+	INIT_LIST_HEAD(&fc_stats->addlist);
+	INIT_LIST_HEAD(&fc_stats->pool);
+	fc_stats->pool_size = 0;
+	spin_lock_init(&fc_stats->addlist_lock);
+	fc_stats->wq = NULL;
+
+	if (!mlx5_fc_supported(dev))
+		return 0;
+
+	fc_stats->wq = create_singlethread_workqueue("mlx5_fc");
+	if (!fc_stats->wq)
+		return -ENOMEM;
+
+	fc_stats->sampling_interval = MLX5_FC_STATS_PERIOD;
+	fc_stats->next_query = jiffies;
+	/* Counter ids are 16 bit, a larger bulk is never useful */
+	log_bulk = min_t(int, 16,
+			 MLX5_CAP_GEN(dev, log_max_flow_counter_bulk));
+	fc_stats->bulk_query_max =
+		min_t(int, 1 << log_bulk,
+		      ALIGN(MLX5_CAP_GEN(dev, max_flow_counter),
+			    MLX5_FC_BULK_QUERY_ALIGN));
+	INIT_DELAYED_WORK(&fc_stats->work, mlx5_fc_stats_work);
+
+	if (mlx5_debugfs_root)
+		fc_stats->debugfs = debugfs_create_file("flow_counters", 0400,
+							dev->priv.dbg_root,
+							dev,
+							&mlx5_fc_debugfs_fops);
+
+	return 0;
+}
+
+void mlx5_cleanup_fc_stats(struct mlx5_core_dev *dev)
+{
+	struct mlx5_fc_stats *fc_stats = &dev->priv.fc_stats;
+	struct mlx5_fc *counter;
+	struct mlx5_fc *tmp;
+	struct rb_node *node;
+
+	if (!fc_stats->wq)
+		return;
+
+	debugfs_remove(fc_stats->debugfs);
+	fc_stats->debugfs = NULL;
+
+	cancel_delayed_work_sync(&fc_stats->work);
+	destroy_workqueue(fc_stats->wq);
+	fc_stats->wq = NULL;
+
+	list_for_each_entry_safe(counter, tmp, &fc_stats->addlist, list) {
+		list_del(&counter->list);
+		mlx5_fc_free(dev, counter);
+	}
+
+	list_for_each_entry_safe(counter, tmp, &fc_stats->pool, list) {
+		list_del(&counter->list);
+		mlx5_fc_free(dev, counter);
+	}
+	fc_stats->pool_size = 0;
+
+	node = rb_first(&fc_stats->counters);
+	while (node) {
+		counter = rb_entry(node, struct mlx5_fc, node);
+		node = rb_next(node);
+		rb_erase(&counter->node, &fc_stats->counters);
+		mlx5_fc_free(dev, counter);
+	}
+}
@@ -179,6 +179,7 @@ static void fs_del_dst(struct mlx5_flow_rule *dst);
 static void _fs_del_ft(struct mlx5_flow_table *ft);
 static void fs_del_fg(struct mlx5_flow_group *fg);
 static void fs_del_fte(struct fs_fte *fte);
+static void fs_release_fte(struct fs_fte *fte);
 
 static void cmd_remove_node(struct fs_base *base)
 {
@@ -193,7 +194,7 @@ static void cmd_remove_node(struct fs_base *base)
 		fs_del_fg(container_of(base, struct mlx5_flow_group, base));
 		break;
 	case FS_TYPE_FLOW_ENTRY:
-		fs_del_fte(container_of(base, struct fs_fte, base));
+		fs_release_fte(container_of(base, struct fs_fte, base));
 		break;
 	default:
 		break;
@@ -433,7 +434,7 @@ static int fs_set_star_rules(struct mlx5_core_dev *dev,
 					  new_src_fte->flow_tag,
 					  new_src_fte->action,
 					  new_src_fte->dests_size,
-					  &new_src_fte->dests);
+					  &new_src_fte->dests, NULL);
 		if (err)
 			goto destroy_ctx;
 
@@ -1554,7 +1555,8 @@ static struct mlx5_flow_rule *_fs_add_dst_fte(struct fs_fte *fte,
 	fte->dests_size++;
 	err = mlx5_cmd_fs_set_fte(fs_get_dev(&ft->base), fte->val, ft->type,
 				  ft->id, fte->index, fg->id, fte->flow_tag,
-				  fte->action, fte->dests_size, &fte->dests);
+				  fte->action, fte->dests_size, &fte->dests,
+				  fte->counter);
 	if (err)
 		goto free_dst;
 
@@ -1738,7 +1740,8 @@ static void fs_del_dst(struct mlx5_flow_rule *dst)
 		err = mlx5_cmd_fs_set_fte(dev, match_value, ft->type,
 					  ft->id, fte->index, fg->id,
 					  fte->flow_tag, fte->action,
-					  fte->dests_size, &fte->dests);
+					  fte->dests_size, &fte->dests,
+					  fte->counter);
 		if (err) {
 			mlx5_core_warn(dev, "%s can't delete dst %s\n",
 				       __func__, dst->base.name);
@@ -1775,6 +1778,18 @@ static void fs_del_fte(struct fs_fte *fte)
 	fg->num_ftes--;
 }
 
+/* Called when the fte node is removed from the tree, unlike fs_del_fte()
+ * which is also used to move an fte to a new index.
+ */
+static void fs_release_fte(struct fs_fte *fte)
+{
+	fs_del_fte(fte);
+	if (fte->counter) {
+		mlx5_fc_release(fs_get_dev(&fte->base), fte->counter);
+		fte->counter = NULL;
+	}
+}
+
 static bool has_free_fte(struct mlx5_flow_table *ft, struct mlx5_flow_group *fg)
 {
 	if (ft->type == FS_FT_FDB) {
@@ -1828,8 +1843,17 @@ static struct mlx5_flow_rule *fs_add_dst_fg(struct mlx5_flow_group *fg,
 		dst = (void *)fte;
 		goto unlock_fg;
 	}
+	if (action & MLX5_FLOW_CONTEXT_ACTION_COUNT) {
+		fte->counter = mlx5_fc_alloc(fs_get_dev(&ft->base));
+		if (IS_ERR(fte->counter)) {
+			dst = (void *)fte->counter;
+			kfree(fte);
+			goto unlock_fg;
+		}
+	}
 	dst = _fs_add_dst_fte(fte, fg, dest);
 	if (IS_ERR(dst)) {
+		mlx5_fc_release(fs_get_dev(&ft->base), fte->counter);
 		kfree(fte);
 		goto unlock_fg;
 	}
@@ -1941,6 +1965,21 @@ void mlx5_del_flow_rule(struct mlx5_flow_rule *dst)
 }
 EXPORT_SYMBOL(mlx5_del_flow_rule);
 
+int mlx5_flow_rule_get_stats(struct mlx5_flow_rule *rule,
+			     u64 *packets, u64 *bytes, u64 *lastuse)
+{
+	struct fs_fte *fte;
+
+	fs_get_parent(fte, rule);
+	if (!fte || !fte->counter)
+		return -ENOENT;
+
+	mlx5_fc_query_cached(fte->counter, packets, bytes, lastuse);
+
+	return 0;
+}
+EXPORT_SYMBOL(mlx5_flow_rule_get_stats);
+
 #define MLX5_CORE_FS_ROOT_NS_NAME "root"
 #define MLX5_CORE_FS_FDB_ROOT_NS_NAME "fdb_root"
 #define MLX5_CORE_FS_SNIFFER_RX_ROOT_NS_NAME "sniffer_rx_root"
@@ -2052,6 +2091,7 @@ void mlx5_cleanup_fs(struct mlx5_core_dev *dev)
 	cleanup_single_prio_root_ns(dev, dev->sniffer_rx_root_ns);
 	cleanup_single_prio_root_ns(dev, dev->sniffer_tx_root_ns);
 	cleanup_single_prio_root_ns(dev, dev->fdb_root_ns);
+	mlx5_cleanup_fc_stats(dev);
 }
 
 struct mlx5_flow_namespace *fs_init_namespace(struct mlx5_flow_namespace
@@ -2370,6 +2410,10 @@ int mlx5_init_fs(struct mlx5_core_dev *dev)
 {
 	int err;
 
+	err = mlx5_init_fc_stats(dev);
+	if (err)
+		goto err;
+
 	if (MLX5_CAP_GEN(dev, nic_flow_table)) {
 		err = init_root_ns(dev);
 		if (err)
@@ -1091,7 +1091,11 @@ static int mlx5_load_one(struct mlx5_core_dev *dev, struct mlx5_priv *priv)
 		goto cmd_cleanup;
 	}
 
-	mlx5_pagealloc_init(dev);
+	err = mlx5_pagealloc_init(dev);
+	if (err) {
+		dev_err(&pdev->dev, "mlx5_pagealloc_init failed\n");
+		goto cmd_cleanup;
+	}
 
 	err = mlx5_core_enable_hca(dev, 0);
 	if (err) {
@@ -36,6 +36,7 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/rcupdate.h>
 #include <linux/mlx5/driver.h>
 
 
@@ -91,6 +92,66 @@ static inline int mlx5_cmd_exec_check_status(struct mlx5_core_dev *dev, u32 *in,
 	return mlx5_cmd_status_to_err((struct mlx5_outbox_hdr *)out);
 }
 
+#define MLX5_RSC_ARRAY_MAX_LOG_SIZE 14
+
+static inline void mlx5_rsc_array_init(struct mlx5_rsc_array *array,
+				       int log_size)
+{
+	log_size = min(log_size, MLX5_RSC_ARRAY_MAX_LOG_SIZE);
+	array->slots = mlx5_vzalloc((1UL << log_size) * sizeof(*array->slots));
+	array->mask = array->slots ? (1 << log_size) - 1 : 0;
+}
+
+static inline void mlx5_rsc_array_cleanup(struct mlx5_rsc_array *array)
+{
+	kvfree(array->slots);
+	array->slots = NULL;
+	array->mask = 0;
+}
+
+/* Must be called under rcu_read_lock() */
+static inline void *mlx5_rsc_array_lookup(struct mlx5_rsc_array *array,
+					  u32 key)
+{
+	if (unlikely(!array->slots))
+		return NULL;
+
+	return rcu_dereference(array->slots[key & array->mask]);
+}
+
+/* Must be called with the table lock held */
+static inline void mlx5_rsc_array_insert(struct mlx5_rsc_array *array,
+					 u32 key, void *rsc)
+{
+	void __rcu **slot;
+
+	if (!array->slots)
+		return;
+
+	slot = &array->slots[key & array->mask];
+	if (!rcu_access_pointer(*slot))
+		rcu_assign_pointer(*slot, rsc);
+}
+
+/* Must be called with the table lock held. Returns true if rsc was cached,
+ * in which case RCU readers may still hold it until a grace period ends.
+ */
+static inline bool mlx5_rsc_array_remove(struct mlx5_rsc_array *array,
+					 u32 key, void *rsc)
+{
+	void __rcu **slot;
+
+	if (!array->slots)
+		return false;
+
+	slot = &array->slots[key & array->mask];
+	if (rcu_access_pointer(*slot) != rsc)
+		return false;
+
+	RCU_INIT_POINTER(*slot, NULL);
+	return true;
+}
+
 int mlx5_query_hca_caps(struct mlx5_core_dev *dev);
 int mlx5_query_board_id(struct mlx5_core_dev *dev);
 
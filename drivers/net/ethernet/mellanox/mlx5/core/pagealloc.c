@@ -33,6 +33,8 @@
 #include <asm-generic/kmap_types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
 #include <linux/mlx5/driver.h>
 #include <linux/mlx5/cmd.h>
 #include "mlx5_core.h"
@@ -54,10 +56,14 @@ struct mlx5_pages_req {
 	u16	func_id;
 	s32	npages;
 	struct work_struct work;
+	/* pending reclaim requests, see mlx5_pages_reclaim */
+	struct list_head list;
 };
 
+struct fw_chunk;
+
 struct fw_page {
-	struct rb_node		rb_node;
+	struct fw_chunk	       *chunk;
 	u64			addr;
 	struct page	       *page;
 	u16			func_id;
@@ -66,6 +72,28 @@ struct fw_page {
 	unsigned		free_count;
 };
 
+/* A physically contiguous, DMA mapped block of system pages allocated on
+ * the device's NUMA node. Firmware pages are carved out of it and the
+ * whole block is released once none of its pages is in use.
+ */
+struct fw_chunk {
+	struct list_head	list;
+	struct page	       *page;
+	dma_addr_t		addr;
+	unsigned int		order;
+	/* number of pages with all their 4K pieces free */
+	unsigned int		free_pages;
+	struct fw_page		pages[0];
+};
+
+struct mlx5_give_pages_work {
+	struct work_struct	work;
+	struct mlx5_core_dev   *dev;
+	u16			func_id;
+	int			npages;
+	int			err;
+};
+
 struct mlx5_manage_pages_inbox {
 	struct mlx5_inbox_hdr	hdr;
 	__be16			rsvd;
@@ -91,64 +119,79 @@ enum {
 	MLX5_NUM_4K_IN_PAGE		= PAGE_SIZE / MLX5_ADAPTER_PAGE_SIZE,
 };
 
-static int insert_page(struct mlx5_core_dev *dev, u64 addr, struct page *page, u16 func_id)
+enum {
+	MLX5_FW_CHUNK_MAX_SIZE		= 1 << 20,
+	MLX5_GIVE_PAGES_PER_WORKER	= 4096,
+	MLX5_GIVE_PAGES_MAX_WORKERS	= 8,
+	/* time the reclaim worker may run before yielding pg_wq */
+	MLX5_RECLAIM_BATCH_MSECS	= 20,
+};
+
+static int insert_chunk(struct mlx5_core_dev *dev, struct fw_chunk *chunk)
 {
-	struct rb_root *root = &dev->priv.page_root;
-	struct rb_node **new = &root->rb_node;
-	struct rb_node *parent = NULL;
-	struct fw_page *nfp;
-	struct fw_page *tfp;
+	int npages = 1 << chunk->order;
+	int err;
 	int i;
 
-	while (*new) {
-		parent = *new;
-		tfp = rb_entry(parent, struct fw_page, rb_node);
-		if (tfp->addr < addr)
-			new = &parent->rb_left;
-		else if (tfp->addr > addr)
-			new = &parent->rb_right;
-		else
-			return -EEXIST;
+	for (i = 0; i < npages; i++) {
+		err = radix_tree_insert(&dev->priv.page_tree,
+					chunk->pages[i].addr >> PAGE_SHIFT,
+					&chunk->pages[i]);
+		if (err)
+			goto err_delete;
 	}
 
-	nfp = kzalloc(sizeof(*nfp), GFP_KERNEL);
-	if (!nfp)
-		return -ENOMEM;
-
-	nfp->addr = addr;
-	nfp->page = page;
-	nfp->func_id = func_id;
-	nfp->free_count = MLX5_NUM_4K_IN_PAGE;
-	for (i = 0; i < MLX5_NUM_4K_IN_PAGE; i++)
-		set_bit(i, &nfp->bitmask);
-
-	rb_link_node(&nfp->rb_node, parent, new);
-	rb_insert_color(&nfp->rb_node, root);
-	list_add(&nfp->list, &dev->priv.free_list);
+	for (i = npages - 1; i >= 0; i--)
+		list_add(&chunk->pages[i].list, &dev->priv.free_list);
+	list_add(&chunk->list, &dev->priv.chunk_list);
+	dev->priv.pages_stats.chunks_allocated++;
 
 	return 0;
+
+err_delete:
+	while (--i >= 0)
+		radix_tree_delete(&dev->priv.page_tree,
+				  chunk->pages[i].addr >> PAGE_SHIFT);
+	return err;
 }
 
 static struct fw_page *find_fw_page(struct mlx5_core_dev *dev, u64 addr)
 {
-	struct rb_root *root = &dev->priv.page_root;
-	struct rb_node *tmp = root->rb_node;
-	struct fw_page *result = NULL;
-	struct fw_page *tfp;
-
-	while (tmp) {
-		tfp = rb_entry(tmp, struct fw_page, rb_node);
-		if (tfp->addr < addr) {
-			tmp = tmp->rb_left;
-		} else if (tfp->addr > addr) {
-			tmp = tmp->rb_right;
-		} else {
-			result = tfp;
-			break;
-		}
-	}
+	return radix_tree_lookup(&dev->priv.page_tree, addr >> PAGE_SHIFT);
+}
 
-	return result;
+static void free_chunk(struct mlx5_core_dev *dev, struct fw_chunk *chunk)
+{
+	dma_unmap_page(&dev->pdev->dev, chunk->addr, PAGE_SIZE << chunk->order,
+		       DMA_BIDIRECTIONAL);
+	__free_pages(chunk->page, chunk->order);
+	kfree(chunk);
+}
+
+static void free_chunks(struct mlx5_core_dev *dev, struct list_head *chunks)
+{
+	struct fw_chunk *chunk;
+	struct fw_chunk *tmp;
+
+	list_for_each_entry_safe(chunk, tmp, chunks, list)
+		free_chunk(dev, chunk);
+}
+
+/* Unlink a chunk whose pages are all free. The memory itself is released
+ * by the caller through free_chunks() once page_lock has been dropped.
+ */
+static void release_chunk(struct mlx5_core_dev *dev, struct fw_chunk *chunk,
+			  struct list_head *to_free)
+{
+	int i;
+
+	for (i = 0; i < (1 << chunk->order); i++) {
+		radix_tree_delete(&dev->priv.page_tree,
+				  chunk->pages[i].addr >> PAGE_SHIFT);
+		list_del(&chunk->pages[i].list);
+	}
+	list_move(&chunk->list, to_free);
+	dev->priv.pages_stats.chunks_freed++;
 }
 
 static int mlx5_cmd_query_pages(struct mlx5_core_dev *dev, u16 *func_id,
@@ -175,7 +218,7 @@ static int mlx5_cmd_query_pages(struct mlx5_core_dev *dev, u16 *func_id,
 	return 0;
 }
 
-static int alloc_4k(struct mlx5_core_dev *dev, u64 *addr)
+static int alloc_4k(struct mlx5_core_dev *dev, u64 *addr, u16 func_id)
 {
 	struct fw_page *fp;
 	unsigned n;
@@ -189,6 +232,10 @@ static int alloc_4k(struct mlx5_core_dev *dev, u64 *addr)
 		mlx5_core_warn(dev, "alloc 4k bug\n");
 		return -ENOENT;
 	}
+	if (fp->free_count == MLX5_NUM_4K_IN_PAGE) {
+		fp->chunk->free_pages--;
+		fp->func_id = func_id;
+	}
 	clear_bit(n, &fp->bitmask);
 	fp->free_count--;
 	if (!fp->free_count)
@@ -199,7 +246,8 @@ static int alloc_4k(struct mlx5_core_dev *dev, u64 *addr)
 	return 0;
 }
 
-static void free_4k(struct mlx5_core_dev *dev, u64 addr)
+static void free_4k(struct mlx5_core_dev *dev, u64 addr,
+		    struct list_head *to_free)
 {
 	struct fw_page *fwp;
 	int n;
@@ -213,38 +261,82 @@ static void free_4k(struct mlx5_core_dev *dev, u64 addr)
 	n = (addr & ~PAGE_MASK) >> MLX5_ADAPTER_PAGE_SHIFT;
 	fwp->free_count++;
 	set_bit(n, &fwp->bitmask);
-	if (fwp->free_count == MLX5_NUM_4K_IN_PAGE) {
-		rb_erase(&fwp->rb_node, &dev->priv.page_root);
-		if (fwp->free_count != 1)
-			list_del(&fwp->list);
-		dma_unmap_page(&dev->pdev->dev, addr & PAGE_MASK, PAGE_SIZE,
-			       DMA_BIDIRECTIONAL);
-		__free_page(fwp->page);
-		kfree(fwp);
-	} else if (fwp->free_count == 1) {
+	if (fwp->free_count == 1)
 		list_add(&fwp->list, &dev->priv.free_list);
-	}
+	if (fwp->free_count == MLX5_NUM_4K_IN_PAGE &&
+	    ++fwp->chunk->free_pages == (1 << fwp->chunk->order))
+		release_chunk(dev, fwp->chunk, to_free);
 }
 
-static int alloc_system_page(struct mlx5_core_dev *dev, u16 func_id)
+/* Allocate a chunk large enough for npages 4K firmware pages, capped at
+ * MLX5_FW_CHUNK_MAX_SIZE, falling back to smaller orders under memory
+ * fragmentation. Called without page_lock held.
+ */
+static int alloc_system_chunk(struct mlx5_core_dev *dev, u16 func_id,
+			      int npages)
 {
+	int node = dev_to_node(&dev->pdev->dev);
+	struct fw_chunk *chunk;
+	unsigned int order;
 	struct page *page;
-	u64 addr;
+	dma_addr_t addr;
+	gfp_t gfp;
 	int err;
+	int i;
 
-	page = alloc_page(GFP_HIGHUSER);
+	order = min_t(unsigned int, get_order(MLX5_FW_CHUNK_MAX_SIZE),
+		      order_base_2(DIV_ROUND_UP(npages, MLX5_NUM_4K_IN_PAGE)));
+	for (;;) {
+		gfp = GFP_HIGHUSER;
+		if (order)
+			gfp |= __GFP_NOWARN | __GFP_NORETRY;
+		page = alloc_pages_node(node, gfp, order);
+		if (page || !order)
+			break;
+		order--;
+		mutex_lock(&dev->priv.page_lock);
+		dev->priv.pages_stats.order_fallbacks++;
+		mutex_unlock(&dev->priv.page_lock);
+	}
 	if (!page) {
 		mlx5_core_warn(dev, "failed to allocate page\n");
 		return -ENOMEM;
 	}
+
+	chunk = kzalloc_node(sizeof(*chunk) +
+			     (1 << order) * sizeof(chunk->pages[0]),
+			     GFP_KERNEL, node);
+	if (!chunk) {
+		err = -ENOMEM;
+		goto out_alloc;
+	}
+
 	addr = dma_map_page(&dev->pdev->dev, page, 0,
-			    PAGE_SIZE, DMA_BIDIRECTIONAL);
+			    PAGE_SIZE << order, DMA_BIDIRECTIONAL);
 	if (dma_mapping_error(&dev->pdev->dev, addr)) {
 		mlx5_core_warn(dev, "failed dma mapping page\n");
 		err = -ENOMEM;
-		goto out_alloc;
+		goto out_chunk;
 	}
-	err = insert_page(dev, addr, page, func_id);
+
+	chunk->page = page;
+	chunk->addr = addr;
+	chunk->order = order;
+	chunk->free_pages = 1 << order;
+	for (i = 0; i < (1 << order); i++) {
+		struct fw_page *fp = &chunk->pages[i];
+
+		fp->chunk = chunk;
+		fp->addr = addr + i * PAGE_SIZE;
+		fp->page = page + i;
+		fp->func_id = func_id;
+		fp->free_count = MLX5_NUM_4K_IN_PAGE;
+		bitmap_fill(&fp->bitmask, MLX5_NUM_4K_IN_PAGE);
+	}
+
+	mutex_lock(&dev->priv.page_lock);
+	err = insert_chunk(dev, chunk);
+	mutex_unlock(&dev->priv.page_lock);
 	if (err) {
 		mlx5_core_err(dev, "failed to track allocated page\n");
 		goto out_mapping;
@@ -253,10 +345,14 @@ static int alloc_system_page(struct mlx5_core_dev *dev, u16 func_id)
 	return 0;
 
 out_mapping:
-	dma_unmap_page(&dev->pdev->dev, addr, PAGE_SIZE, DMA_BIDIRECTIONAL);
+	dma_unmap_page(&dev->pdev->dev, addr, PAGE_SIZE << order,
+		       DMA_BIDIRECTIONAL);
+
+out_chunk:
+	kfree(chunk);
 
 out_alloc:
-	__free_page(page);
+	__free_pages(page, order);
 
 	return err;
 }
@@ -286,6 +382,7 @@ static int give_pages(struct mlx5_core_dev *dev, u16 func_id, int npages,
 {
 	struct mlx5_manage_pages_inbox *in;
 	struct mlx5_manage_pages_outbox out;
+	LIST_HEAD(to_free);
 	int inlen;
 	u64 addr;
 	int err;
@@ -301,12 +398,17 @@ static int give_pages(struct mlx5_core_dev *dev, u16 func_id, int npages,
 	}
 	memset(&out, 0, sizeof(out));
 
+	mutex_lock(&dev->priv.page_lock);
 	for (i = 0; i < npages; i++) {
 retry:
-		err = alloc_4k(dev, &addr);
+		err = alloc_4k(dev, &addr, func_id);
 		if (err) {
-			if (err == -ENOMEM)
-				err = alloc_system_page(dev, func_id);
+			if (err == -ENOMEM) {
+				mutex_unlock(&dev->priv.page_lock);
+				err = alloc_system_chunk(dev, func_id,
+							 npages - i);
+				mutex_lock(&dev->priv.page_lock);
+			}
 			if (err)
 				goto out_alloc;
 
@@ -314,6 +416,7 @@ retry:
 		}
 		in->pas[i] = cpu_to_be64(addr);
 	}
+	mutex_unlock(&dev->priv.page_lock);
 
 	in->hdr.opcode = cpu_to_be16(MLX5_CMD_OP_MANAGE_PAGES);
 	in->hdr.opmod = cpu_to_be16(MLX5_PAGES_GIVE);
@@ -334,21 +437,27 @@ retry:
 		}
 	}
 
+	mutex_lock(&dev->priv.page_lock);
 	dev->priv.fw_pages += npages;
 	if (func_id)
 		dev->priv.vfs_pages += npages;
+	mutex_unlock(&dev->priv.page_lock);
 
 	mlx5_core_dbg(dev, "err %d\n", err);
 
 	goto out_free;
 
 out_alloc:
+	mutex_unlock(&dev->priv.page_lock);
 	if (notify_fail)
 		page_notify_fail(dev, func_id);
 
 out_4k:
+	mutex_lock(&dev->priv.page_lock);
 	for (i--; i >= 0; i--)
-		free_4k(dev, be64_to_cpu(in->pas[i]));
+		free_4k(dev, be64_to_cpu(in->pas[i]), &to_free);
+	mutex_unlock(&dev->priv.page_lock);
+	free_chunks(dev, &to_free);
 out_free:
 	kvfree(in);
 	return err;
@@ -359,6 +468,7 @@ static int reclaim_pages(struct mlx5_core_dev *dev, u32 func_id, int npages,
 {
 	struct mlx5_manage_pages_inbox   in;
 	struct mlx5_manage_pages_outbox *out;
+	LIST_HEAD(to_free);
 	int num_claimed;
 	int outlen;
 	u64 addr;
@@ -400,42 +510,223 @@ static int reclaim_pages(struct mlx5_core_dev *dev, u32 func_id, int npages,
 	if (nclaimed)
 		*nclaimed = num_claimed;
 
+	mutex_lock(&dev->priv.page_lock);
 	for (i = 0; i < num_claimed; i++) {
 		addr = be64_to_cpu(out->pas[i]);
-		free_4k(dev, addr);
+		free_4k(dev, addr, &to_free);
 	}
 	dev->priv.fw_pages -= num_claimed;
 	if (func_id)
 		dev->priv.vfs_pages -= num_claimed;
+	mutex_unlock(&dev->priv.page_lock);
+
+	/* release the system memory outside of page_lock */
+	free_chunks(dev, &to_free);
+	if (func_id && num_claimed)
+		wake_up(&dev->priv.pages_reclaim.vf_wait);
 
 out_free:
 	kvfree(out);
 	return err;
 }
 
+static void give_pages_work_handler(struct work_struct *work)
+{
+	struct mlx5_give_pages_work *gw =
+		container_of(work, struct mlx5_give_pages_work, work);
+
+	gw->err = give_pages(gw->dev, gw->func_id, gw->npages, 0);
+}
+
+/* Split large requests into slices handed to parallel workers so that
+ * page allocation, DMA mapping and the MANAGE_PAGES commands overlap.
+ */
+static int give_pages_parallel(struct mlx5_core_dev *dev, u16 func_id,
+			       int npages, int notify_fail)
+{
+	struct mlx5_give_pages_work *gw;
+	int per_worker;
+	int nworkers;
+	int err = 0;
+	int i;
+
+	nworkers = min_t(int, num_online_cpus(), MLX5_GIVE_PAGES_MAX_WORKERS);
+	nworkers = min_t(int, nworkers,
+			 DIV_ROUND_UP(npages, MLX5_GIVE_PAGES_PER_WORKER));
+	if (nworkers <= 1 || !dev->priv.pg_give_wq)
+		return give_pages(dev, func_id, npages, notify_fail);
+
+	gw = kcalloc(nworkers, sizeof(*gw), GFP_KERNEL);
+	if (!gw)
+		return give_pages(dev, func_id, npages, notify_fail);
+
+	per_worker = DIV_ROUND_UP(npages, nworkers);
+	nworkers = DIV_ROUND_UP(npages, per_worker);
+	for (i = 0; i < nworkers; i++) {
+		gw[i].dev = dev;
+		gw[i].func_id = func_id;
+		gw[i].npages = min(per_worker, npages - i * per_worker);
+		INIT_WORK(&gw[i].work, give_pages_work_handler);
+		queue_work(dev->priv.pg_give_wq, &gw[i].work);
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		flush_work(&gw[i].work);
+		if (gw[i].err && !err)
+			err = gw[i].err;
+	}
+	kfree(gw);
+
+	if (err && notify_fail)
+		page_notify_fail(dev, func_id);
+
+	return err;
+}
+
+enum {
+	MLX5_BLKS_FOR_RECLAIM_PAGES = 12
+};
+
+static int optimal_reclaimed_pages(void)
+{
+	struct mlx5_cmd_prot_block *block;
+	struct mlx5_cmd_layout *lay;
+	int ret;
+
+	ret = (sizeof(lay->out) + MLX5_BLKS_FOR_RECLAIM_PAGES * sizeof(block->data) -
+	       sizeof(struct mlx5_manage_pages_outbox)) /
+	       FIELD_SIZEOF(struct mlx5_manage_pages_outbox, pas[0]);
+
+	return ret;
+}
+
 static void pages_work_handler(struct work_struct *work)
 {
 	struct mlx5_pages_req *req = container_of(work, struct mlx5_pages_req, work);
 	struct mlx5_core_dev *dev = req->dev;
 	int err = 0;
 
-	if (req->npages < 0)
-		err = reclaim_pages(dev, req->func_id, -1 * req->npages, NULL);
-	else if (req->npages > 0)
-		err = give_pages(dev, req->func_id, req->npages, 1);
+	if (req->npages > 0)
+		err = give_pages_parallel(dev, req->func_id, req->npages, 1);
 
 	if (err)
-		mlx5_core_warn(dev, "%s fail %d\n",
-			       req->npages < 0 ? "reclaim" : "give", err);
+		mlx5_core_warn(dev, "give fail %d\n", err);
 
 	kfree(req);
 }
 
+/* Serve pending reclaim requests in chunks of optimal_reclaimed_pages().
+ * The worker yields pg_wq after MLX5_RECLAIM_BATCH_MSECS so that page
+ * give requests are not starved behind a large reclaim.
+ */
+static void reclaim_work_handler(struct work_struct *work)
+{
+	struct mlx5_pages_reclaim *rc =
+		container_of(work, struct mlx5_pages_reclaim, work);
+	struct mlx5_core_dev *dev =
+		container_of(rc, struct mlx5_core_dev, priv.pages_reclaim);
+	unsigned long end = jiffies + msecs_to_jiffies(MLX5_RECLAIM_BATCH_MSECS);
+	int batch = optimal_reclaimed_pages();
+	struct mlx5_pages_req *req;
+	int nclaimed;
+	ktime_t start;
+	u16 func_id;
+	u64 elapsed;
+	int npages;
+	int queued;
+	int err;
+
+	for (;;) {
+		spin_lock_irq(&rc->lock);
+		if (list_empty(&rc->reqs)) {
+			spin_unlock_irq(&rc->lock);
+			return;
+		}
+		req = list_first_entry(&rc->reqs, struct mlx5_pages_req, list);
+		func_id = req->func_id;
+		queued = req->npages;
+		npages = min(queued, batch);
+		spin_unlock_irq(&rc->lock);
+
+		start = ktime_get();
+		err = reclaim_pages(dev, func_id, npages, &nclaimed);
+		elapsed = ktime_to_us(ktime_sub(ktime_get(), start));
+		if (err)
+			mlx5_core_warn(dev, "reclaim fail %d\n", err);
+
+		spin_lock_irq(&rc->lock);
+		rc->batches++;
+		rc->reclaimed += nclaimed;
+		if (elapsed > rc->max_batch_us)
+			rc->max_batch_us = elapsed;
+		/* only requests get queued while we run, so req is still here */
+		if (err || nclaimed < npages) {
+			/* firmware has nothing more to return for this function
+			 * as of this batch; pages requested meanwhile stay queued
+			 */
+			rc->pending -= queued;
+			req->npages -= queued;
+		} else {
+			rc->pending -= npages;
+			req->npages -= npages;
+		}
+		if (!req->npages) {
+			list_del(&req->list);
+			kfree(req);
+		}
+		spin_unlock_irq(&rc->lock);
+
+		if (time_after(jiffies, end)) {
+			queue_work(dev->priv.pg_wq, &rc->work);
+			return;
+		}
+	}
+}
+
+static void queue_reclaim_request(struct mlx5_core_dev *dev, u16 func_id,
+				  s32 npages)
+{
+	struct mlx5_pages_reclaim *rc = &dev->priv.pages_reclaim;
+	struct mlx5_pages_req *req;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rc->lock, flags);
+	list_for_each_entry(req, &rc->reqs, list) {
+		if (req->func_id == func_id) {
+			req->npages += npages;
+			goto out;
+		}
+	}
+
+	req = kzalloc(sizeof(*req), GFP_ATOMIC);
+	if (!req) {
+		spin_unlock_irqrestore(&rc->lock, flags);
+		mlx5_core_warn(dev, "failed to allocate pages request\n");
+		return;
+	}
+	req->dev = dev;
+	req->func_id = func_id;
+	req->npages = npages;
+	list_add_tail(&req->list, &rc->reqs);
+
+out:
+	rc->pending += npages;
+	rc->requested += npages;
+	spin_unlock_irqrestore(&rc->lock, flags);
+
+	queue_work(dev->priv.pg_wq, &rc->work);
+}
+
 void mlx5_core_req_pages_handler(struct mlx5_core_dev *dev, u16 func_id,
 				 s32 npages)
 {
 	struct mlx5_pages_req *req;
 
+	if (npages < 0) {
+		queue_reclaim_request(dev, func_id, -npages);
+		return;
+	}
+
 	req = kzalloc(sizeof(*req), GFP_ATOMIC);
 	if (!req) {
 		mlx5_core_warn(dev, "failed to allocate pages request\n");
@@ -451,8 +742,11 @@ void mlx5_core_req_pages_handler(struct mlx5_core_dev *dev, u16 func_id,
 
 int mlx5_satisfy_startup_pages(struct mlx5_core_dev *dev, int boot)
 {
+	struct mlx5_pages_stats *stats = &dev->priv.pages_stats;
 	u16 uninitialized_var(func_id);
 	s32 uninitialized_var(npages);
+	ktime_t start = ktime_get();
+	u64 elapsed;
 	int err;
 
 	err = mlx5_cmd_query_pages(dev, &func_id, &npages, boot);
@@ -462,46 +756,63 @@ int mlx5_satisfy_startup_pages(struct mlx5_core_dev *dev, int boot)
 	mlx5_core_dbg(dev, "requested %d %s pages for func_id 0x%x\n",
 		      npages, boot ? "boot" : "init", func_id);
 
-	return give_pages(dev, func_id, npages, 0);
-}
+	err = give_pages_parallel(dev, func_id, npages, 0);
 
-enum {
-	MLX5_BLKS_FOR_RECLAIM_PAGES = 12
-};
+	elapsed = ktime_to_us(ktime_sub(ktime_get(), start));
+	if (boot)
+		stats->boot_pages_time_us = elapsed;
+	else
+		stats->init_pages_time_us = elapsed;
 
-static int optimal_reclaimed_pages(void)
+	return err;
+}
+
+/* Every chunk on chunk_list has at least one page in use by firmware */
+static struct fw_page *first_used_fw_page(struct mlx5_core_dev *dev)
 {
-	struct mlx5_cmd_prot_block *block;
-	struct mlx5_cmd_layout *lay;
-	int ret;
+	struct fw_chunk *chunk;
+	int i;
 
-	ret = (sizeof(lay->out) + MLX5_BLKS_FOR_RECLAIM_PAGES * sizeof(block->data) -
-	       sizeof(struct mlx5_manage_pages_outbox)) /
-	       FIELD_SIZEOF(struct mlx5_manage_pages_outbox, pas[0]);
+	list_for_each_entry(chunk, &dev->priv.chunk_list, list)
+		for (i = 0; i < (1 << chunk->order); i++)
+			if (chunk->pages[i].free_count < MLX5_NUM_4K_IN_PAGE)
+				return &chunk->pages[i];
 
-	return ret;
+	return NULL;
 }
 
 int mlx5_reclaim_startup_pages(struct mlx5_core_dev *dev)
 {
 	unsigned long end = jiffies + msecs_to_jiffies(MAX_RECLAIM_TIME_MSECS);
-	struct fw_page *fwp;
-	struct rb_node *p;
+	struct fw_page *p;
+	LIST_HEAD(to_free);
 	int nclaimed = 0;
+	u16 func_id;
 	int err = 0;
+	int n;
 
 	do {
-		p = rb_first(&dev->priv.page_root);
+		mutex_lock(&dev->priv.page_lock);
+		p = first_used_fw_page(dev);
 		if (p) {
-			fwp = rb_entry(p, struct fw_page, rb_node);
+			func_id = p->func_id;
 			if (dev->state == MLX5_DEVICE_STATE_INTERNAL_ERROR) {
-				free_4k(dev, fwp->addr);
+				/* p may be released by free_4k() */
+				n = find_first_zero_bit(&p->bitmask,
+							MLX5_NUM_4K_IN_PAGE);
+				free_4k(dev, p->addr + n * MLX5_ADAPTER_PAGE_SIZE,
+					&to_free);
 				nclaimed = 1;
-			} else {
-				err = reclaim_pages(dev, fwp->func_id,
+			}
+		}
+		mutex_unlock(&dev->priv.page_lock);
+		free_chunks(dev, &to_free);
+		INIT_LIST_HEAD(&to_free);
+		if (p) {
+			if (dev->state != MLX5_DEVICE_STATE_INTERNAL_ERROR)
+				err = reclaim_pages(dev, func_id,
 						    optimal_reclaimed_pages(),
 						    &nclaimed);
-			}
 			if (err) {
 				mlx5_core_warn(dev, "failed reclaiming pages (%d)\n",
 					       err);
@@ -519,15 +830,89 @@ int mlx5_reclaim_startup_pages(struct mlx5_core_dev *dev)
 	return 0;
 }
 
-void mlx5_pagealloc_init(struct mlx5_core_dev *dev)
+static void pages_debugfs_init(struct mlx5_core_dev *dev)
 {
-	dev->priv.page_root = RB_ROOT;
+	struct mlx5_pages_stats *stats = &dev->priv.pages_stats;
+
+	if (!mlx5_debugfs_root)
+		return;
+
+	stats->debugfs = debugfs_create_dir("pages", dev->priv.dbg_root);
+	if (!stats->debugfs)
+		return;
+
+	debugfs_create_u64("boot_pages_time_us", 0400, stats->debugfs,
+			   &stats->boot_pages_time_us);
+	debugfs_create_u64("init_pages_time_us", 0400, stats->debugfs,
+			   &stats->init_pages_time_us);
+	debugfs_create_u64("chunks_allocated", 0400, stats->debugfs,
+			   &stats->chunks_allocated);
+	debugfs_create_u64("chunks_freed", 0400, stats->debugfs,
+			   &stats->chunks_freed);
+	debugfs_create_u64("order_fallbacks", 0400, stats->debugfs,
+			   &stats->order_fallbacks);
+}
+
+static ssize_t fw_pages_reclaim_show(struct device *device,
+				     struct device_attribute *attr, char *buf)
+{
+	struct mlx5_core_dev *dev = pci_get_drvdata(to_pci_dev(device));
+	struct mlx5_pages_reclaim *rc = &dev->priv.pages_reclaim;
+	u64 pending, requested, reclaimed, batches, max_batch_us;
+
+	spin_lock_irq(&rc->lock);
+	pending = rc->pending;
+	requested = rc->requested;
+	reclaimed = rc->reclaimed;
+	batches = rc->batches;
+	max_batch_us = rc->max_batch_us;
+	spin_unlock_irq(&rc->lock);
+
+	return sprintf(buf,
+		       "fw_pages: %d\nvfs_pages: %d\npending: %llu\nrequested: %llu\nreclaimed: %llu\nbatches: %llu\nmax_batch_us: %llu\n",
+		       dev->priv.fw_pages, dev->priv.vfs_pages, pending,
+		       requested, reclaimed, batches, max_batch_us);
+}
+
+static DEVICE_ATTR(fw_pages_reclaim, S_IRUGO, fw_pages_reclaim_show, NULL);
+
+int mlx5_pagealloc_init(struct mlx5_core_dev *dev)
+{
+	struct mlx5_pages_reclaim *rc = &dev->priv.pages_reclaim;
+
+	INIT_RADIX_TREE(&dev->priv.page_tree, GFP_KERNEL);
 	INIT_LIST_HEAD(&dev->priv.free_list);
+	INIT_LIST_HEAD(&dev->priv.chunk_list);
+	mutex_init(&dev->priv.page_lock);
+	memset(&dev->priv.pages_stats, 0, sizeof(dev->priv.pages_stats));
+
+	memset(rc, 0, sizeof(*rc));
+	spin_lock_init(&rc->lock);
+	INIT_LIST_HEAD(&rc->reqs);
+	INIT_WORK(&rc->work, reclaim_work_handler);
+	init_waitqueue_head(&rc->vf_wait);
+
+	dev->priv.pg_give_wq = alloc_workqueue("mlx5_page_give",
+					       WQ_UNBOUND | WQ_MEM_RECLAIM,
+					       MLX5_GIVE_PAGES_MAX_WORKERS);
+	if (!dev->priv.pg_give_wq)
+		return -ENOMEM;
+
+	pages_debugfs_init(dev);
+
+	if (device_create_file(&dev->pdev->dev, &dev_attr_fw_pages_reclaim))
+		mlx5_core_warn(dev, "failed to create fw_pages_reclaim sysfs file\n");
+
+	return 0;
 }
 
 void mlx5_pagealloc_cleanup(struct mlx5_core_dev *dev)
 {
-	/* nothing */
+	device_remove_file(&dev->pdev->dev, &dev_attr_fw_pages_reclaim);
+	debugfs_remove_recursive(dev->priv.pages_stats.debugfs);
+	dev->priv.pages_stats.debugfs = NULL;
+	destroy_workqueue(dev->priv.pg_give_wq);
+	dev->priv.pg_give_wq = NULL;
 }
 
 int mlx5_pagealloc_start(struct mlx5_core_dev *dev)
@@ -541,26 +926,38 @@ int mlx5_pagealloc_start(struct mlx5_core_dev *dev)
 
 void mlx5_pagealloc_stop(struct mlx5_core_dev *dev)
 {
+	struct mlx5_pages_reclaim *rc = &dev->priv.pages_reclaim;
+	struct mlx5_pages_req *req;
+	struct mlx5_pages_req *tmp;
+
 	destroy_workqueue(dev->priv.pg_wq);
+
+	/* whatever is left is reclaimed by mlx5_reclaim_startup_pages() */
+	spin_lock_irq(&rc->lock);
+	list_for_each_entry_safe(req, tmp, &rc->reqs, list) {
+		list_del(&req->list);
+		kfree(req);
+	}
+	rc->pending = 0;
+	spin_unlock_irq(&rc->lock);
 }
 
 int mlx5_wait_for_vf_pages(struct mlx5_core_dev *dev)
 {
-	unsigned long end = jiffies + msecs_to_jiffies(MAX_RECLAIM_VFS_PAGES_TIME_MSECS);
+	unsigned long timeout = msecs_to_jiffies(MAX_RECLAIM_VFS_PAGES_TIME_MSECS);
 	int prev_vfs_pages = dev->priv.vfs_pages;
 
 	mlx5_core_dbg(dev, "Waiting for %d pages from %s\n", prev_vfs_pages,
 		      dev->priv.name);
+	/* woken by reclaim_pages() on progress; the timeout restarts then */
 	while (dev->priv.vfs_pages) {
-		if (time_after(jiffies, end)) {
+		if (!wait_event_timeout(dev->priv.pages_reclaim.vf_wait,
+					dev->priv.vfs_pages < prev_vfs_pages,
+					timeout)) {
 			mlx5_core_warn(dev, "aborting while there are %d pending pages\n", dev->priv.vfs_pages);
 			return -ETIMEDOUT;
 		}
-		if (dev->priv.vfs_pages < prev_vfs_pages) {
-			end = jiffies + msecs_to_jiffies(MAX_RECLAIM_VFS_PAGES_TIME_MSECS);
-			prev_vfs_pages = dev->priv.vfs_pages;
-		}
-		msleep(50);
+		prev_vfs_pages = dev->priv.vfs_pages;
 	}
 
 	mlx5_core_dbg(dev, "All pages received from %s\n", dev->priv.name);
@@ -41,12 +41,36 @@
 
 #include "mlx5_core.h"
 
+/* Only QPs, RQs and SQs are cached in the qp table array */
+static bool mlx5_rsc_array_match(struct mlx5_core_rsc_common *common, u32 rsn)
+{
+	struct mlx5_core_qp *qp = (struct mlx5_core_qp *)common;
+
+	switch (common->res) {
+	case MLX5_RES_QP:
+	case MLX5_RES_RQ:
+	case MLX5_RES_SQ:
+		return (qp->qpn | (common->res << 24)) == rsn;
+	default:
+		return false;
+	}
+}
+
 static struct mlx5_core_rsc_common *mlx5_get_rsc(struct mlx5_core_dev *dev,
 						 u32 rsn)
 {
 	struct mlx5_qp_table *table = &dev->priv.qp_table;
 	struct mlx5_core_rsc_common *common;
 
+	rcu_read_lock();
+	common = mlx5_rsc_array_lookup(&table->array, rsn);
+	if (likely(common && mlx5_rsc_array_match(common, rsn) &&
+		   atomic_inc_not_zero(&common->refcount))) {
+		rcu_read_unlock();
+		return common;
+	}
+	rcu_read_unlock();
+
 	spin_lock(&table->lock);
 
 	common = radix_tree_lookup(&table->tree, rsn);
@@ -198,16 +222,19 @@ static int create_qprqsq_common(struct mlx5_core_dev *dev,
 	int err;
 
 	qp->common.res = rsc_type;
+	atomic_set(&qp->common.refcount, 1);
+	init_completion(&qp->common.free);
+	qp->pid = current->pid;
+
 	spin_lock_irq(&table->lock);
 	err = radix_tree_insert(&table->tree, qp->qpn | (rsc_type << 24), qp);
+	if (!err)
+		mlx5_rsc_array_insert(&table->array,
+				      qp->qpn | (rsc_type << 24), qp);
 	spin_unlock_irq(&table->lock);
 	if (err)
 		return err;
 
-	atomic_set(&qp->common.refcount, 1);
-	init_completion(&qp->common.free);
-	qp->pid = current->pid;
-
 	return 0;
 
 }
@@ -217,11 +244,18 @@ static void destroy_qprqsq_common(struct mlx5_core_dev *dev,
 {
 	struct mlx5_qp_table *table = &dev->priv.qp_table;
 	unsigned long flags;
+	bool cached;
 
 	spin_lock_irqsave(&table->lock, flags);
 	radix_tree_delete(&table->tree, qp->qpn | (rsc_type << 24));
+	cached = mlx5_rsc_array_remove(&table->array,
+				       qp->qpn | (rsc_type << 24), qp);
 	spin_unlock_irqrestore(&table->lock, flags);
 
+	/* lockless readers may still hold qp */
+	if (cached)
+		synchronize_rcu();
+
 	mlx5_core_put_rsc((struct mlx5_core_rsc_common *)qp);
 	wait_for_completion(&qp->common.free);
 }
@@ -330,12 +364,14 @@ void mlx5_init_qp_table(struct mlx5_core_dev *dev)
 	memset(table, 0, sizeof(*table));
 	spin_lock_init(&table->lock);
 	INIT_RADIX_TREE(&table->tree, GFP_ATOMIC);
+	mlx5_rsc_array_init(&table->array, MLX5_CAP_GEN(dev, log_max_qp));
 	mlx5_qp_debugfs_init(dev);
 }
 
 void mlx5_cleanup_qp_table(struct mlx5_core_dev *dev)
 {
 	mlx5_qp_debugfs_cleanup(dev);
+	mlx5_rsc_array_cleanup(&dev->priv.qp_table.array);
 }
 
 void mlx5_init_dct_table(struct mlx5_core_dev *dev)
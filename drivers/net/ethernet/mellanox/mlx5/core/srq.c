@@ -39,11 +39,20 @@
 #include <rdma/ib_verbs.h>
 #include "mlx5_core.h"
 
-void mlx5_srq_event(struct mlx5_core_dev *dev, u32 srqn, int event_type)
+static struct mlx5_core_srq *mlx5_get_srq(struct mlx5_srq_table *table,
+					 u32 srqn)
 {
-	struct mlx5_srq_table *table = &dev->priv.srq_table;
 	struct mlx5_core_srq *srq;
 
+	rcu_read_lock();
+	srq = mlx5_rsc_array_lookup(&table->array, srqn);
+	if (likely(srq && srq->srqn == srqn &&
+		   atomic_inc_not_zero(&srq->refcount))) {
+		rcu_read_unlock();
+		return srq;
+	}
+	rcu_read_unlock();
+
 	spin_lock(&table->lock);
 
 	srq = radix_tree_lookup(&table->tree, srqn);
@@ -52,6 +61,15 @@ void mlx5_srq_event(struct mlx5_core_dev *dev, u32 srqn, int event_type)
 
 	spin_unlock(&table->lock);
 
+	return srq;
+}
+
+void mlx5_srq_event(struct mlx5_core_dev *dev, u32 srqn, int event_type)
+{
+	struct mlx5_srq_table *table = &dev->priv.srq_table;
+	struct mlx5_core_srq *srq;
+
+	srq = mlx5_get_srq(table, srqn);
 	if (!srq) {
 		mlx5_core_warn(dev, "Async event for bogus SRQ 0x%08x\n", srqn);
 		return;
@@ -131,18 +149,7 @@ static void rmpc_srqc_reformat(void *srqc, void *rmpc, bool srqc_to_rmpc)
 
 struct mlx5_core_srq *mlx5_core_get_srq(struct mlx5_core_dev *dev, u32 srqn)
 {
-	struct mlx5_srq_table *table = &dev->priv.srq_table;
-	struct mlx5_core_srq *srq;
-
-	spin_lock(&table->lock);
-
-	srq = radix_tree_lookup(&table->tree, srqn);
-	if (srq)
-		atomic_inc(&srq->refcount);
-
-	spin_unlock(&table->lock);
-
-	return srq;
+	return mlx5_get_srq(&dev->priv.srq_table, srqn);
 }
 EXPORT_SYMBOL(mlx5_core_get_srq);
 
@@ -441,6 +448,8 @@ int mlx5_core_create_srq(struct mlx5_core_dev *dev, struct mlx5_core_srq *srq,
 
 	spin_lock_irq(&table->lock);
 	err = radix_tree_insert(&table->tree, srq->srqn, srq);
+	if (!err)
+		mlx5_rsc_array_insert(&table->array, srq->srqn, srq);
 	spin_unlock_irq(&table->lock);
 	if (err) {
 		mlx5_core_warn(dev, "err %d, srqn 0x%x\n", err, srq->srqn);
@@ -460,11 +469,16 @@ int mlx5_core_destroy_srq(struct mlx5_core_dev *dev, struct mlx5_core_srq *srq)
 {
 	struct mlx5_srq_table *table = &dev->priv.srq_table;
 	struct mlx5_core_srq *tmp;
+	bool cached;
 	int err;
 
 	spin_lock_irq(&table->lock);
 	tmp = radix_tree_delete(&table->tree, srq->srqn);
+	cached = mlx5_rsc_array_remove(&table->array, srq->srqn, srq);
 	spin_unlock_irq(&table->lock);
+	/* lockless readers may still hold srq */
+	if (cached)
+		synchronize_rcu();
 	if (!tmp) {
 		mlx5_core_warn(dev, "srq 0x%x not found in tree\n", srq->srqn);
 		return -EINVAL;
@@ -517,9 +531,10 @@ void mlx5_init_srq_table(struct mlx5_core_dev *dev)
 	memset(table, 0, sizeof(*table));
 	spin_lock_init(&table->lock);
 	INIT_RADIX_TREE(&table->tree, GFP_ATOMIC);
+	mlx5_rsc_array_init(&table->array, MLX5_CAP_GEN(dev, log_max_srq));
 }
 
 void mlx5_cleanup_srq_table(struct mlx5_core_dev *dev)
 {
-	/* nothing */
+	mlx5_rsc_array_cleanup(&dev->priv.srq_table.array);
 }
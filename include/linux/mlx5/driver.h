@@ -41,6 +41,7 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/radix-tree.h>
+#include <linux/interrupt.h>
 
 #include <linux/mlx5/device.h>
 #include <linux/mlx5/doorbell.h>
@@ -373,6 +374,16 @@ struct mlx5_buf {
 	u8			page_shift;
 };
 
+struct mlx5_eq_stats {
+	u64			irqs;
+	/* tasklet runs that continued a budget-limited interrupt */
+	u64			polls;
+	u64			eqes;
+	u32			max_eqes_per_irq;
+	u64			irq_time_ns;
+	u64			max_irq_time_ns;
+};
+
 struct mlx5_eq {
 	struct mlx5_core_dev   *dev;
 	__be32 __iomem	       *doorbell;
@@ -386,6 +397,8 @@ struct mlx5_eq {
 	int			index;
 	struct mlx5_rsc_debug	*dbg;
 	cpumask_var_t		affinity_mask;
+	struct tasklet_struct	tasklet;
+	struct mlx5_eq_stats	stats;
 };
 
 struct mlx5_core_psv {
@@ -468,11 +481,22 @@ struct mlx5_core_health {
 	struct work_struct		work;
 };
 
+/* Direct indexed front end of a resource radix tree. Slot i caches the
+ * first resource inserted whose number has i in its low bits, others are
+ * found through the tree only. Readers run under RCU and must check the
+ * number of the resource they get, writers hold the owning table lock.
+ */
+struct mlx5_rsc_array {
+	void __rcu	      **slots;
+	u32			mask;
+};
+
 struct mlx5_cq_table {
 	/* protect radix tree
 	 */
 	spinlock_t		lock;
 	struct radix_tree_root	tree;
+	struct mlx5_rsc_array	array;
 };
 
 struct mlx5_qp_table {
@@ -480,6 +504,7 @@ struct mlx5_qp_table {
 	 */
 	spinlock_t		lock;
 	struct radix_tree_root	tree;
+	struct mlx5_rsc_array	array;
 };
 
 struct mlx5_srq_table {
@@ -487,6 +512,7 @@ struct mlx5_srq_table {
 	 */
 	spinlock_t		lock;
 	struct radix_tree_root	tree;
+	struct mlx5_rsc_array	array;
 };
 
 struct mlx5_mr_table {
@@ -543,6 +569,28 @@ struct mlx5_eswitch {
 	int                     enabled_vports;
 };
 
+struct mlx5_fc_stats {
+	/* counters tracked by the stats worker, sorted by id */
+	struct rb_root		counters;
+	/* protect counters tree against debugfs readers */
+	struct mutex		counters_lock;
+	/* counters waiting to be inserted into the tree */
+	struct list_head	addlist;
+	/* released counters kept allocated in firmware for reuse */
+	struct list_head	pool;
+	int			pool_size;
+	/* protect addlist, pool and the counters deleted flag */
+	spinlock_t		addlist_lock;
+
+	struct workqueue_struct	*wq;
+	struct delayed_work	work;
+	unsigned long		next_query;
+	unsigned long		sampling_interval;
+	/* max counters per QUERY_FLOW_COUNTER, from the HCA caps */
+	int			bulk_query_max;
+	struct dentry		*debugfs;
+};
+
 struct mlx5_vf_context {
 	int	enabled;
 };
@@ -567,6 +615,28 @@ struct mlx5_irq_info {
 	char name[MLX5_MAX_IRQ_NAME];
 };
 
+struct mlx5_pages_stats {
+	u64			boot_pages_time_us;
+	u64			init_pages_time_us;
+	u64			chunks_allocated;
+	u64			chunks_freed;
+	u64			order_fallbacks;
+	struct dentry	       *debugfs;
+};
+
+struct mlx5_pages_reclaim {
+	/* protects reqs and pending */
+	spinlock_t		lock;
+	struct list_head	reqs;
+	struct work_struct	work;
+	wait_queue_head_t	vf_wait;
+	u64			pending;
+	u64			requested;
+	u64			reclaimed;
+	u64			batches;
+	u64			max_batch_us;
+};
+
 struct mlx5_priv {
 	char			name[MLX5_MAX_NAME_LEN];
 	struct mlx5_eq_table	eq_table;
@@ -579,11 +649,18 @@ struct mlx5_priv {
 
 	/* pages stuff */
 	struct workqueue_struct *pg_wq;
-	struct rb_root		page_root;
+	/* runs the slices of large give requests in parallel */
+	struct workqueue_struct *pg_give_wq;
+	/* protects page_tree, free_list, chunk_list and the counters below */
+	struct mutex		page_lock;
+	struct radix_tree_root	page_tree;
 	int			fw_pages;
 	atomic_t		reg_pages;
 	struct list_head	free_list;
+	struct list_head	chunk_list;
 	int			vfs_pages;
+	struct mlx5_pages_stats	pages_stats;
+	struct mlx5_pages_reclaim pages_reclaim;
 
 	struct mlx5_core_health health;
 
@@ -629,6 +706,7 @@ struct mlx5_priv {
 
 	struct mlx5_eswitch     eswitch;
 	struct mlx5_core_sriov	sriov;
+	struct mlx5_fc_stats	fc_stats;
 	unsigned long		pci_dev_data;
 };
 
@@ -959,7 +1037,7 @@ int mlx5_core_alloc_pd(struct mlx5_core_dev *dev, u32 *pdn);
 int mlx5_core_dealloc_pd(struct mlx5_core_dev *dev, u32 pdn);
 int mlx5_core_mad_ifc(struct mlx5_core_dev *dev, void *inb, void *outb,
 		      u16 opmod, u8 port);
-void mlx5_pagealloc_init(struct mlx5_core_dev *dev);
+int mlx5_pagealloc_init(struct mlx5_core_dev *dev);
 void mlx5_pagealloc_cleanup(struct mlx5_core_dev *dev);
 int mlx5_pagealloc_start(struct mlx5_core_dev *dev);
 void mlx5_pagealloc_stop(struct mlx5_core_dev *dev);
@@ -99,6 +99,8 @@ void mlx5_destroy_flow_group(struct mlx5_flow_group *fg);
 
 /* Single destination per rule.
  * Group ID is implied by the match criteria.
+ * Adding MLX5_FLOW_CONTEXT_ACTION_COUNT to action attaches a flow counter
+ * to the rule, rules sharing the same match value and action share it.
  */
 struct mlx5_flow_rule *
 mlx5_add_flow_rule(struct mlx5_flow_table *ft,
@@ -110,6 +112,12 @@ mlx5_add_flow_rule(struct mlx5_flow_table *ft,
 		   struct mlx5_flow_destination *dest);
 void mlx5_del_flow_rule(struct mlx5_flow_rule *fr);
 
+/* Returns the counter values cached by the last periodic bulk query,
+ * no firmware command is issued. lastuse is in jiffies.
+ */
+int mlx5_flow_rule_get_stats(struct mlx5_flow_rule *fr,
+			     u64 *packets, u64 *bytes, u64 *lastuse);
+
 
 
 
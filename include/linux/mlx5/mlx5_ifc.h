@@ -202,6 +202,9 @@ enum {
 	MLX5_CMD_OP_SET_FLOW_TABLE_ENTRY          = 0x936,
 	MLX5_CMD_OP_QUERY_FLOW_TABLE_ENTRY        = 0x937,
 	MLX5_CMD_OP_DELETE_FLOW_TABLE_ENTRY       = 0x938,
+	MLX5_CMD_OP_ALLOC_FLOW_COUNTER            = 0x939,
+	MLX5_CMD_OP_DEALLOC_FLOW_COUNTER          = 0x93a,
+	MLX5_CMD_OP_QUERY_FLOW_COUNTER            = 0x93b,
 	MLX5_CMD_OP_SET_WOL_ROL		  	  = 0x830,
 	MLX5_CMD_OP_QUERY_WOL_ROL		  = 0x831,
 };
@@ -266,7 +269,9 @@ struct mlx5_ifc_flow_table_fields_supported_bits {
 
 struct mlx5_ifc_flow_table_prop_layout_bits {
 	u8         ft_support[0x1];
-	u8         reserved_0[0x3];
+	u8         reserved_0[0x1];
+	u8         flow_counter[0x1];
+	u8         reserved_9[0x1];
 	u8         modify_root[0x1];
 	u8         reserved_1[0x1b];
 
@@ -807,7 +812,9 @@ struct mlx5_ifc_cmd_hca_cap_bits {
 	u8         reserved_44[0xb];
 	u8         log_max_xrcd[0x5];
 
-	u8         reserved_45[0x20];
+	u8         reserved_45[0x8];
+	u8         log_max_flow_counter_bulk[0x8];
+	u8         max_flow_counter[0x10];
 
 	u8         reserved_46[0x3];
 	u8         log_max_rq[0x5];
@@ -883,6 +890,19 @@ struct mlx5_ifc_dest_format_struct_bits {
 	u8         reserved_0[0x20];
 };
 
+struct mlx5_ifc_flow_counter_list_bits {
+	u8         reserved_0[0x10];
+	u8         flow_counter_id[0x10];
+
+	u8         reserved_1[0x20];
+};
+
+struct mlx5_ifc_traffic_counter_bits {
+	u8         packets[0x40];
+
+	u8         octets[0x40];
+};
+
 struct mlx5_ifc_fte_match_param_bits {
 	struct mlx5_ifc_fte_match_set_lyr_2_4_bits outer_headers;
 
@@ -1910,6 +1930,7 @@ enum {
 	MLX5_FLOW_CONTEXT_ACTION_ALLOW     = 0x1,
 	MLX5_FLOW_CONTEXT_ACTION_DROP      = 0x2,
 	MLX5_FLOW_CONTEXT_ACTION_FWD_DEST  = 0x4,
+	MLX5_FLOW_CONTEXT_ACTION_COUNT     = 0x8,
 };
 
 struct mlx5_ifc_flow_context_bits {
@@ -1926,11 +1947,14 @@ struct mlx5_ifc_flow_context_bits {
 	u8         reserved_3[0x8];
 	u8         destination_list_size[0x18];
 
-	u8         reserved_4[0x160];
+	u8         reserved_4[0x8];
+	u8         flow_counter_list_size[0x18];
+
+	u8         reserved_5[0x140];
 
 	struct mlx5_ifc_fte_match_param_bits match_value;
 
-	u8         reserved_5[0x600];
+	u8         reserved_6[0x600];
 
 	struct mlx5_ifc_dest_format_struct_bits destination[0];
 };
@@ -5296,6 +5320,78 @@ struct mlx5_ifc_delete_fte_in_bits {
 	u8         reserved_6[0xe0];
 };
 
+struct mlx5_ifc_alloc_flow_counter_out_bits {
+	u8         status[0x8];
+	u8         reserved_0[0x18];
+
+	u8         syndrome[0x20];
+
+	u8         reserved_1[0x10];
+	u8         flow_counter_id[0x10];
+
+	u8         reserved_2[0x20];
+};
+
+struct mlx5_ifc_alloc_flow_counter_in_bits {
+	u8         opcode[0x10];
+	u8         reserved_0[0x10];
+
+	u8         reserved_1[0x10];
+	u8         op_mod[0x10];
+
+	u8         reserved_2[0x40];
+};
+
+struct mlx5_ifc_dealloc_flow_counter_out_bits {
+	u8         status[0x8];
+	u8         reserved_0[0x18];
+
+	u8         syndrome[0x20];
+
+	u8         reserved_1[0x40];
+};
+
+struct mlx5_ifc_dealloc_flow_counter_in_bits {
+	u8         opcode[0x10];
+	u8         reserved_0[0x10];
+
+	u8         reserved_1[0x10];
+	u8         op_mod[0x10];
+
+	u8         reserved_2[0x10];
+	u8         flow_counter_id[0x10];
+
+	u8         reserved_3[0x20];
+};
+
+struct mlx5_ifc_query_flow_counter_out_bits {
+	u8         status[0x8];
+	u8         reserved_0[0x18];
+
+	u8         syndrome[0x20];
+
+	u8         reserved_1[0x40];
+
+	struct mlx5_ifc_traffic_counter_bits flow_statistics[0];
+};
+
+struct mlx5_ifc_query_flow_counter_in_bits {
+	u8         opcode[0x10];
+	u8         reserved_0[0x10];
+
+	u8         reserved_1[0x10];
+	u8         op_mod[0x10];
+
+	u8         reserved_2[0x80];
+
+	u8         clear[0x1];
+	u8         reserved_3[0xf];
+	u8         num_of_counters[0x10];
+
+	u8         reserved_4[0x10];
+	u8         flow_counter_id[0x10];
+};
+
 struct mlx5_ifc_dealloc_xrcd_out_bits {
 	u8         status[0x8];
 	u8         reserved_0[0x18];